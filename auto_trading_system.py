@@ -7,7 +7,8 @@ from datetime import datetime, timedelta
 import numpy as np
 import pandas as pd
 
-from vnpy.event import EventEngine
+from vnpy.event import EventEngine, Event
+from vnpy.trader.event import EVENT_ACCOUNT, EVENT_ORDER, EVENT_TRADE
 from vnpy.trader.engine import MainEngine
 from vnpy.trader.ui import create_qapp
 from vnpy_ctp import CtpGateway
@@ -16,6 +17,9 @@ from src.market_data.market_data_service import MarketDataService
 from src.models.ml_model import PricePredictionModel
 from src.strategies.predictive_trading_strategy import PredictiveTradingStrategy
 from src.data.data_processor import DataProcessor
+from src.trading.tca import TCARecorder
+from src.risk_management.kill_switch import KillSwitch
+from src.risk_management.daily_drawdown_risk import DailyDrawdownRisk
 
 
 class AutoTradingSystem:
@@ -38,6 +42,21 @@ class AutoTradingSystem:
         # 初始化数据处理器
         self.data_processor = DataProcessor()
         
+        # 交易成本分析：委托/成交回报转给TCA记录器
+        self.tca = TCARecorder(strategy='auto_trading')
+        self.event_engine.register(EVENT_ORDER, self.process_order_event)
+        self.event_engine.register(EVENT_TRADE, self.process_trade_event)
+        
+        # 全局熔断：创建 KILL 文件或 kill -USR1 <pid> 即撤销全部委托并平仓
+        self.kill_switch = KillSwitch(self.main_engine, self.event_engine, flatten=True)
+        self.kill_switch.install()
+        self.kill_switch.watch_file("KILL")
+        self.kill_switch.listen_signal()
+        
+        # 日内回撤超限时触发全局熔断（撤单并平仓），账户回报驱动
+        self.drawdown_risk = DailyDrawdownRisk(max_daily_loss=50000, kill_switch=self.kill_switch)
+        self.event_engine.register(EVENT_ACCOUNT, self.process_account_event)
+        
         # 当前交易状态
         self.is_trading_active = False
         self.active_contracts = ["rb2602", "cu2602", "ni2602"]  # 默认活跃合约列表
@@ -52,6 +71,18 @@ class AutoTradingSystem:
         self.shutdown()
         sys.exit(0)
     
+    def process_order_event(self, event: Event):
+        """委托回报"""
+        self.tca.on_order(event.data)
+    
+    def process_trade_event(self, event: Event):
+        """成交回报"""
+        self.tca.on_trade(event.data)
+    
+    def process_account_event(self, event: Event):
+        """账户回报：检查日内回撤"""
+        self.drawdown_risk.update_account(event.data)
+    
     def is_trading_time(self):
         """检查当前是否在交易时间内"""
         now = datetime.now().time()
@@ -211,6 +242,10 @@ class AutoTradingSystem:
     
     def execute_trade_based_on_prediction(self, symbol, prediction):
         """根据预测结果执行交易"""
+        if self.kill_switch.tripped:
+            print(f"熔断已触发（{self.kill_switch.reason}），停止交易")
+            return False
+            
         if prediction['confidence'] < 0.005:  # 置信度太低，不交易
             print(f"预测置信度太低({prediction['confidence']:.3f})，跳过交易")
             return False
@@ -236,31 +271,38 @@ class AutoTradingSystem:
             if prediction['direction'] == '上涨':
                 # 买入开多
                 print(f"执行买入开多操作 - 合约: {symbol}, 价格: {current_tick.ask_price_1}")
+                record = self.tca.decide(symbol, 1, fixed_size, current_tick.last_price)
+                limit_price = current_tick.ask_price_1 + price_offset
+                self.tca.before_send(record)
                 order_id = self.main_engine.send_order(
                     symbol=symbol,
                     exchange=current_tick.exchange,
                     direction='long',
                     type='limit',
                     volume=fixed_size,
-                    price=current_tick.ask_price_1 + price_offset,
+                    price=limit_price,
                     offset='open'
                 )
             elif prediction['direction'] == '下跌':
                 # 卖出开空
                 print(f"执行卖出开空操作 - 合约: {symbol}, 价格: {current_tick.bid_price_1}")
+                record = self.tca.decide(symbol, -1, fixed_size, current_tick.last_price)
+                limit_price = current_tick.bid_price_1 - price_offset
+                self.tca.before_send(record)
                 order_id = self.main_engine.send_order(
                     symbol=symbol,
                     exchange=current_tick.exchange,
                     direction='short',
                     type='limit',
                     volume=fixed_size,
-                    price=current_tick.bid_price_1 - price_offset,
+                    price=limit_price,
                     offset='open'
                 )
             else:
                 print("预测为横盘，暂不交易")
                 return False
                 
+            self.tca.on_send(record, order_id, limit_price)
             if order_id:
                 print(f"订单已发送: {order_id}")
                 return True
@@ -299,6 +341,8 @@ class AutoTradingSystem:
                     tick = self.get_latest_market_data(symbol)
                     
                     if tick:
+                        self.tca.on_tick(tick)
+                        
                         # 添加到历史数据
                         ticks_history[symbol].append(tick)
                         
@@ -340,6 +384,13 @@ class AutoTradingSystem:
         """关闭系统"""
         print("正在关闭自动交易系统...")
         
+        # 输出交易成本汇总
+        self.tca.flush()
+        if self.tca.results:
+            print(self.tca.summary(by=['symbol']))
+        
+        self.kill_switch.close()
+        
         # 关闭连接
         try:
             self.main_engine.close()
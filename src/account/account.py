@@ -321,6 +321,14 @@ class AccountManager:
             "position_details": position_details
         }
 
+    def get_trade_analytics(self, store=None, **kwargs):
+        """
+        逐笔回合交易分析（MAE/MFE、持仓时间、分时段盈亏等），见 src.account.trade_analytics
+        :param store: K线仓库，提供时计算MAE/MFE与信号衰减
+        """
+        from src.account.trade_analytics import analyze_trades
+        return analyze_trades(self.trade_records, store=store, **kwargs)
+
 
 # 示例使用
 if __name__ == "__main__":
@@ -0,0 +1,404 @@
+"""
+成交分析模块
+把成交记录（AccountManager.trade_records、vnpy TradeData、回测持仓序列）按合约先进先出配对为回合交易，
+对每笔回合交易计算：
+- 最大不利/有利偏移（MAE/MFE，价格点、跳数、金额）及到达极值所用K线数
+- 持仓时间、持仓K线数、毛/净盈亏
+- 按交易时段、入场小时、市场状态、方向、合约分组的统计
+- 信号到成交的衰减：信号价到成交价的滑点，以及从信号时刻/成交时刻起算的后续收益（markout）
+配对与逐笔K线扫描为numba编译的单次遍历，其余为数组运算；一个月的剥头皮成交可在亚秒级完成分析，
+用于依据实际偏移分布设定止盈止损
+"""
+from typing import Dict, Iterable, List, Optional, Sequence, Union
+
+import numpy as np
+import pandas as pd
+from numba import njit
+
+from src.data.bar_store import symbol_to_code
+from src.trading.contract_specs import get_contract_spec
+from src.trading.sessions import build_session_map, get_sessions
+from src.utils.direction import direction_sign
+
+
+FILL_COLUMNS = ('datetime', 'symbol', 'side', 'volume', 'price', 'commission', 'signal_datetime', 'signal_price')
+
+def _to_cst(values) -> pd.Series:
+    """时间统一为不带时区的北京时间"""
+    times = pd.to_datetime(pd.Series(values))
+    if times.dt.tz is not None:
+        times = times.dt.tz_convert('Asia/Shanghai').dt.tz_localize(None)
+    return times
+
+
+def fills_from_records(records: Iterable) -> pd.DataFrame:
+    """
+    成交记录标准化
+    :param records: AccountManager.trade_records（字典：symbol/direction/volume/price/trade_time/commission），
+                    或 vnpy TradeData 列表（symbol/direction/volume/price/datetime）；
+                    可选 signal_time/signal_price 字段记录产生信号的时刻与当时价格
+    :return: 列为 FILL_COLUMNS 的DataFrame，按时间排序
+    """
+    rows = []
+    for record in records:
+        get = record.get if isinstance(record, dict) else (lambda key, default=None: getattr(record, key, default))
+        rows.append({
+            'datetime': get('trade_time') or get('datetime'),
+            'symbol': get('symbol') or get('vt_symbol'),
+            'side': direction_sign(get('direction')),
+            'volume': float(get('volume')),
+            'price': float(get('price')),
+            'commission': float(get('commission', 0.0) or 0.0),
+            'signal_datetime': get('signal_time'),
+            'signal_price': get('signal_price'),
+        })
+    fills = pd.DataFrame(rows, columns=list(FILL_COLUMNS))
+    if fills.empty:
+        return fills
+    fills['datetime'] = _to_cst(fills['datetime']).values
+    fills['signal_datetime'] = _to_cst(fills['signal_datetime']).values
+    fills['signal_price'] = pd.to_numeric(fills['signal_price'], errors='coerce')
+    return fills.sort_values('datetime', kind='stable').reset_index(drop=True)
+
+
+def fills_from_positions(positions: np.ndarray, arrays: Dict[str, np.ndarray], symbol: str,
+                         signal_shift: int = 0) -> pd.DataFrame:
+    """
+    回测的逐K线目标持仓 -> 成交：持仓变化时按该K线收盘价成交（at_bar_close 列为True，MAE/MFE不计该K线）
+    :param positions: 每根K线收盘后的持仓手数（多正空负），与 arrays 等长
+    :param arrays: 列式K线数据（BarStore.load_arrays）
+    :param signal_shift: 信号比成交早的K线数（如下一根K线开盘成交时为1），用于信号衰减分析
+    """
+    positions = np.asarray(positions, dtype=np.float64)
+    delta = np.diff(positions, prepend=0.0)
+    idx = np.flatnonzero(delta != 0)
+    signal_idx = np.maximum(idx - signal_shift, 0)
+    datetimes = np.asarray(arrays['datetime'], dtype=np.int64)
+    return pd.DataFrame({
+        'datetime': datetimes[idx].astype('datetime64[ns]'),
+        'symbol': symbol,
+        'side': np.sign(delta[idx]).astype(np.int64),
+        'volume': np.abs(delta[idx]),
+        'price': arrays['close'][idx],
+        'commission': 0.0,
+        'signal_datetime': datetimes[signal_idx].astype('datetime64[ns]'),
+        'signal_price': arrays['close'][signal_idx],
+        'at_bar_close': True,
+    })
+
+
+@njit(cache=True)
+def _fifo_pair(side, volume):
+    """
+    先进先出配对
+    :return: (开仓成交下标, 平仓成交下标, 数量, 方向)，方向为开仓成交的方向；以及未平仓的 (成交下标, 剩余数量)
+    """
+    n = side.shape[0]
+    lot_fill = np.empty(n, dtype=np.int64)
+    lot_left = np.empty(n)
+    head, tail = 0, 0
+    out_entry = np.empty(2 * n, dtype=np.int64)
+    out_exit = np.empty(2 * n, dtype=np.int64)
+    out_qty = np.empty(2 * n)
+    out_dir = np.empty(2 * n, dtype=np.int64)
+    count = 0
+
+    for i in range(n):
+        left = volume[i]
+        # 与队列中反向的持仓配对
+        while left > 1e-12 and head < tail and side[lot_fill[head]] != side[i]:
+            matched = min(left, lot_left[head])
+            out_entry[count] = lot_fill[head]
+            out_exit[count] = i
+            out_qty[count] = matched
+            out_dir[count] = side[lot_fill[head]]
+            count += 1
+            left -= matched
+            lot_left[head] -= matched
+            if lot_left[head] <= 1e-12:
+                head += 1
+        if left > 1e-12:
+            lot_fill[tail] = i
+            lot_left[tail] = left
+            tail += 1
+
+    return (out_entry[:count], out_exit[:count], out_qty[:count], out_dir[:count],
+            lot_fill[head:tail].copy(), lot_left[head:tail].copy())
+
+
+@njit(cache=True)
+def _excursions(bar_high, bar_low, lo, first, hi, direction, entry_price):
+    """
+    逐笔扫描持仓期间的K线 [first, hi]，first 为 lo（成交所在K线）或按收盘价成交时的下一根
+    :return: (最大有利偏移, 最大不利偏移, 到达MFE的K线数, 到达MAE的K线数)，单位为价格，K线数从 lo 起算
+    """
+    n = lo.shape[0]
+    mfe = np.zeros(n)
+    mae = np.zeros(n)
+    mfe_bar = np.zeros(n, dtype=np.int64)
+    mae_bar = np.zeros(n, dtype=np.int64)
+    for t in range(n):
+        for k in range(first[t], hi[t] + 1):
+            if direction[t] > 0:
+                favorable = bar_high[k] - entry_price[t]
+                adverse = entry_price[t] - bar_low[k]
+            else:
+                favorable = entry_price[t] - bar_low[k]
+                adverse = bar_high[k] - entry_price[t]
+            if favorable > mfe[t]:
+                mfe[t] = favorable
+                mfe_bar[t] = k - lo[t]
+            if adverse > mae[t]:
+                mae[t] = adverse
+                mae_bar[t] = k - lo[t]
+    return mfe, mae, mfe_bar, mae_bar
+
+
+def pair_trades(fills: pd.DataFrame) -> pd.DataFrame:
+    """
+    按合约先进先出配对为回合交易；一笔成交可拆成多笔回合（部分平仓），手续费按数量分摊
+    :return: 每行一笔回合交易
+    """
+    frames = []
+    for symbol, group in fills.groupby('symbol', sort=False):
+        side = group['side'].values.astype(np.int64)
+        volume = group['volume'].values.astype(np.float64)
+        entry, exit_, qty, direction, _, _ = _fifo_pair(side, volume)
+        if len(entry) == 0:
+            continue
+        g = {column: group[column].values for column in FILL_COLUMNS}
+        # 可选列：成交价为所在K线的收盘价（回测），成交时刻在K线结束处
+        at_close = (group['at_bar_close'].values.astype(bool) if 'at_bar_close' in group
+                    else np.zeros(len(group), dtype=bool))
+        commission = (g['commission'][entry] * qty / volume[entry] + g['commission'][exit_] * qty / volume[exit_])
+        frames.append(pd.DataFrame({
+            'symbol': symbol,
+            'direction': direction,
+            'volume': qty,
+            'entry_time': g['datetime'][entry],
+            'exit_time': g['datetime'][exit_],
+            'entry_price': g['price'][entry].astype(np.float64),
+            'exit_price': g['price'][exit_].astype(np.float64),
+            'commission': commission,
+            'signal_time': g['signal_datetime'][entry],
+            'signal_price': g['signal_price'][entry].astype(np.float64),
+            'entry_at_bar_close': at_close[entry],
+        }))
+    if not frames:
+        return pd.DataFrame(columns=['symbol', 'direction', 'volume', 'entry_time', 'exit_time', 'entry_price',
+                                     'exit_price', 'commission', 'signal_time', 'signal_price',
+                                     'entry_at_bar_close'])
+    trades = pd.concat(frames, ignore_index=True)
+    return trades.sort_values('entry_time', kind='stable').reset_index(drop=True)
+
+
+def open_positions(fills: pd.DataFrame) -> pd.DataFrame:
+    """尚未配对平仓的持仓（按成交列出剩余数量）"""
+    rows = []
+    for symbol, group in fills.groupby('symbol', sort=False):
+        *_, lot_fill, lot_left = _fifo_pair(group['side'].values.astype(np.int64),
+                                            group['volume'].values.astype(np.float64))
+        for i, left in zip(lot_fill, lot_left):
+            row = group.iloc[i]
+            rows.append({'symbol': symbol, 'side': row['side'], 'volume': left, 'price': row['price'],
+                         'datetime': row['datetime']})
+    return pd.DataFrame(rows)
+
+
+def _session_labels(symbol: str, times: pd.Series) -> np.ndarray:
+    session_index, _ = build_session_map(symbol)
+    sessions = get_sessions(symbol)
+    names = np.array([f"{start // 60 % 24:02d}:{start % 60:02d}-{end // 60 % 24:02d}:{end % 60:02d}"
+                      for start, end in sessions] + ['off-session'], dtype=object)
+    minutes = (times.dt.hour * 60 + times.dt.minute).values
+    return names[session_index[minutes]]
+
+
+def _lookup_regime(regimes, symbol: str, times: np.ndarray) -> np.ndarray:
+    """按入场时间取最近一个不晚于它的市场状态标签"""
+    series = regimes.get(symbol) if isinstance(regimes, dict) else regimes
+    if series is None or len(series) == 0:
+        return np.full(len(times), None, dtype=object)
+    index = pd.to_datetime(series.index).values.astype('datetime64[ns]')
+    pos = np.searchsorted(index, times.astype('datetime64[ns]'), side='right') - 1
+    values = np.asarray(series.values, dtype=object)
+    return np.where(pos >= 0, values[np.maximum(pos, 0)], None)
+
+
+class TradeAnalytics:
+    """
+    回合交易分析结果
+    trades 每行一笔回合交易，列包括 pnl/net_pnl（金额）、pnl_ticks、mfe_ticks/mae_ticks、
+    holding_seconds、bars_held、session、hour、regime，以及有信号信息时的 signal_slippage_ticks
+    """
+
+    def __init__(self, trades: pd.DataFrame, markouts: Dict[str, pd.DataFrame] = None):
+        self.trades = trades
+        self.markouts = markouts or {}
+
+    def summary(self) -> Dict[str, float]:
+        t = self.trades
+        if t.empty:
+            return {'trades': 0}
+        wins = t['net_pnl'] > 0
+        loss_sum = -t.loc[~wins, 'net_pnl'].sum()
+        result = {
+            'trades': len(t),
+            'win_rate': float(wins.mean()),
+            'net_pnl': float(t['net_pnl'].sum()),
+            'gross_pnl': float(t['pnl'].sum()),
+            'commission': float(t['commission'].sum()),
+            'profit_factor': float(t.loc[wins, 'net_pnl'].sum() / loss_sum) if loss_sum > 0 else np.inf,
+            'avg_pnl_ticks': float(t['pnl_ticks'].mean()),
+            'avg_holding_seconds': float(t['holding_seconds'].mean()),
+        }
+        if 'mfe_ticks' in t.columns:
+            result.update({
+                'avg_mfe_ticks': float(t['mfe_ticks'].mean()),
+                'avg_mae_ticks': float(t['mae_ticks'].mean()),
+                # 平均捕获的有利偏移比例：出场价相对MFE留下了多少利润
+                'mfe_capture': float(t['pnl_ticks'].sum() / t['mfe_ticks'].sum()) if t['mfe_ticks'].sum() > 0
+                else np.nan,
+            })
+        if 'signal_slippage_ticks' in t.columns and t['signal_slippage_ticks'].notna().any():
+            result['avg_signal_slippage_ticks'] = float(t['signal_slippage_ticks'].mean())
+        return result
+
+    def breakdown(self, by: Union[str, List[str]] = 'session') -> pd.DataFrame:
+        """
+        分组统计
+        :param by: 'session'、'hour'、'regime'、'direction'、'symbol' 或其组合
+        """
+        t = self.trades
+        if t.empty:
+            return pd.DataFrame()
+        group = t.groupby(by, dropna=False)
+        result = pd.DataFrame({
+            'trades': group.size(),
+            'win_rate': group['net_pnl'].apply(lambda x: (x > 0).mean()),
+            'net_pnl': group['net_pnl'].sum(),
+            'avg_pnl_ticks': group['pnl_ticks'].mean(),
+            'avg_holding_seconds': group['holding_seconds'].mean(),
+        })
+        if 'mfe_ticks' in t.columns:
+            result['avg_mfe_ticks'] = group['mfe_ticks'].mean()
+            result['avg_mae_ticks'] = group['mae_ticks'].mean()
+        return result
+
+    def excursion_profile(self, quantiles: Sequence[float] = (0.25, 0.5, 0.75, 0.9)) -> pd.DataFrame:
+        """
+        MAE/MFE 分位数（跳），按盈亏分开：亏损交易的MFE说明止盈可以更近，盈利交易的MAE说明止损需要多宽
+        """
+        t = self.trades
+        if t.empty or 'mfe_ticks' not in t.columns:
+            return pd.DataFrame()
+        outcome = np.where(t['net_pnl'] > 0, 'win', 'loss')
+        return t.groupby(outcome)[['mfe_ticks', 'mae_ticks']].quantile(list(quantiles)).unstack()
+
+    def edge_decay(self) -> pd.DataFrame:
+        """
+        信号衰减：各持有期的平均markout（跳），from_signal 从信号时刻与信号价起算，from_fill 从成交起算，
+        二者之差即信号到成交之间损失的优势
+        """
+        if not self.markouts:
+            return pd.DataFrame()
+        return pd.DataFrame({name: frame.mean() for name, frame in self.markouts.items()})
+
+
+def analyze_trades(fills: Union[pd.DataFrame, Iterable], store=None, bars: Dict[str, Dict[str, np.ndarray]] = None,
+                   regimes=None, horizons: Sequence[int] = (1, 5, 15, 30),
+                   specs: Dict[str, dict] = None) -> TradeAnalytics:
+    """
+    成交分析
+    :param fills: fills_from_records / fills_from_positions 的结果，或原始成交记录
+    :param store: K线仓库（BarStore / ResampledBarStore），用于MAE/MFE与信号衰减；也可直接传 bars
+    :param bars: {合约: 列式K线数据}
+    :param regimes: 市场状态标签，以时间为索引的Series，或 {合约: Series}
+    :param horizons: markout 的持有期（K线数）
+    :param specs: {合约: {'size', 'price_tick'}}，默认取 contract_specs
+    """
+    if not isinstance(fills, pd.DataFrame):
+        fills = fills_from_records(fills)
+    trades = pair_trades(fills)
+    if trades.empty:
+        return TradeAnalytics(trades)
+
+    n = len(trades)
+    size = np.empty(n)
+    tick = np.empty(n)
+    for symbol in trades['symbol'].unique():
+        spec = (specs or {}).get(symbol) or get_contract_spec(symbol_to_code(symbol))
+        mask = (trades['symbol'] == symbol).values
+        size[mask] = spec['size']
+        tick[mask] = spec['price_tick']
+
+    direction = trades['direction'].values
+    move = direction * (trades['exit_price'].values - trades['entry_price'].values)
+    trades['pnl'] = move * trades['volume'].values * size
+    trades['net_pnl'] = trades['pnl'] - trades['commission']
+    trades['pnl_ticks'] = move / tick
+    trades['holding_seconds'] = (trades['exit_time'] - trades['entry_time']).dt.total_seconds().values
+    trades['hour'] = trades['entry_time'].dt.hour
+    trades['session'] = None
+    trades['regime'] = None
+    if trades['signal_price'].notna().any():
+        trades['signal_slippage_ticks'] = direction * (trades['entry_price'] - trades['signal_price']).values / tick
+
+    markouts = {}
+    with_bars = store is not None or bars is not None
+    if with_bars:
+        for column in ('mfe_ticks', 'mae_ticks', 'mfe_bar', 'mae_bar', 'bars_held'):
+            trades[column] = np.nan
+        markouts = {'from_fill': pd.DataFrame(np.nan, index=trades.index, columns=list(horizons)),
+                    'from_signal': pd.DataFrame(np.nan, index=trades.index, columns=list(horizons))}
+
+    for symbol, index in trades.groupby('symbol', sort=False).groups.items():
+        rows = trades.loc[index]
+        trades.loc[index, 'session'] = _session_labels(symbol, rows['entry_time'])
+        if regimes is not None:
+            trades.loc[index, 'regime'] = _lookup_regime(regimes, symbol, rows['entry_time'].values)
+        if not with_bars:
+            continue
+
+        arrays = bars[symbol] if bars is not None else store.load_arrays(symbol)
+        bar_time = np.asarray(arrays['datetime'], dtype=np.int64)
+        entry_ns = rows['entry_time'].values.astype('datetime64[ns]').astype(np.int64)
+        exit_ns = rows['exit_time'].values.astype('datetime64[ns]').astype(np.int64)
+        # K线时间为K线开始时刻，成交所在的K线为最后一根开始时间不晚于成交时间的K线
+        lo = np.maximum(np.searchsorted(bar_time, entry_ns, side='right') - 1, 0)
+        hi = np.maximum(np.searchsorted(bar_time, exit_ns, side='right') - 1, lo)
+        d = rows['direction'].values.astype(np.int64)
+        entry_price = rows['entry_price'].values
+        exit_price = rows['exit_price'].values
+        # 按收盘价成交时入场K线的价格全部在入场之前，从下一根K线开始扫描；
+        # 盘中成交无法区分入场K线内成交前后的价格，整根计入
+        first = lo + rows['entry_at_bar_close'].values.astype(np.int64)
+        mfe, mae, mfe_bar, mae_bar = _excursions(arrays['high'], arrays['low'], lo, first, hi, d, entry_price)
+        # 偏移至少为出场价对应的有利/不利变动
+        mfe = np.maximum(mfe, d * (exit_price - entry_price))
+        mae = np.maximum(mae, -d * (exit_price - entry_price))
+        t = tick[trades.index.get_indexer(index)]
+        trades.loc[index, 'mfe_ticks'] = mfe / t
+        trades.loc[index, 'mae_ticks'] = mae / t
+        trades.loc[index, 'mfe_bar'] = mfe_bar
+        trades.loc[index, 'mae_bar'] = mae_bar
+        trades.loc[index, 'bars_held'] = hi - lo
+
+        close = arrays['close']
+        last = len(close) - 1
+        signal_ns = rows['signal_time'].values.astype('datetime64[ns]').astype(np.int64)
+        has_signal = ~np.isnat(rows['signal_time'].values) & np.isfinite(rows['signal_price'].values)
+        signal_bar = np.maximum(np.searchsorted(bar_time, signal_ns, side='right') - 1, 0)
+        for h in horizons:
+            ahead = lo + h
+            valid = ahead <= last
+            markouts['from_fill'].loc[index, h] = np.where(
+                valid, d * (close[np.minimum(ahead, last)] - entry_price) / t, np.nan)
+            ahead = signal_bar + h
+            valid = has_signal & (ahead <= last)
+            markouts['from_signal'].loc[index, h] = np.where(
+                valid, d * (close[np.minimum(ahead, last)] - rows['signal_price'].values) / t, np.nan)
+
+    if markouts and markouts['from_signal'].isna().all().all():
+        del markouts['from_signal']
+    return TradeAnalytics(trades, markouts)
@@ -0,0 +1,230 @@
+"""
+K线数据仓库模块
+按合约加载天勤(TqSdk)导出的K线CSV文件（解压后的目录或原始zip压缩包），统一转换为列式numpy数组，
+供标注、采样、重采样等批量计算使用
+"""
+import os
+import re
+import zipfile
+from concurrent.futures import ThreadPoolExecutor
+from typing import Dict, List, Optional
+
+import numpy as np
+import pandas as pd
+
+from src.data.fast_csv import CST_OFFSET_NS, parse_csv_bytes
+
+
+# 标准K线字段（与CSV中 {合约}.{字段} 列名对应）
+BAR_FIELDS = ['open', 'high', 'low', 'close', 'volume', 'open_oi', 'close_oi']
+
+# 文件名格式: {合约}.{周期秒数}.{开始时间}.{结束时间}.csv，如 SHFE.rb2602.60.2026-01-01 00_00_00.2026-01-26 00_00_00.csv
+_FILE_PATTERN = re.compile(r'^(?P<symbol>.+?)\.(?P<period>\d+)\.\d{4}-\d{2}-\d{2}')
+
+
+def parse_bar_filename(filename: str) -> Optional[tuple]:
+    """
+    解析K线文件名
+    :param filename: 文件名
+    :return: (合约代码, 周期秒数)，无法识别时返回None
+    """
+    if not filename.endswith('.csv'):
+        return None
+    match = _FILE_PATTERN.match(filename)
+    if not match:
+        return None
+    return match.group('symbol'), int(match.group('period'))
+
+
+def symbol_to_product(symbol: str) -> str:
+    """
+    从合约代码中提取品种代码
+    如 SHFE.rb2602 -> rb，KQ.m@SHFE.rb -> rb
+    """
+    code = symbol.split('.')[-1]
+    return re.sub(r'\d+$', '', code)
+
+
+def symbol_to_code(symbol: str) -> str:
+    """
+    从合约代码中提取不带交易所前缀的代码，用于查询合约规格
+    如 SHFE.rb2602 -> rb2602，KQ.m@SHFE.rb -> rb
+    """
+    return symbol.split('.')[-1]
+
+
+def parse_bar_csv(source, symbol: str) -> Dict[str, np.ndarray]:
+    """
+    解析K线CSV为列式数组（src.data.fast_csv 多线程解析）
+    时间直接取整数列 datetime_nano，不解析 datetime 字符串列
+    :param source: 文件路径或文件内容（bytes）
+    :return: {'datetime': int64纳秒(北京时间), 'open': float64, ...}
+    """
+    if not isinstance(source, bytes):
+        with open(source, 'rb') as f:
+            source = f.read()
+    columns = parse_csv_bytes(source)
+    if 'datetime_nano' not in columns:
+        raise ValueError(f"K线文件缺少 datetime_nano 列: {symbol}")
+
+    arrays = {
+        'datetime': columns['datetime_nano'] + CST_OFFSET_NS
+    }
+    for field in BAR_FIELDS:
+        column = f'{symbol}.{field}'
+        if column in columns:
+            arrays[field] = columns[column]
+    return arrays
+
+
+class BarStore:
+    """
+    K线数据仓库
+    扫描数据目录或zip压缩包中的K线文件，按需加载并缓存为列式数组；
+    压缩包成员直接在内存中解压解析，不生成临时文件
+    """
+
+    def __init__(self, data_dirs, period: int = 60):
+        """
+        :param data_dirs: 数据目录、zip压缩包或其列表，如 'data/rb_1min_2026_01_01_2026_01_26.zip'
+        :param period: K线周期（秒），默认60即1分钟K线
+        """
+        if isinstance(data_dirs, str):
+            data_dirs = [data_dirs]
+        self.data_dirs = list(data_dirs)
+        self.period = period
+
+        self.files: Dict[str, str] = {}  # 合约代码 -> 文件路径（压缩包内的合约为压缩包路径）
+        self.members: Dict[str, str] = {}  # 合约代码 -> 压缩包内的成员名
+        self._cache: Dict[str, Dict[str, np.ndarray]] = {}  # 合约代码 -> 列式数据
+
+        self.scan()
+
+    @classmethod
+    def from_root(cls, root: str = 'data', prefer_archives: bool = True, period: int = 60) -> "BarStore":
+        """
+        扫描根目录下的全部数据集
+        同一数据集同时有压缩包和解压目录时只使用其中一个，prefer_archives 为True时使用压缩包，
+        这样解压目录可以删除
+        """
+        archives, dirs = {}, {}
+        for name in sorted(os.listdir(root)):
+            path = os.path.join(root, name)
+            if name.endswith('.zip') and zipfile.is_zipfile(path):
+                archives[name[:-4]] = path
+            elif os.path.isdir(path):
+                dirs[name] = path
+
+        sources = []
+        for name in sorted(set(archives) | set(dirs)):
+            if name in archives and (prefer_archives or name not in dirs):
+                sources.append(archives[name])
+            else:
+                sources.append(dirs[name])
+        return cls(sources, period)
+
+    def scan(self):
+        """扫描数据目录与压缩包，登记可用的合约文件"""
+        for data_dir in self.data_dirs:
+            if data_dir.endswith('.zip') and os.path.isfile(data_dir):
+                with zipfile.ZipFile(data_dir) as archive:
+                    names = sorted(archive.namelist())
+                for member in names:
+                    self._register(os.path.basename(member), data_dir, member)
+                continue
+
+            if not os.path.isdir(data_dir):
+                print(f"数据目录不存在: {data_dir}")
+                continue
+
+            for filename in sorted(os.listdir(data_dir)):
+                self._register(filename, os.path.join(data_dir, filename))
+
+    def _register(self, filename: str, path: str, member: str = None):
+        parsed = parse_bar_filename(filename)
+        if not parsed:
+            return
+        symbol, period = parsed
+        if period != self.period:
+            return
+        self.files[symbol] = path
+        if member:
+            self.members[symbol] = member
+        else:
+            self.members.pop(symbol, None)
+
+    def symbols(self, product: str = None, include_index: bool = True) -> List[str]:
+        """
+        获取可用合约列表
+        :param product: 品种代码过滤，如 'rb'
+        :param include_index: 是否包含指数/主连合约（KQ.i@、KQ.m@）
+        """
+        result = []
+        for symbol in self.files:
+            if product and symbol_to_product(symbol) != product:
+                continue
+            if not include_index and symbol.startswith('KQ.'):
+                continue
+            result.append(symbol)
+        return result
+
+    def load_arrays(self, symbol: str) -> Dict[str, np.ndarray]:
+        """
+        加载合约的列式数据
+        :param symbol: 合约代码，如 'SHFE.rb2602'
+        :return: {'datetime': int64纳秒(北京时间), 'open': float64, ...}
+        """
+        if symbol in self._cache:
+            return self._cache[symbol]
+
+        if symbol not in self.files:
+            raise KeyError(f"找不到合约数据: {symbol}")
+
+        arrays = self._read(symbol)
+        self._cache[symbol] = arrays
+        return arrays
+
+    def _read(self, symbol: str) -> Dict[str, np.ndarray]:
+        """读取并解析单个合约，不访问缓存，可在线程中调用"""
+        path = self.files[symbol]
+        member = self.members.get(symbol)
+        if member is None:
+            return parse_bar_csv(path, symbol)
+
+        # 每次读取单独打开压缩包，ZipFile 对象不能跨线程共享；zlib解压时释放GIL
+        with zipfile.ZipFile(path) as archive:
+            data = archive.read(member)
+        return parse_bar_csv(data, symbol)
+
+    def load_many(self, symbols: List[str] = None, max_workers: int = None) -> Dict[str, Dict[str, np.ndarray]]:
+        """
+        并行加载多个合约（解压与CSV解析在线程池中进行），结果写入缓存
+        :param symbols: 合约列表，默认全部合约
+        :return: {合约: 列式数据}
+        """
+        symbols = symbols or list(self.files)
+        missing = [symbol for symbol in symbols if symbol not in self._cache]
+        for symbol in missing:
+            if symbol not in self.files:
+                raise KeyError(f"找不到合约数据: {symbol}")
+
+        if missing:
+            with ThreadPoolExecutor(max_workers=max_workers) as executor:
+                # 结果在主线程写入缓存
+                for symbol, arrays in zip(missing, executor.map(self._read, missing)):
+                    self._cache[symbol] = arrays
+        return {symbol: self._cache[symbol] for symbol in symbols}
+
+    def load_frame(self, symbol: str) -> pd.DataFrame:
+        """
+        加载合约数据为标准格式DataFrame（datetime索引，open/high/low/close/volume/open_oi/close_oi列）
+        """
+        arrays = self.load_arrays(symbol)
+        df = pd.DataFrame({field: arrays[field] for field in BAR_FIELDS if field in arrays})
+        df.index = pd.to_datetime(arrays['datetime'])
+        df.index.name = 'datetime'
+        return df
+
+    def clear_cache(self):
+        """清空缓存"""
+        self._cache.clear()
@@ -81,6 +81,17 @@ class DataCollector:
     def save_tick_data(self, tick):
         """保存实时tick数据到数据库"""
         self.database.save_tick_data([tick])
+    
+    def load_tick_data(self, symbol, exchange, start_date, end_date):
+        """
+        加载已记录的tick数据，可回放给 EventBarGenerator 构建事件K线
+        """
+        if isinstance(start_date, str):
+            start_date = datetime.strptime(start_date, "%Y-%m-%d")
+        if isinstance(end_date, str):
+            end_date = datetime.strptime(end_date, "%Y-%m-%d")
+        
+        return self.database.load_tick_data(symbol, exchange, start_date, end_date)
         
     def get_available_contracts(self, underlying_symbol=None):
         """获取可用的合约列表"""
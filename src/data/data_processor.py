@@ -1,27 +1,70 @@
 import numpy as np
 import pandas as pd
 from sklearn.preprocessing import StandardScaler, MinMaxScaler
-from ta import add_all_ta_features
 from ta.utils import dropna
 from sklearn.decomposition import PCA
-import talib
+from src.data.features.indicator_graph import IndicatorGraph
+from src.data.features.rolling_stats import rolling_order_stats
+from src.data.features.seasonality import seasonal_features
+
+
+# 特征工程指标定义，编译时共享 returns、滚动均值/方差、EWM 等公共计算
+FEATURE_SPEC = {
+    'returns': ('pct_change', 'close'),
+    'log_returns': ('log_return', 'close'),
+    'ma_5': ('sma', 'close', 5),
+    'ma_10': ('sma', 'close', 10),
+    'ma_20': ('sma', 'close', 20),
+    'ma_60': ('sma', 'close', 60),
+    'rsi': ('rsi', 'close', 14),
+    'bb_upper': ('bollinger_upper', 'close', 20, 2.0),
+    'bb_middle': ('sma', 'close', 20),
+    'bb_lower': ('bollinger_lower', 'close', 20, 2.0),
+    'macd': ('macd', 'close', 12, 26),
+    'signal': ('macd_signal', 'close', 12, 26, 9),
+    'histogram': ('macd_hist', 'close', 12, 26, 9),
+    'atr': ('atr', 14),
+    'volume_ma': ('sma', 'volume', 20),
+    'volume_ratio': ('div', 'volume', 'volume_ma'),
+    'volatility': ('rolling_std', 'returns', 20),
+}
 
 
 class DataProcessor:
     """数据预处理模块"""
     
-    def __init__(self):
+    def __init__(self, seasonality=None):
+        """
+        :param seasonality: 品种的日内季节性表（SeasonalityProfile），设置后特征中增加去季节化的
+                            成交量/波动率/振幅比率；默认不增加，保持原有特征维度
+        """
         self.scaler = StandardScaler()
         self.pca = None
-        
-    def clean_data(self, df):
-        """数据清洗"""
+        self.indicators = IndicatorGraph.from_spec(FEATURE_SPEC).compile()
+        self.seasonality = seasonality
+        
+    def clean_data(self, df, window=None):
+        """
+        数据清洗
+        :param window: 滚动IQR窗口长度，为None时使用全样本分位数；
+                       设置后每根K线只用最近window根K线（含当前）的分位数判断异常值，不引入未来数据
+        """
         df = dropna(df)
         
         # 处理异常值 - 使用IQR方法
         numeric_columns = ['open', 'high', 'low', 'close', 'volume']
         for col in numeric_columns:
             if col in df.columns:
+                if window:
+                    quartiles = rolling_order_stats(df[col].values, window, (0.25, 0.75))
+                    Q1 = quartiles['q0.25']
+                    Q3 = quartiles['q0.75']
+                    IQR = Q3 - Q1
+                    # 窗口未满时没有分位数，保留该K线
+                    keep = np.isnan(IQR) | ((df[col].values >= Q1 - 1.5 * IQR) & (df[col].values <= Q3 + 1.5 * IQR))
+                    df = df[keep]
+                    continue
+                
                 Q1 = df[col].quantile(0.25)
                 Q3 = df[col].quantile(0.75)
                 IQR = Q3 - Q1
@@ -36,75 +79,22 @@ class DataProcessor:
         if df.empty:
             return df
             
-        # 添加基础技术指标
-        df['returns'] = df['close'].pct_change()
-        df['log_returns'] = np.log(df['close']/df['close'].shift(1))
-        
-        # 添加移动平均线
-        df['ma_5'] = df['close'].rolling(window=5).mean()
-        df['ma_10'] = df['close'].rolling(window=10).mean()
-        df['ma_20'] = df['close'].rolling(window=20).mean()
-        df['ma_60'] = df['close'].rolling(window=60).mean()
-        
-        # 添加RSI
-        df['rsi'] = self._calculate_rsi(df['close'])
-        
-        # 添加布林带
-        df['bb_upper'], df['bb_middle'], df['bb_lower'] = self._calculate_bollinger_bands(df['close'])
-        
-        # 添加MACD
-        df['macd'], df['signal'], df['histogram'] = self._calculate_macd(df['close'])
+        # 按 FEATURE_SPEC 一次计算全部技术指标
+        features = self.indicators.transform(df)
+        for col in features.columns:
+            df[col] = features[col]
         
-        # 添加ATR（平均真实波幅）
-        df['atr'] = self._calculate_atr(df['high'], df['low'], df['close'])
-        
-        # 添加成交量相关指标
-        df['volume_ma'] = df['volume'].rolling(window=20).mean()
-        df['volume_ratio'] = df['volume'] / df['volume_ma']
-        
-        # 添加波动率
-        df['volatility'] = df['returns'].rolling(window=20).std()
+        # 按开盘、休盘前后的典型水平修正成交量比率等特征，需要时间索引
+        if self.seasonality is not None and isinstance(df.index, pd.DatetimeIndex):
+            seasonal = seasonal_features(df, self.seasonality)
+            for col in seasonal.columns:
+                df[col] = seasonal[col]
         
         # 删除包含NaN的行
         df.dropna(inplace=True)
         
         return df
     
-    def _calculate_rsi(self, prices, period=14):
-        """计算RSI指标"""
-        delta = prices.diff()
-        gain = (delta.where(delta > 0, 0)).rolling(window=period).mean()
-        loss = (-delta.where(delta < 0, 0)).rolling(window=period).mean()
-        rs = gain / loss
-        rsi = 100 - (100 / (1 + rs))
-        return rsi
-    
-    def _calculate_bollinger_bands(self, prices, period=20, std_dev=2):
-        """计算布林带"""
-        ma = prices.rolling(window=period).mean()
-        std = prices.rolling(window=period).std()
-        upper_band = ma + (std * std_dev)
-        lower_band = ma - (std * std_dev)
-        return upper_band, ma, lower_band
-    
-    def _calculate_macd(self, prices, fast=12, slow=26, signal_period=9):
-        """计算MACD"""
-        exp1 = prices.ewm(span=fast, adjust=False).mean()
-        exp2 = prices.ewm(span=slow, adjust=False).mean()
-        macd = exp1 - exp2
-        signal = macd.ewm(span=signal_period, adjust=False).mean()
-        histogram = macd - signal
-        return macd, signal, histogram
-    
-    def _calculate_atr(self, high, low, close, period=14):
-        """计算ATR"""
-        high_low = high - low
-        high_close = np.abs(high - close.shift())
-        low_close = np.abs(low - close.shift())
-        true_range = np.maximum(high_low, np.maximum(high_close, low_close))
-        atr = true_range.rolling(window=period).mean()
-        return atr
-        
     def normalize_data(self, df, method='standardization'):
         """数据标准化或归一化"""
         # 选择数值列进行标准化
@@ -0,0 +1,260 @@
+"""
+天勤(TqSdk)K线CSV快速解析模块
+导出文件的列布局固定：datetime（字符串）、datetime_nano（整数）、{合约}.{字段}（数值）。
+用numba多线程解析：按行边界把文件切成若干块，先并行统计每块的行数确定写入位置，
+再并行逐字节解析数值直接写入列缓冲区；时间只取 datetime_nano，不解析字符串列
+"""
+from typing import Dict, Union
+
+import numba
+import numpy as np
+import pandas as pd
+from numba import njit, prange
+
+
+# datetime_nano 为UTC纳秒时间戳，交易所时间为北京时间（UTC+8）
+CST_OFFSET_NS = 8 * 3600 * 1_000_000_000
+
+# 列类型
+_SKIP = 0       # 跳过（字符串列）
+_INT = 1        # int64
+_FLOAT = 2      # float64
+
+# 不解析的字符串列
+STRING_COLUMNS = ('datetime',)
+INT_COLUMNS = ('datetime_nano',)
+
+# 10的整数次幂（|指数| <= 22 时可精确表示）
+_POW10 = np.array([10.0 ** i for i in range(23)])
+# 尾数上限 2^53：不超过上限且 |指数| <= 22 时，尾数转float64精确，再乘除一个精确的10的幂只舍入一次，
+# 结果正确舍入（行情价格、成交量都在此范围内）。超过上限的有效数字（约16位以上）被截断，
+# |指数| > 22 时幂本身有舍入，这两种情况结果与正确舍入值相差若干ulp，接近float64上下限时可能溢出为inf或下溢为0
+_MAX_MANTISSA = 9007199254740992
+
+_NEWLINE = 10
+_RETURN = 13
+_COMMA = 44
+
+
+@njit(cache=True, nogil=True, inline='always')
+def _parse_float(buf, pos, end):
+    """
+    解析一个浮点数，返回 (值, 结束位置)；结束位置指向分隔符
+    空字段与 nan/inf 等非数字返回NaN
+    """
+    neg = False
+    if pos < end and (buf[pos] == 45 or buf[pos] == 43):  # '-' / '+'
+        neg = buf[pos] == 45
+        pos += 1
+
+    mantissa = 0
+    exp10 = 0
+    digits = 0
+    full = False  # 尾数已达上限，之后的数字全部截断
+    while pos < end and 48 <= buf[pos] <= 57:
+        if not full:
+            m = mantissa * 10 + (buf[pos] - 48)
+            full = m > _MAX_MANTISSA
+        if full:
+            exp10 += 1
+        else:
+            mantissa = m
+        digits += 1
+        pos += 1
+    if pos < end and buf[pos] == 46:  # '.'
+        pos += 1
+        while pos < end and 48 <= buf[pos] <= 57:
+            if not full:
+                m = mantissa * 10 + (buf[pos] - 48)
+                full = m > _MAX_MANTISSA
+                if not full:
+                    mantissa = m
+                    exp10 -= 1
+            digits += 1
+            pos += 1
+    if digits > 0 and pos < end and (buf[pos] == 101 or buf[pos] == 69):  # 'e' / 'E'
+        pos += 1
+        exp_neg = False
+        if pos < end and (buf[pos] == 45 or buf[pos] == 43):
+            exp_neg = buf[pos] == 45
+            pos += 1
+        e = 0
+        while pos < end and 48 <= buf[pos] <= 57:
+            e = e * 10 + (buf[pos] - 48)
+            pos += 1
+        exp10 += -e if exp_neg else e
+
+    if digits == 0:
+        # nan / inf / 空字段：跳到分隔符
+        while pos < end and buf[pos] != _COMMA and buf[pos] != _NEWLINE and buf[pos] != _RETURN:
+            pos += 1
+        return np.nan, pos
+
+    value = float(mantissa)
+    if exp10 < 0:
+        value = value / _POW10[-exp10] if exp10 >= -22 else value * 10.0 ** exp10
+    elif exp10 > 0:
+        value = value * _POW10[exp10] if exp10 <= 22 else value * 10.0 ** exp10
+    return (-value if neg else value), pos
+
+
+@njit(cache=True, nogil=True, inline='always')
+def _parse_int(buf, pos, end):
+    """解析一个整数，返回 (值, 结束位置)"""
+    neg = False
+    if pos < end and (buf[pos] == 45 or buf[pos] == 43):
+        neg = buf[pos] == 45
+        pos += 1
+    value = 0
+    while pos < end and 48 <= buf[pos] <= 57:
+        value = value * 10 + (buf[pos] - 48)
+        pos += 1
+    return (-value if neg else value), pos
+
+
+@njit(cache=True, nogil=True, inline='always')
+def _count_rows(buf, start, end):
+    """块内的非空行数"""
+    rows = 0
+    empty = True
+    for i in range(start, end):
+        c = buf[i]
+        if c == _NEWLINE:
+            if not empty:
+                rows += 1
+            empty = True
+        elif c != _RETURN:
+            empty = False
+    if not empty:
+        rows += 1
+    return rows
+
+
+@njit(cache=True, nogil=True, parallel=True)
+def _parse_body(buf, starts, kinds, slots, n_float, n_int):
+    """
+    :param buf: 文件内容（uint8）
+    :param starts: 各块的起始位置（表头之后），均位于行首，最后一个元素为结束位置
+    :param kinds: 每列的类型（_SKIP/_INT/_FLOAT）
+    :param slots: 每列在对应类型输出矩阵中的列号
+    :return: (浮点列矩阵, 整数列矩阵)，行数为非空行数
+    """
+    n_chunks = starts.shape[0] - 1
+    n_cols = kinds.shape[0]
+
+    counts = np.zeros(n_chunks, dtype=np.int64)
+    for c in prange(n_chunks):
+        counts[c] = _count_rows(buf, starts[c], starts[c + 1])
+    offsets = np.zeros(n_chunks + 1, dtype=np.int64)
+    for c in range(n_chunks):
+        offsets[c + 1] = offsets[c] + counts[c]
+
+    n_rows = offsets[n_chunks]
+    out_f = np.full((n_rows, n_float), np.nan)
+    out_i = np.zeros((n_rows, n_int), dtype=np.int64)
+
+    for c in prange(n_chunks):
+        row = offsets[c]
+        pos = starts[c]
+        end = starts[c + 1]
+        while pos < end:
+            if buf[pos] == _NEWLINE or buf[pos] == _RETURN:
+                pos += 1
+                continue
+
+            col = 0
+            while col < n_cols:
+                kind = kinds[col]
+                if kind == _FLOAT:
+                    value, pos = _parse_float(buf, pos, end)
+                    out_f[row, slots[col]] = value
+                elif kind == _INT:
+                    ivalue, pos = _parse_int(buf, pos, end)
+                    out_i[row, slots[col]] = ivalue
+                while pos < end and buf[pos] != _COMMA and buf[pos] != _NEWLINE:
+                    pos += 1
+                if pos < end and buf[pos] == _COMMA:
+                    pos += 1
+                    col += 1
+                else:
+                    break
+
+            while pos < end and buf[pos] != _NEWLINE:
+                pos += 1
+            pos += 1
+            row += 1
+
+    return out_f, out_i
+
+
+def _chunk_starts(data: bytes, begin: int, n_chunks: int) -> np.ndarray:
+    """把 [begin, len(data)) 按行边界切成 n_chunks 块"""
+    size = len(data) - begin
+    starts = [begin]
+    for k in range(1, n_chunks):
+        pos = data.find(b'\n', begin + k * size // n_chunks)
+        pos = len(data) if pos < 0 else pos + 1
+        starts.append(max(pos, starts[-1]))
+    starts.append(len(data))
+    return np.array(starts, dtype=np.int64)
+
+
+def parse_csv_bytes(data: bytes, n_threads: int = None) -> Dict[str, np.ndarray]:
+    """
+    解析CSV内容为列式数组
+    datetime_nano 解析为int64，datetime 字符串列跳过，其余列解析为float64
+    :param data: 文件内容
+    :param n_threads: 线程数，默认为numba的线程数
+    :return: {列名: 数组}
+    """
+    header_end = data.find(b'\n')
+    if header_end < 0:
+        header_end = len(data)
+    names = data[:header_end].decode('utf-8').strip().split(',')
+
+    kinds = np.empty(len(names), dtype=np.int64)
+    slots = np.empty(len(names), dtype=np.int64)
+    float_names, int_names = [], []
+    for i, name in enumerate(names):
+        if name in STRING_COLUMNS:
+            kinds[i], slots[i] = _SKIP, 0
+        elif name in INT_COLUMNS:
+            kinds[i], slots[i] = _INT, len(int_names)
+            int_names.append(name)
+        else:
+            kinds[i], slots[i] = _FLOAT, len(float_names)
+            float_names.append(name)
+
+    n_threads = n_threads or numba.get_num_threads()
+    # 每块至少约64KB，小文件不必切分
+    n_chunks = max(1, min(n_threads * 4, (len(data) - header_end) // 65536))
+    starts = _chunk_starts(data, min(header_end + 1, len(data)), n_chunks)
+
+    buf = np.frombuffer(data, dtype=np.uint8)
+    out_f, out_i = _parse_body(buf, starts, kinds, slots, len(float_names), len(int_names))
+
+    columns = {name: np.ascontiguousarray(out_i[:, j]) for j, name in enumerate(int_names)}
+    columns.update({name: np.ascontiguousarray(out_f[:, j]) for j, name in enumerate(float_names)})
+    return columns
+
+
+def read_csv_columns(path: str, n_threads: int = None) -> Dict[str, np.ndarray]:
+    """读取CSV文件为列式数组"""
+    with open(path, 'rb') as f:
+        data = f.read()
+    return parse_csv_bytes(data, n_threads)
+
+
+def read_tqsdk_csv(source: Union[str, bytes], n_threads: int = None) -> pd.DataFrame:
+    """
+    读取天勤K线CSV为DataFrame，索引为北京时间的 datetime（由 datetime_nano 换算），
+    列与原文件一致（不含 datetime 字符串列）
+    :param source: 文件路径或文件内容
+    """
+    columns = parse_csv_bytes(source, n_threads) if isinstance(source, bytes) else read_csv_columns(source, n_threads)
+    if 'datetime_nano' not in columns:
+        raise ValueError("CSV缺少 datetime_nano 列")
+    df = pd.DataFrame(columns)
+    df.index = pd.to_datetime(columns['datetime_nano'] + CST_OFFSET_NS)
+    df.index.name = 'datetime'
+    return df
@@ -0,0 +1,164 @@
+"""
+分数阶差分特征模块
+对（对数）价格做 d 阶分数差分（0 < d < 1），在平稳性与长记忆之间折中：
+批量计算用FFT卷积，O(n log n)；实时计算用截断的固定宽度权重在环形缓冲区上做点积，每根K线 O(w)；
+每个合约的最小平稳阶数 d 通过ADF检验并行搜索
+"""
+from concurrent.futures import ThreadPoolExecutor
+from typing import Dict, List, Optional, Sequence
+
+import numpy as np
+from scipy.signal import fftconvolve
+
+from src.data.bar_store import BarStore
+
+
+# ADF检验（含常数项）5%显著性水平的渐近临界值
+ADF_CRITICAL_5PCT = -2.8621
+
+# 默认的d搜索网格
+D_GRID = np.round(np.arange(0.0, 1.0001, 0.05), 2)
+
+
+def fracdiff_weights(d: float, threshold: float = 1e-4, max_width: int = 10000) -> np.ndarray:
+    """
+    分数差分权重 w_k = -w_{k-1} * (d - k + 1) / k，截断到 |w_k| < threshold
+    :return: 权重数组，w[0] 对应当前值，w[k] 对应 k 根K线之前的值
+    """
+    weights = [1.0]
+    for k in range(1, max_width):
+        w = -weights[-1] * (d - k + 1) / k
+        if abs(w) < threshold:
+            break
+        weights.append(w)
+    return np.array(weights)
+
+
+def fracdiff(series: np.ndarray, d: float, threshold: float = 1e-4, weights: np.ndarray = None) -> np.ndarray:
+    """
+    固定宽度分数差分（FFT卷积）
+    :param series: 输入序列（一般为对数价格）
+    :param weights: 预先计算的权重，默认按 d 与 threshold 生成
+    :return: 与输入等长，前 width-1 个值为NaN
+    """
+    series = np.asarray(series, dtype=np.float64)
+    if weights is None:
+        weights = fracdiff_weights(d, threshold)
+    width = len(weights)
+
+    result = np.full(series.shape[0], np.nan)
+    if series.shape[0] < width:
+        return result
+    # 卷积第 t 项为 sum_k w[k] * x[t - k]
+    result[width - 1:] = fftconvolve(series, weights, mode='full')[width - 1:series.shape[0]]
+    return result
+
+
+def adf_statistic(series: np.ndarray, max_lag: int = 1) -> float:
+    """
+    ADF检验统计量（含常数项）：Δy_t = a + b·y_{t-1} + Σ c_i·Δy_{t-i} + e_t，返回 b 的t统计量
+    """
+    y = np.asarray(series, dtype=np.float64)
+    y = y[~np.isnan(y)]
+    if y.shape[0] < max_lag + 10:
+        return np.nan
+
+    dy = np.diff(y)
+    target = dy[max_lag:]
+    columns = [np.ones(target.shape[0]), y[max_lag:-1]]
+    for i in range(1, max_lag + 1):
+        columns.append(dy[max_lag - i:-i])
+    X = np.column_stack(columns)
+
+    beta, _, rank, _ = np.linalg.lstsq(X, target, rcond=None)
+    if rank < X.shape[1]:
+        return np.nan
+    resid = target - X @ beta
+    sigma2 = resid @ resid / (X.shape[0] - X.shape[1])
+    xtx_inv = np.linalg.inv(X.T @ X)
+    return float(beta[1] / np.sqrt(sigma2 * xtx_inv[1, 1]))
+
+
+def min_stationary_d(series: np.ndarray, d_grid: Sequence[float] = D_GRID, threshold: float = 1e-4,
+                     critical: float = ADF_CRITICAL_5PCT, max_lag: int = 1) -> Optional[float]:
+    """
+    使分数差分序列通过ADF检验的最小 d
+    ADF统计量随 d 单调下降，在网格上二分查找，只需 O(log |grid|) 次检验
+    :return: 最小平稳阶数，网格内都不平稳时返回None
+    """
+    log_prices = np.log(np.asarray(series, dtype=np.float64))
+    d_grid = sorted(d_grid)
+
+    def stationary(d):
+        stat = adf_statistic(fracdiff(log_prices, d, threshold), max_lag)
+        return np.isfinite(stat) and stat < critical
+
+    lo, hi = 0, len(d_grid) - 1
+    if not stationary(d_grid[hi]):
+        return None
+    while lo < hi:
+        mid = (lo + hi) // 2
+        if stationary(d_grid[mid]):
+            hi = mid
+        else:
+            lo = mid + 1
+    return float(d_grid[lo])
+
+
+def search_min_d(store: BarStore, symbols: List[str] = None, d_grid: Sequence[float] = D_GRID,
+                 threshold: float = 1e-4, max_workers: int = None) -> Dict[str, Optional[float]]:
+    """
+    并行搜索每个合约的最小平稳阶数（FFT与最小二乘在numpy/scipy内部释放GIL，线程池即可并行）
+    :return: {合约: d}
+    """
+    symbols = symbols or store.symbols()
+    closes = {symbol: arrays['close'] for symbol, arrays in store.load_many(symbols, max_workers).items()}
+
+    with ThreadPoolExecutor(max_workers=max_workers) as executor:
+        futures = {symbol: executor.submit(min_stationary_d, closes[symbol], d_grid, threshold)
+                   for symbol in symbols}
+        return {symbol: future.result() for symbol, future in futures.items()}
+
+
+class FracDiffStream:
+    """
+    实时分数差分：固定宽度权重与最近 width 个值做点积
+    缓冲区长度为 2 * width，每个值写两次，最近 width 个值始终是一段连续内存，无需取模拼接
+    """
+
+    def __init__(self, d: float, threshold: float = 1e-4, log: bool = True):
+        """
+        :param d: 差分阶数
+        :param log: 是否先取对数（输入为价格时）
+        """
+        self.d = d
+        self.log = log
+        # 反转权重，使点积按时间正序对应缓冲区
+        self.weights = fracdiff_weights(d, threshold)[::-1].copy()
+        self.width = len(self.weights)
+        self.buffer = np.zeros(2 * self.width)
+        self.pos = 0
+        self.count = 0
+
+    def reset(self):
+        self.buffer[:] = 0.0
+        self.pos = 0
+        self.count = 0
+
+    @property
+    def ready(self) -> bool:
+        return self.count >= self.width
+
+    def update(self, value: float) -> float:
+        """
+        :return: 最新的分数差分值，缓冲区未满时返回NaN
+        """
+        x = np.log(value) if self.log else value
+        self.buffer[self.pos] = x
+        self.buffer[self.pos + self.width] = x
+        self.pos = (self.pos + 1) % self.width
+        self.count += 1
+        if not self.ready:
+            return np.nan
+        # 缓冲区 [pos, pos + width) 为最近 width 个值，按时间正序
+        return float(self.weights @ self.buffer[self.pos:self.pos + self.width])
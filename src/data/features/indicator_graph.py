@@ -0,0 +1,507 @@
+"""
+指标计算图模块
+把声明式的特征定义编译为依赖图（DAG）：相同的滚动原语（滚动和、平方和、EWM、滚动最大/最小、滞后）
+只保留一个节点（公共子表达式消除），再按拓扑序生成指令表，由一个numba内核逐行一次遍历计算全部特征。
+批量计算与逐根K线的流式计算执行同一段内核代码，结果一致
+"""
+from typing import Dict, List, Sequence, Tuple, Union
+
+import numpy as np
+import pandas as pd
+from numba import njit
+
+
+# ===== 指令 =====
+OP_INPUT = 0    # 输入列
+OP_CONST = 1    # 常数
+OP_ADD = 2
+OP_SUB = 3
+OP_MUL = 4
+OP_DIV = 5
+OP_MAX = 6      # 逐元素最大值（任一为NaN则为NaN）
+OP_ABS = 7
+OP_SQRT = 8     # 负数按0处理，吸收滚动方差的舍入误差
+OP_LOG = 9
+OP_POS = 10     # max(x, 0)，NaN记为0（与 pandas 的 where(x > 0, 0) 一致）
+OP_NEG = 11     # max(-x, 0)，NaN记为0
+OP_LAG = 12     # 滞后k根
+OP_RSUM = 13    # 滚动和
+OP_RMAX = 14    # 滚动最大值
+OP_RMIN = 15    # 滚动最小值
+OP_EWM = 16     # 指数加权均值（adjust=False）
+OP_SIGN = 17    # 符号（-1/0/1）
+OP_SDIV = 18    # 除法，分母为0时取 fparam（默认0）
+
+# 满足交换律的指令，参数排序后去重
+_COMMUTATIVE = {OP_ADD, OP_MUL, OP_MAX}
+# 需要环形缓冲区的指令
+_WINDOWED = {OP_LAG, OP_RSUM, OP_RMAX, OP_RMIN}
+
+
+# 批量计算时每次处理的行数，中间结果保持在缓存内
+_CHUNK_ROWS = 4096
+
+
+@njit(cache=True, error_model='numpy')
+def _run_program(inputs, ops, arg0, arg1, iparam, fparam, buf_off, out_idx,
+                 acc, nan_cnt, cnt, buf, dq, dq_head, dq_len):
+    """
+    执行指令表：按行分块，块内按拓扑序逐节点计算整列，每个节点只计算一次
+    窗口类节点的状态（acc/nan_cnt/cnt/buf/dq/dq_head/dq_len）在调用之间保留，
+    流式计算时每次传入一行即可，与批量计算执行同一段代码
+    """
+    n_rows = inputs.shape[0]
+    n_nodes = ops.shape[0]
+    out = np.empty((n_rows, out_idx.shape[0]))
+    vals = np.empty((n_nodes, min(n_rows, _CHUNK_ROWS)))
+
+    for start in range(0, n_rows, _CHUNK_ROWS):
+        m = min(_CHUNK_ROWS, n_rows - start)
+
+        for k in range(n_nodes):
+            op = ops[k]
+            v = vals[k]
+            a = vals[arg0[k]] if arg0[k] >= 0 else vals[k]
+            b = vals[arg1[k]] if arg1[k] >= 0 else vals[k]
+
+            if op == OP_INPUT:
+                col = iparam[k]
+                for r in range(m):
+                    v[r] = inputs[start + r, col]
+            elif op == OP_CONST:
+                v[:m] = fparam[k]
+            elif op == OP_ADD:
+                for r in range(m):
+                    v[r] = a[r] + b[r]
+            elif op == OP_SUB:
+                for r in range(m):
+                    v[r] = a[r] - b[r]
+            elif op == OP_MUL:
+                for r in range(m):
+                    v[r] = a[r] * b[r]
+            elif op == OP_DIV:
+                for r in range(m):
+                    v[r] = a[r] / b[r]
+            elif op == OP_MAX:
+                for r in range(m):
+                    if a[r] == a[r] and b[r] == b[r]:
+                        v[r] = a[r] if a[r] >= b[r] else b[r]
+                    else:
+                        v[r] = np.nan
+            elif op == OP_ABS:
+                for r in range(m):
+                    v[r] = abs(a[r])
+            elif op == OP_SQRT:
+                for r in range(m):
+                    if a[r] == a[r]:
+                        v[r] = np.sqrt(a[r]) if a[r] > 0 else 0.0
+                    else:
+                        v[r] = np.nan
+            elif op == OP_LOG:
+                for r in range(m):
+                    v[r] = np.log(a[r])
+            elif op == OP_POS:
+                for r in range(m):
+                    v[r] = a[r] if a[r] > 0 else 0.0
+            elif op == OP_NEG:
+                for r in range(m):
+                    v[r] = -a[r] if a[r] < 0 else 0.0
+            elif op == OP_SIGN:
+                for r in range(m):
+                    v[r] = np.sign(a[r])
+            elif op == OP_SDIV:
+                for r in range(m):
+                    v[r] = a[r] / b[r] if b[r] != 0 else fparam[k]
+            elif op == OP_EWM:
+                alpha = fparam[k]
+                e = acc[k]
+                for r in range(m):
+                    x = a[r]
+                    if x == x:
+                        e = alpha * x + (1.0 - alpha) * e if e == e else x
+                    v[r] = e
+                acc[k] = e
+            else:
+                # 窗口类指令：环形缓冲区 buf[off, off + L)，pos 为下一个写入位置
+                L = iparam[k]
+                off = buf_off[k]
+                c = cnt[k]
+                pos = c % L
+
+                if op == OP_LAG:
+                    for r in range(m):
+                        v[r] = buf[off + pos] if c >= L else np.nan
+                        buf[off + pos] = a[r]
+                        c += 1
+                        pos += 1
+                        if pos == L:
+                            pos = 0
+
+                elif op == OP_RSUM:
+                    s = acc[k]
+                    nans = nan_cnt[k]
+                    for r in range(m):
+                        x = a[r]
+                        if c >= L:
+                            old = buf[off + pos]
+                            if old == old:
+                                s -= old
+                            else:
+                                nans -= 1
+                        buf[off + pos] = x
+                        if x == x:
+                            s += x
+                        else:
+                            nans += 1
+                        c += 1
+                        pos += 1
+                        if pos == L:
+                            pos = 0
+                            # 每绕环一周按缓冲区重新求和，消除累加误差
+                            s = 0.0
+                            for i in range(L):
+                                y = buf[off + i]
+                                if y == y:
+                                    s += y
+                        v[r] = s if c >= L and nans == 0 else np.nan
+                    acc[k] = s
+                    nan_cnt[k] = nans
+
+                else:
+                    # 单调队列：dq 中按时间顺序保存候选极值的序号，队首即窗口极值
+                    is_max = op == OP_RMAX
+                    nans = nan_cnt[k]
+                    head = dq_head[k]
+                    size = dq_len[k]
+                    for r in range(m):
+                        x = a[r]
+                        if c >= L:
+                            old = buf[off + pos]
+                            if old != old:
+                                nans -= 1
+                        buf[off + pos] = x
+
+                        # 移出窗口外的序号
+                        if size > 0 and dq[off + head] <= c - L:
+                            head += 1
+                            if head == L:
+                                head = 0
+                            size -= 1
+                        if x == x:
+                            # 弹出被新值支配的队尾
+                            while size > 0:
+                                tail = head + size - 1
+                                if tail >= L:
+                                    tail -= L
+                                y = buf[off + dq[off + tail] % L]
+                                if (is_max and y <= x) or (not is_max and y >= x):
+                                    size -= 1
+                                else:
+                                    break
+                            tail = head + size
+                            if tail >= L:
+                                tail -= L
+                            dq[off + tail] = c
+                            size += 1
+                        else:
+                            nans += 1
+
+                        c += 1
+                        pos += 1
+                        if pos == L:
+                            pos = 0
+                        if c >= L and nans == 0 and size > 0:
+                            v[r] = buf[off + dq[off + head] % L]
+                        else:
+                            v[r] = np.nan
+                    nan_cnt[k] = nans
+                    dq_head[k] = head
+                    dq_len[k] = size
+
+                cnt[k] = c
+
+        for j in range(out_idx.shape[0]):
+            row = vals[out_idx[j]]
+            for r in range(m):
+                out[start + r, j] = row[r]
+
+    return out
+
+
+class IndicatorGraph:
+    """
+    指标计算图构建器
+    每个构建方法返回节点编号；参数完全相同的节点只创建一次
+    """
+
+    def __init__(self, inputs: Sequence[str] = ('open', 'high', 'low', 'close', 'volume')):
+        self.inputs = list(inputs)
+        self.nodes: List[Tuple] = []         # (op, arg0, arg1, iparam, fparam)
+        self._index: Dict[Tuple, int] = {}   # 节点键 -> 编号
+        self.outputs: Dict[str, int] = {}    # 特征名 -> 节点编号
+        self.requested = 0                   # 不做去重时需要的节点数
+
+    # ===== 基础节点 =====
+    def node(self, op: int, arg0: int = -1, arg1: int = -1, iparam: int = 0, fparam: float = 0.0) -> int:
+        self.requested += 1
+        if op in _COMMUTATIVE and arg1 < arg0:
+            arg0, arg1 = arg1, arg0
+        key = (op, arg0, arg1, int(iparam), float(fparam))
+        if key not in self._index:
+            self._index[key] = len(self.nodes)
+            self.nodes.append(key)
+        return self._index[key]
+
+    def ref(self, x: Union[str, int]) -> int:
+        """把输入列名、已定义的特征名或节点编号解析为节点编号"""
+        if isinstance(x, str):
+            if x in self.outputs:
+                return self.outputs[x]
+            if x in self.inputs:
+                return self.node(OP_INPUT, iparam=self.inputs.index(x))
+            raise ValueError(f"Unknown indicator input: {x}")
+        if isinstance(x, (int, np.integer)) and 0 <= x < len(self.nodes):
+            return int(x)
+        raise ValueError(f"Unsupported indicator argument: {x!r}")
+
+    def const(self, c: float) -> int:
+        return self.node(OP_CONST, fparam=c)
+
+    def add(self, a, b) -> int:
+        return self.node(OP_ADD, self.ref(a), self.ref(b))
+
+    def sub(self, a, b) -> int:
+        return self.node(OP_SUB, self.ref(a), self.ref(b))
+
+    def mul(self, a, b) -> int:
+        return self.node(OP_MUL, self.ref(a), self.ref(b))
+
+    def div(self, a, b) -> int:
+        return self.node(OP_DIV, self.ref(a), self.ref(b))
+
+    def maximum(self, a, b) -> int:
+        return self.node(OP_MAX, self.ref(a), self.ref(b))
+
+    def abs(self, x) -> int:
+        return self.node(OP_ABS, self.ref(x))
+
+    def sqrt(self, x) -> int:
+        return self.node(OP_SQRT, self.ref(x))
+
+    def log(self, x) -> int:
+        return self.node(OP_LOG, self.ref(x))
+
+    def sign(self, x) -> int:
+        return self.node(OP_SIGN, self.ref(x))
+
+    def safe_div(self, a, b, default: float = 0.0) -> int:
+        return self.node(OP_SDIV, self.ref(a), self.ref(b), fparam=default)
+
+    def scale(self, x, c: float) -> int:
+        return self.mul(x, self.const(c))
+
+    def lag(self, x, k: int = 1) -> int:
+        return self.node(OP_LAG, self.ref(x), iparam=k)
+
+    def rolling_sum(self, x, window: int) -> int:
+        return self.node(OP_RSUM, self.ref(x), iparam=window)
+
+    def rolling_max(self, x, window: int) -> int:
+        return self.node(OP_RMAX, self.ref(x), iparam=window)
+
+    def rolling_min(self, x, window: int) -> int:
+        return self.node(OP_RMIN, self.ref(x), iparam=window)
+
+    def ewm(self, x, span: int) -> int:
+        return self.node(OP_EWM, self.ref(x), fparam=2.0 / (span + 1))
+
+    # ===== 组合指标 =====
+    def sma(self, x, window: int) -> int:
+        return self.div(self.rolling_sum(x, window), self.const(window))
+
+    def rolling_std(self, x, window: int) -> int:
+        """滚动样本标准差（ddof=1），由滚动和与滚动平方和得到"""
+        x = self.ref(x)
+        s = self.rolling_sum(x, window)
+        sq = self.rolling_sum(self.mul(x, x), window)
+        var = self.div(self.sub(sq, self.div(self.mul(s, s), self.const(window))), self.const(window - 1))
+        return self.sqrt(var)
+
+    def diff(self, x, k: int = 1) -> int:
+        return self.sub(x, self.lag(x, k))
+
+    def pct_change(self, x, k: int = 1) -> int:
+        return self.sub(self.div(x, self.lag(x, k)), self.const(1.0))
+
+    def log_return(self, x, k: int = 1) -> int:
+        return self.log(self.div(x, self.lag(x, k)))
+
+    def rsi(self, x, window: int = 14) -> int:
+        """与 add_technical_indicators 一致的简单均值RSI"""
+        delta = self.diff(x)
+        gain = self.sma(self.node(OP_POS, delta), window)
+        loss = self.sma(self.node(OP_NEG, delta), window)
+        rs = self.div(gain, loss)
+        return self.sub(self.const(100.0), self.div(self.const(100.0), self.add(self.const(1.0), rs)))
+
+    def bollinger_upper(self, x, window: int = 20, dev: float = 2.0) -> int:
+        return self.add(self.sma(x, window), self.mul(self.rolling_std(x, window), self.const(dev)))
+
+    def bollinger_lower(self, x, window: int = 20, dev: float = 2.0) -> int:
+        return self.sub(self.sma(x, window), self.mul(self.rolling_std(x, window), self.const(dev)))
+
+    def bollinger_width(self, x, window: int = 20, dev: float = 2.0) -> int:
+        return self.sub(self.bollinger_upper(x, window, dev), self.bollinger_lower(x, window, dev))
+
+    def bollinger_position(self, x, window: int = 20, dev: float = 2.0) -> int:
+        """价格在布林带中的位置；窗口内价格不变时带宽为0，记为中轨0.5"""
+        return self.safe_div(self.sub(x, self.bollinger_lower(x, window, dev)), self.bollinger_width(x, window, dev), 0.5)
+
+    def macd(self, x, fast: int = 12, slow: int = 26) -> int:
+        return self.sub(self.ewm(x, fast), self.ewm(x, slow))
+
+    def macd_signal(self, x, fast: int = 12, slow: int = 26, signal: int = 9) -> int:
+        return self.ewm(self.macd(x, fast, slow), signal)
+
+    def macd_hist(self, x, fast: int = 12, slow: int = 26, signal: int = 9) -> int:
+        return self.sub(self.macd(x, fast, slow), self.macd_signal(x, fast, slow, signal))
+
+    def true_range(self, high='high', low='low', close='close') -> int:
+        prev_close = self.lag(close)
+        return self.maximum(self.sub(high, low),
+                            self.maximum(self.abs(self.sub(high, prev_close)),
+                                         self.abs(self.sub(low, prev_close))))
+
+    def atr(self, window: int = 14, high='high', low='low', close='close') -> int:
+        return self.sma(self.true_range(high, low, close), window)
+
+    def highest(self, x, window: int) -> int:
+        return self.rolling_max(x, window)
+
+    def lowest(self, x, window: int) -> int:
+        return self.rolling_min(x, window)
+
+    # ===== 声明式定义 =====
+    def define(self, name: str, func: str, *args) -> int:
+        """
+        定义一个输出特征
+        :param func: 构建方法名，如 'sma'、'rsi'、'bollinger_upper'、'sub'
+        :param args: 参数，字符串为输入列或已定义的特征名，数值为窗口等参数
+        """
+        builder = getattr(self, func, None)
+        if builder is None or func.startswith('_') or func in ('define', 'compile', 'node', 'ref'):
+            raise ValueError(f"Unsupported indicator: {func}")
+        self.outputs[name] = builder(*args)
+        return self.outputs[name]
+
+    @classmethod
+    def from_spec(cls, spec: Dict[str, tuple], inputs: Sequence[str] = ('open', 'high', 'low', 'close', 'volume')):
+        """
+        由声明式定义构建计算图
+        :param spec: {特征名: (构建方法名, 参数...)}，按顺序定义，后面的特征可引用前面的特征名；
+                     以下划线开头的名称为中间量，不作为输出列
+        """
+        graph = cls(inputs)
+        for name, definition in spec.items():
+            graph.define(name, definition[0], *definition[1:])
+        return graph
+
+    def compile(self) -> "CompiledIndicators":
+        return CompiledIndicators(self)
+
+
+class CompiledIndicators:
+    """编译后的指令表"""
+
+    def __init__(self, graph: IndicatorGraph):
+        self.inputs = list(graph.inputs)
+        self.names = [name for name in graph.outputs if not name.startswith('_')]
+        self.n_requested = graph.requested
+
+        nodes = graph.nodes
+        self.ops = np.array([n[0] for n in nodes], dtype=np.int64)
+        self.arg0 = np.array([n[1] for n in nodes], dtype=np.int64)
+        self.arg1 = np.array([n[2] for n in nodes], dtype=np.int64)
+        self.iparam = np.array([n[3] for n in nodes], dtype=np.int64)
+        self.fparam = np.array([n[4] for n in nodes], dtype=np.float64)
+        self.out_idx = np.array([graph.outputs[name] for name in self.names], dtype=np.int64)
+
+        # 为窗口类节点分配环形缓冲区
+        sizes = np.where(np.isin(self.ops, list(_WINDOWED)), self.iparam, 0)
+        self.buf_off = np.concatenate(([0], np.cumsum(sizes)[:-1])).astype(np.int64)
+        self.buf_size = int(sizes.sum())
+
+    @property
+    def n_nodes(self) -> int:
+        return len(self.ops)
+
+    def summary(self) -> Dict[str, int]:
+        """计算图规模：特征数、去重后节点数、去重前节点数、滚动原语数"""
+        return {
+            'features': len(self.names),
+            'nodes': self.n_nodes,
+            'requested_nodes': self.n_requested,
+            'rolling_primitives': int(np.isin(self.ops, [OP_RSUM, OP_RMAX, OP_RMIN, OP_EWM]).sum())
+        }
+
+    def new_state(self) -> Tuple[np.ndarray, ...]:
+        n = self.n_nodes
+        acc = np.zeros(n)
+        acc[self.ops == OP_EWM] = np.nan
+        return (acc, np.zeros(n, dtype=np.int64), np.zeros(n, dtype=np.int64),
+                np.zeros(self.buf_size), np.zeros(self.buf_size, dtype=np.int64),
+                np.zeros(n, dtype=np.int64), np.zeros(n, dtype=np.int64))
+
+    def run(self, inputs: np.ndarray, state: Tuple[np.ndarray, ...]) -> np.ndarray:
+        """
+        :param inputs: shape (n_rows, n_inputs)，列顺序与 self.inputs 一致
+        :param state: new_state() 创建的状态，原地更新
+        """
+        return _run_program(np.ascontiguousarray(inputs, dtype=np.float64), self.ops, self.arg0, self.arg1,
+                            self.iparam, self.fparam, self.buf_off, self.out_idx, *state)
+
+    def transform(self, data: Union[pd.DataFrame, Dict[str, np.ndarray]]) -> pd.DataFrame:
+        """
+        批量计算全部特征
+        :param data: 包含输入列的DataFrame或列式数组
+        :return: 特征DataFrame（与输入同索引）
+        """
+        inputs = np.column_stack([np.asarray(data[name], dtype=np.float64) for name in self.inputs])
+        result = self.run(inputs, self.new_state())
+        index = data.index if isinstance(data, pd.DataFrame) else None
+        return pd.DataFrame(result, columns=self.names, index=index)
+
+    def create_stream(self) -> "IndicatorStream":
+        return IndicatorStream(self)
+
+
+class IndicatorStream:
+    """流式计算器：逐根K线更新，与批量计算结果一致"""
+
+    def __init__(self, compiled: CompiledIndicators):
+        self.compiled = compiled
+        self.state = compiled.new_state()
+        self._row = np.zeros((1, len(compiled.inputs)))
+
+    def reset(self):
+        self.state = self.compiled.new_state()
+
+    def update(self, values: Sequence[float]) -> np.ndarray:
+        """
+        :param values: 一根K线的输入值，顺序与 compiled.inputs 一致
+        :return: 全部特征的最新值
+        """
+        self._row[0, :] = values
+        return self.compiled.run(self._row, self.state)[0]
+
+    def update_bar(self, bar) -> np.ndarray:
+        """用vnpy的BarData更新"""
+        fields = {
+            'open': bar.open_price,
+            'high': bar.high_price,
+            'low': bar.low_price,
+            'close': bar.close_price,
+            'volume': bar.volume,
+            'open_interest': bar.open_interest,
+        }
+        return self.update([fields[name] for name in self.compiled.inputs])
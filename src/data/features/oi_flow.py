@@ -0,0 +1,159 @@
+"""
+持仓量（OI）流向分析模块
+由K线的 open_oi/close_oi 计算增减仓状态、开平仓成交量拆分、OI确认的资金流向，
+以及同一品种各交割月之间的持仓迁移（移仓）。
+单合约特征以 IndicatorGraph 规格定义，可与价格特征合并为同一张计算图一次计算；实时由 OIFlowStream 逐根K线更新
+"""
+from typing import Dict, List, Optional
+
+import numpy as np
+import pandas as pd
+
+from src.data.bar_store import BarStore
+from src.data.features.indicator_graph import IndicatorGraph
+
+
+# 增减仓状态 = 价格方向 + 3 × 持仓方向（两个方向各取 -1/0/1，九种组合编码互不相同）
+LONG_BUILD = 4          # 价涨仓增：多头增仓
+SHORT_BUILD = 2         # 价跌仓增：空头增仓
+SHORT_COVER = -2        # 价涨仓减：空头平仓
+LONG_LIQUIDATION = -4   # 价跌仓减：多头平仓
+PRICE_FLAT_OI_UP = 3    # 价平仓增
+PRICE_FLAT_OI_DOWN = -3 # 价平仓减
+PRICE_UP_OI_FLAT = 1    # 价涨仓平：换手，无增减仓
+PRICE_DOWN_OI_FLAT = -1 # 价跌仓平：换手，无增减仓
+NO_CHANGE = 0           # 价平仓平
+
+OI_INPUTS = ('open', 'high', 'low', 'close', 'volume', 'open_oi', 'close_oi')
+
+OI_FEATURE_SPEC = {
+    'oi_change': ('sub', 'close_oi', 'open_oi'),
+    'oi_change_pct': ('safe_div', 'oi_change', 'open_oi'),
+    # 开仓比例：持仓变化占成交量的比例，1为全部开仓，-1为全部平仓
+    'oi_volume_ratio': ('safe_div', 'oi_change', 'volume'),
+    # 成交量拆分：开仓 ≈ (成交量 + 持仓变化) / 2，平仓 ≈ (成交量 - 持仓变化) / 2
+    '_volume_plus_oi': ('add', 'volume', 'oi_change'),
+    'open_volume': ('scale', '_volume_plus_oi', 0.5),
+    '_volume_minus_oi': ('sub', 'volume', 'oi_change'),
+    'close_volume': ('scale', '_volume_minus_oi', 0.5),
+    '_price_change': ('diff', 'close'),
+    '_price_dir': ('sign', '_price_change'),
+    '_oi_dir': ('sign', 'oi_change'),
+    '_oi_dir_3': ('scale', '_oi_dir', 3.0),
+    'position_state': ('add', '_price_dir', '_oi_dir_3'),
+    # OI加权成交量：按价格方向计正负的开仓成交量
+    'oi_weighted_volume': ('mul', '_price_dir', 'open_volume'),
+    # OI确认的资金流向：20根K线内带方向的持仓变化占成交量的比例
+    '_oi_flow': ('mul', '_price_dir', 'oi_change'),
+    '_oi_flow_sum': ('rolling_sum', '_oi_flow', 20),
+    '_volume_sum': ('rolling_sum', 'volume', 20),
+    'oi_flow_ratio': ('safe_div', '_oi_flow_sum', '_volume_sum'),
+}
+
+
+def compile_oi_features(extra_spec: Dict[str, tuple] = None):
+    """
+    编译OI特征计算图
+    :param extra_spec: 需要在同一次遍历中计算的其他特征（如 TECHNICAL_INDICATOR_SPEC）
+    """
+    spec = dict(extra_spec or {})
+    spec.update(OI_FEATURE_SPEC)
+    return IndicatorGraph.from_spec(spec, inputs=OI_INPUTS).compile()
+
+
+def oi_features(data, extra_spec: Dict[str, tuple] = None) -> pd.DataFrame:
+    """
+    批量计算OI特征
+    :param data: 包含 open/high/low/close/volume/open_oi/close_oi 的DataFrame或列式数组（BarStore.load_arrays）
+    """
+    return compile_oi_features(extra_spec).transform(data)
+
+
+def oi_migration(store: BarStore, product: str) -> pd.DataFrame:
+    """
+    同一品种各交割月之间的持仓迁移
+    :param product: 品种代码，如 'rb'
+    :return: 以时间为索引，包含各合约持仓占比（share.{合约}）、主力合约（dominant，持仓最大）、
+             全链总持仓（total_oi）、迁移量（migration，持仓占比变化的正部分之和，即本根K线移动的持仓比例）
+    """
+    symbols = store.symbols(product, include_index=False)
+    if not symbols:
+        return pd.DataFrame()
+
+    oi = {}
+    for symbol in symbols:
+        arrays = store.load_arrays(symbol)
+        if 'close_oi' in arrays:
+            oi[symbol] = pd.Series(arrays['close_oi'], index=arrays['datetime'])
+    panel = pd.DataFrame(oi).sort_index().ffill().fillna(0.0)
+
+    values = panel.values
+    total = values.sum(axis=1)
+    share = np.divide(values, total[:, None], out=np.zeros_like(values), where=total[:, None] > 0)
+    share_change = np.diff(share, axis=0, prepend=share[:1])
+
+    result = pd.DataFrame(share, index=pd.to_datetime(panel.index),
+                          columns=[f'share.{symbol}' for symbol in panel.columns])
+    result.index.name = 'datetime'
+    result['dominant'] = np.asarray(panel.columns)[values.argmax(axis=1)]
+    result['total_oi'] = total
+    result['migration'] = np.clip(share_change, 0, None).sum(axis=1)
+    return result
+
+
+class OIFlowStream:
+    """
+    实时OI特征
+    vnpy的BarData只有收盘持仓量（open_interest），开盘持仓量取上一根K线的收盘持仓量
+    """
+
+    def __init__(self, extra_spec: Dict[str, tuple] = None):
+        self.compiled = compile_oi_features(extra_spec)
+        self.stream = self.compiled.create_stream()
+        self.last_oi: Optional[float] = None
+
+    @property
+    def names(self) -> List[str]:
+        return self.compiled.names
+
+    def update_bar(self, bar) -> np.ndarray:
+        """
+        :return: 与 self.names 对应的特征值
+        """
+        open_oi = self.last_oi if self.last_oi is not None else bar.open_interest
+        self.last_oi = bar.open_interest
+        return self.stream.update([bar.open_price, bar.high_price, bar.low_price, bar.close_price,
+                                   bar.volume, open_oi, bar.open_interest])
+
+    def update_bar_dict(self, bar) -> Dict[str, float]:
+        return dict(zip(self.names, self.update_bar(bar)))
+
+
+class ChainOIMonitor:
+    """
+    实时跟踪同一品种各交割月的持仓占比与主力合约切换
+    """
+
+    def __init__(self, symbols: List[str]):
+        self.symbols = list(symbols)
+        self.index = {symbol: i for i, symbol in enumerate(self.symbols)}
+        self.oi = np.zeros(len(self.symbols))
+        self.share = np.zeros(len(self.symbols))
+        self.dominant: Optional[str] = None
+
+    def update(self, symbol: str, open_interest: float) -> float:
+        """
+        更新某合约的持仓量
+        :return: 本次更新引起的持仓占比迁移量
+        """
+        i = self.index.get(symbol)
+        if i is None:
+            return 0.0
+        self.oi[i] = open_interest
+
+        total = self.oi.sum()
+        share = self.oi / total if total > 0 else np.zeros_like(self.oi)
+        migration = float(np.clip(share - self.share, 0, None).sum())
+        self.share = share
+        self.dominant = self.symbols[int(self.oi.argmax())]
+        return migration
@@ -0,0 +1,342 @@
+"""
+滚动顺序统计模块
+用可索引跳表（indexable skip list）维护窗口内的有序值，插入、删除、按名次取值、求名次均为 O(log w)，
+在此基础上计算滚动中位数、任意分位数、MAD（绝对中位差）与百分位名次。
+批量函数与流式计算器 RollingOrderStats 调用同一组numba函数，结果一致
+"""
+from typing import Dict, Sequence
+
+import numpy as np
+from numba import njit
+
+
+# 状态数组 meta 的下标
+_SIZE = 0       # 跳表中的元素数
+_FREE = 1       # 空闲节点栈顶
+_COUNT = 2      # 已处理的输入数（环形缓冲区写入位置）
+_NAN = 3        # 窗口内无效值（NaN/inf）个数
+
+_HEAD = 0
+_NIL = 1
+
+
+def _max_level(window: int) -> int:
+    return max(2, int(np.ceil(np.log2(window + 1))) + 1)
+
+
+def new_state(window: int):
+    """
+    创建跳表状态
+    :return: (val, nxt, wid, lvl, free, meta, chain, steps, ring)
+    """
+    levels = _max_level(window)
+    capacity = window + 2
+    val = np.zeros(capacity)
+    val[_NIL] = np.inf
+    nxt = np.full((capacity, levels), _NIL, dtype=np.int64)
+    wid = np.ones((capacity, levels), dtype=np.int64)
+    lvl = np.zeros(capacity, dtype=np.int64)
+    free = np.arange(capacity - 1, 1, -1, dtype=np.int64)  # 可用节点编号 2..capacity-1
+    meta = np.zeros(4, dtype=np.int64)
+    meta[_FREE] = free.shape[0]
+    chain = np.zeros(levels, dtype=np.int64)
+    steps = np.zeros(levels, dtype=np.int64)
+    ring = np.full(window, np.nan)
+    return val, nxt, wid, lvl, free, meta, chain, steps, ring
+
+
+@njit(cache=True, inline='always')
+def _insert(value, val, nxt, wid, lvl, free, meta, chain, steps):
+    levels = nxt.shape[1]
+    node = _HEAD
+    for level in range(levels - 1, -1, -1):
+        steps[level] = 0
+        while nxt[node, level] != _NIL and val[nxt[node, level]] <= value:
+            steps[level] += wid[node, level]
+            node = nxt[node, level]
+        chain[level] = node
+
+    # 随机层数：第 d 层的概率为 2^-d
+    d = 1
+    while d < levels and np.random.random() < 0.5:
+        d += 1
+
+    meta[_FREE] -= 1
+    new = free[meta[_FREE]]
+    val[new] = value
+    lvl[new] = d
+
+    acc = 0
+    for level in range(d):
+        prev = chain[level]
+        nxt[new, level] = nxt[prev, level]
+        nxt[prev, level] = new
+        wid[new, level] = wid[prev, level] - acc
+        wid[prev, level] = acc + 1
+        acc += steps[level]
+    for level in range(d, levels):
+        wid[chain[level], level] += 1
+    meta[_SIZE] += 1
+
+
+@njit(cache=True, inline='always')
+def _remove(value, val, nxt, wid, lvl, free, meta, chain):
+    levels = nxt.shape[1]
+    node = _HEAD
+    for level in range(levels - 1, -1, -1):
+        while nxt[node, level] != _NIL and val[nxt[node, level]] < value:
+            node = nxt[node, level]
+        chain[level] = node
+
+    target = nxt[chain[0], 0]
+    d = lvl[target]
+    for level in range(d):
+        prev = chain[level]
+        wid[prev, level] += wid[target, level] - 1
+        nxt[prev, level] = nxt[target, level]
+    for level in range(d, levels):
+        wid[chain[level], level] -= 1
+
+    free[meta[_FREE]] = target
+    meta[_FREE] += 1
+    meta[_SIZE] -= 1
+
+
+@njit(cache=True, inline='always')
+def _select(i, val, nxt, wid):
+    """第 i 小的值（从0开始）"""
+    levels = nxt.shape[1]
+    node = _HEAD
+    i += 1
+    for level in range(levels - 1, -1, -1):
+        while wid[node, level] <= i:
+            i -= wid[node, level]
+            node = nxt[node, level]
+    return val[node]
+
+
+@njit(cache=True, inline='always')
+def _count_less(value, inclusive, val, nxt, wid):
+    """小于（inclusive时为小于等于）value 的元素个数"""
+    levels = nxt.shape[1]
+    node = _HEAD
+    rank = 0
+    for level in range(levels - 1, -1, -1):
+        while nxt[node, level] != _NIL and (val[nxt[node, level]] < value or
+                                            (inclusive and val[nxt[node, level]] == value)):
+            rank += wid[node, level]
+            node = nxt[node, level]
+    return rank
+
+
+@njit(cache=True, inline='always')
+def _push(x, window, val, nxt, wid, lvl, free, meta, chain, steps, ring):
+    """新值进入窗口，最早的值移出窗口；NaN/inf 不进入跳表"""
+    pos = meta[_COUNT] % window
+    if meta[_COUNT] >= window:
+        old = ring[pos]
+        if np.isfinite(old):
+            _remove(old, val, nxt, wid, lvl, free, meta, chain)
+        else:
+            meta[_NAN] -= 1
+    ring[pos] = x
+    if np.isfinite(x):
+        _insert(x, val, nxt, wid, lvl, free, meta, chain, steps)
+    else:
+        meta[_NAN] += 1
+    meta[_COUNT] += 1
+
+
+@njit(cache=True)
+def _quantile(q, val, nxt, wid, meta):
+    """线性插值分位数（与 pandas/numpy 默认一致）"""
+    n = meta[_SIZE]
+    if n == 0:
+        return np.nan
+    pos = q * (n - 1)
+    lo = int(np.floor(pos))
+    frac = pos - lo
+    lower = _select(lo, val, nxt, wid)
+    if frac == 0.0 or lo + 1 >= n:
+        return lower
+    return lower + (_select(lo + 1, val, nxt, wid) - lower) * frac
+
+
+@njit(cache=True)
+def _kth_deviation(k, median, below, n, val, nxt, wid):
+    """
+    第 k 小的 |x - median|
+    中位数左侧的偏离（由近到远）与右侧的偏离分别有序，在两个有序序列上二分求第 k 小
+    """
+    n_left = below
+    n_right = n - below
+    lo = max(0, k + 1 - n_right)
+    hi = min(k + 1, n_left)
+    while lo < hi:
+        i = (lo + hi) // 2          # 取左侧前 i 个
+        j = k + 1 - i               # 取右侧前 j 个
+        left_i = median - _select(below - 1 - i, val, nxt, wid)
+        right_j = _select(below + j - 1, val, nxt, wid) - median
+        if left_i < right_j:
+            lo = i + 1
+        else:
+            hi = i
+    i = lo
+    j = k + 1 - i
+    result = -np.inf
+    if i > 0:
+        result = max(result, median - _select(below - i, val, nxt, wid))
+    if j > 0:
+        result = max(result, _select(below + j - 1, val, nxt, wid) - median)
+    return result
+
+
+@njit(cache=True)
+def _mad(val, nxt, wid, meta):
+    """绝对中位差 median(|x - median(x)|)，O(log² w)"""
+    n = meta[_SIZE]
+    if n == 0:
+        return np.nan
+    median = _quantile(0.5, val, nxt, wid, meta)
+    below = _count_less(median, False, val, nxt, wid)
+    if n % 2 == 1:
+        return _kth_deviation(n // 2, median, below, n, val, nxt, wid)
+    return 0.5 * (_kth_deviation(n // 2 - 1, median, below, n, val, nxt, wid) +
+                  _kth_deviation(n // 2, median, below, n, val, nxt, wid))
+
+
+@njit(cache=True)
+def _pct_rank(x, val, nxt, wid, meta):
+    """x 在窗口中的百分位名次（并列取平均名次，与 pandas rank(pct=True) 一致）"""
+    n = meta[_SIZE]
+    if n == 0 or not np.isfinite(x):
+        return np.nan
+    less = _count_less(x, False, val, nxt, wid)
+    equal = _count_less(x, True, val, nxt, wid) - less
+    return (less + (equal + 1) / 2.0) / n
+
+
+@njit(cache=True)
+def _rolling_kernel(values, window, min_periods, quantiles, with_mad, with_rank,
+                    val, nxt, wid, lvl, free, meta, chain, steps, ring):
+    n = values.shape[0]
+    n_q = quantiles.shape[0]
+    out_q = np.full((n, n_q), np.nan)
+    out_mad = np.full(n, np.nan)
+    out_rank = np.full(n, np.nan)
+
+    for t in range(n):
+        x = values[t]
+        _push(x, window, val, nxt, wid, lvl, free, meta, chain, steps, ring)
+        if meta[_SIZE] < min_periods:
+            continue
+        for j in range(n_q):
+            out_q[t, j] = _quantile(quantiles[j], val, nxt, wid, meta)
+        if with_mad:
+            out_mad[t] = _mad(val, nxt, wid, meta)
+        if with_rank:
+            out_rank[t] = _pct_rank(x, val, nxt, wid, meta)
+
+    return out_q, out_mad, out_rank
+
+
+def rolling_order_stats(values: np.ndarray, window: int, quantiles: Sequence[float] = (0.5,),
+                        mad: bool = False, rank: bool = False, min_periods: int = None) -> Dict[str, np.ndarray]:
+    """
+    一次遍历计算多个滚动顺序统计量，共用同一个跳表
+    :param values: 输入序列，NaN/inf 不计入窗口内的有效值
+    :param window: 窗口长度
+    :param quantiles: 分位数列表，如 (0.25, 0.5, 0.75)
+    :param mad: 是否计算MAD
+    :param rank: 是否计算当前值在窗口中的百分位名次
+    :param min_periods: 最少有效值个数，默认等于窗口长度
+    :return: {'q0.25': ..., 'mad': ..., 'rank': ...}
+    """
+    values = np.ascontiguousarray(values, dtype=np.float64)
+    min_periods = window if min_periods is None else min_periods
+    quantiles = np.asarray(quantiles, dtype=np.float64)
+
+    out_q, out_mad, out_rank = _rolling_kernel(values, window, min_periods, quantiles, mad, rank,
+                                               *new_state(window))
+    result = {f'q{q:g}': out_q[:, j] for j, q in enumerate(quantiles)}
+    if mad:
+        result['mad'] = out_mad
+    if rank:
+        result['rank'] = out_rank
+    return result
+
+
+def rolling_quantile(values: np.ndarray, window: int, q: float, min_periods: int = None) -> np.ndarray:
+    """滚动分位数"""
+    return rolling_order_stats(values, window, (q,), min_periods=min_periods)[f'q{q:g}']
+
+
+def rolling_median(values: np.ndarray, window: int, min_periods: int = None) -> np.ndarray:
+    """滚动中位数"""
+    return rolling_quantile(values, window, 0.5, min_periods)
+
+
+def rolling_mad(values: np.ndarray, window: int, min_periods: int = None) -> np.ndarray:
+    """滚动MAD"""
+    return rolling_order_stats(values, window, (), mad=True, min_periods=min_periods)['mad']
+
+
+def rolling_rank(values: np.ndarray, window: int, min_periods: int = None) -> np.ndarray:
+    """滚动百分位名次"""
+    return rolling_order_stats(values, window, (), rank=True, min_periods=min_periods)['rank']
+
+
+class RollingOrderStats:
+    """
+    流式滚动顺序统计：每次 update O(log w)，查询 O(log w)（MAD为 O(log² w)）
+    可用于tick级的稳健特征，如价差中位数、成交量分位数、价格的稳健z值
+    """
+
+    def __init__(self, window: int, min_periods: int = None):
+        self.window = window
+        self.min_periods = window if min_periods is None else min_periods
+        self.state = new_state(window)
+
+    def reset(self):
+        self.state = new_state(self.window)
+
+    def update(self, x: float):
+        _push(float(x), self.window, *self.state)
+
+    @property
+    def count(self) -> int:
+        """窗口内的有效值个数"""
+        return int(self.state[5][_SIZE])
+
+    @property
+    def ready(self) -> bool:
+        return self.count >= self.min_periods
+
+    def quantile(self, q: float) -> float:
+        if not self.ready:
+            return np.nan
+        val, nxt, wid, _, _, meta = self.state[:6]
+        return _quantile(q, val, nxt, wid, meta)
+
+    def median(self) -> float:
+        return self.quantile(0.5)
+
+    def mad(self) -> float:
+        if not self.ready:
+            return np.nan
+        val, nxt, wid, _, _, meta = self.state[:6]
+        return _mad(val, nxt, wid, meta)
+
+    def rank(self, x: float) -> float:
+        """x 在当前窗口中的百分位名次"""
+        if not self.ready:
+            return np.nan
+        val, nxt, wid, _, _, meta = self.state[:6]
+        return _pct_rank(float(x), val, nxt, wid, meta)
+
+    def robust_zscore(self, x: float) -> float:
+        """稳健z值：(x - 中位数) / (1.4826 * MAD)"""
+        mad = self.mad()
+        if not mad or not np.isfinite(mad):
+            return np.nan
+        return (x - self.median()) / (1.4826 * mad)
@@ -0,0 +1,250 @@
+"""
+日内季节性模块
+按品种统计交易日内每一分钟（时段内序号）的成交量、绝对收益率、K线振幅的典型水平，
+存为紧凑的查找数组：分钟 -> 时段内序号 -> 季节性系数，查询为两次数组下标，O(1)。
+批量特征与实时特征都用同一张表去季节化，避免开盘、休盘后成交量比率的剧烈跳动；
+该表也可用于VWAP执行的成交量分配和异常检测
+"""
+from datetime import datetime
+from typing import Dict, List, Sequence
+
+import numpy as np
+import pandas as pd
+
+from src.data.bar_store import BarStore, symbol_to_product
+from src.data.features.indicator_graph import IndicatorGraph
+from src.trading.sessions import build_minute_map
+
+
+# 季节性统计字段
+SEASONAL_FIELDS = ('volume', 'abs_return', 'range')
+
+SEASONAL_INPUTS = ('high', 'low', 'close', 'volume', 'volume_profile', 'abs_return_profile', 'range_profile')
+
+
+def _minutes_of_day(datetimes) -> np.ndarray:
+    """时间戳（北京时间，int64纳秒或DatetimeIndex）-> 当日分钟数"""
+    if isinstance(datetimes, pd.DatetimeIndex):
+        return (datetimes.hour * 60 + datetimes.minute).values.astype(np.int64)
+    ns = np.asarray(datetimes, dtype=np.int64)
+    return (ns // 60_000_000_000) % 1440
+
+
+class SeasonalityProfile:
+    """
+    单个品种的日内季节性表
+    各字段的系数以全天平均为1，表示该分钟相对全天的典型倍数；
+    表末尾多存一个1.0，非交易时间（序号-1）直接查到该值，查询无需分支
+    """
+
+    def __init__(self, product: str, minute_map: np.ndarray, tables: Dict[str, np.ndarray],
+                 counts: np.ndarray = None):
+        """
+        :param minute_map: build_minute_map 的结果
+        :param tables: {字段: 长度为 时段分钟数+1 的系数数组}
+        :param counts: 每个时段分钟的样本数
+        """
+        self.product = product
+        self.minute_map = minute_map
+        self.tables = tables
+        self.n_slots = int(minute_map.max()) + 1
+        self.counts = counts if counts is not None else np.zeros(self.n_slots, dtype=np.int64)
+
+    def slot(self, dt: datetime) -> int:
+        """时段分钟序号，非交易时间为-1"""
+        return int(self.minute_map[dt.hour * 60 + dt.minute])
+
+    def slots(self, datetimes) -> np.ndarray:
+        """批量计算时段分钟序号"""
+        return self.minute_map[_minutes_of_day(datetimes)]
+
+    def lookup(self, field: str, dt: datetime) -> float:
+        """某时刻的季节性系数"""
+        return float(self.tables[field][self.minute_map[dt.hour * 60 + dt.minute]])
+
+    def lookup_array(self, field: str, datetimes) -> np.ndarray:
+        """批量查询季节性系数"""
+        return self.tables[field][self.slots(datetimes)]
+
+    def normalize(self, field: str, values: np.ndarray, datetimes) -> np.ndarray:
+        """去季节化：除以对应分钟的季节性系数"""
+        return np.asarray(values, dtype=np.float64) / self.lookup_array(field, datetimes)
+
+    def volume_weights(self, start: datetime, end: datetime) -> np.ndarray:
+        """
+        [start, end) 内各分钟的成交量占比，可直接作为VWAP执行的分配比例
+        """
+        slots = self.slots(pd.date_range(start, end, freq='1min', inclusive='left'))
+        weights = np.where(slots >= 0, self.tables['volume'][slots], 0.0)
+        total = weights.sum()
+        return weights / total if total > 0 else weights
+
+    def to_frame(self) -> pd.DataFrame:
+        """以时段分钟序号为索引的系数表"""
+        frame = pd.DataFrame({field: table[:-1] for field, table in self.tables.items()})
+        frame['count'] = self.counts
+        frame.index.name = 'slot'
+        return frame
+
+
+def build_seasonality(store: BarStore, products: Sequence[str] = None,
+                      include_index: bool = False) -> Dict[str, SeasonalityProfile]:
+    """
+    从K线仓库统计各品种的日内季节性表
+    每个合约只遍历一次，按时段分钟序号用 bincount 分组累加；各合约先除以自身的均值消除流动性差异，
+    再按合约平均成交量加权合并，使主力合约主导、远月稀疏合约的噪声影响小
+    :param products: 品种列表，默认为仓库中的全部品种
+    :param include_index: 是否包含指数/主连合约
+    :return: {品种: SeasonalityProfile}
+    """
+    symbols = store.symbols(include_index=include_index)
+    if products is None:
+        products = sorted({symbol_to_product(symbol) for symbol in symbols})
+
+    profiles = {}
+    for product in products:
+        product_symbols = [s for s in symbols if symbol_to_product(s) == product]
+        if not product_symbols:
+            continue
+
+        minute_map = build_minute_map(product)
+        n_slots = int(minute_map.max()) + 1
+        sums = {field: np.zeros(n_slots) for field in SEASONAL_FIELDS}
+        weight_sums = np.zeros(n_slots)
+        counts = np.zeros(n_slots, dtype=np.int64)
+
+        for symbol in product_symbols:
+            arrays = store.load_arrays(symbol)
+            close = arrays['close']
+            with np.errstate(divide='ignore', invalid='ignore'):
+                values = {
+                    'volume': arrays['volume'],
+                    'abs_return': np.abs(np.diff(np.log(close), prepend=np.nan)),
+                    'range': (arrays['high'] - arrays['low']) / close,
+                }
+            slots = minute_map[_minutes_of_day(arrays['datetime'])]
+            valid = slots >= 0
+            for x in values.values():
+                valid &= np.isfinite(x)
+            if not valid.any():
+                continue
+
+            weight = arrays['volume'][valid].mean()
+            if weight <= 0:
+                continue
+            for field, x in values.items():
+                level = x[valid].mean()
+                if level > 0:
+                    sums[field] += np.bincount(slots[valid], weights=x[valid] / level, minlength=n_slots) * weight
+            weight_sums += np.bincount(slots[valid], minlength=n_slots) * weight
+            counts += np.bincount(slots[valid], minlength=n_slots)
+
+        tables = {}
+        has_data = weight_sums > 0
+        for field in SEASONAL_FIELDS:
+            table = np.ones(n_slots + 1)
+            if has_data.any():
+                factor = sums[field][has_data] / weight_sums[has_data]
+                mean = factor.mean()
+                # 无样本的分钟按1处理；系数下限避免去季节化时除以接近0的值
+                table[:n_slots][has_data] = np.maximum(factor / mean, 1e-3) if mean > 0 else 1.0
+            tables[field] = table
+
+        profiles[product] = SeasonalityProfile(product, minute_map, tables, counts)
+        print(f"季节性表 {product}: {len(product_symbols)} 个合约, {n_slots} 个时段分钟, 样本 {counts.sum()}")
+
+    return profiles
+
+
+def save_seasonality(profiles: Dict[str, SeasonalityProfile], path: str):
+    """保存季节性表（npz）"""
+    arrays = {}
+    for product, profile in profiles.items():
+        arrays[f'{product}.minute_map'] = profile.minute_map
+        arrays[f'{product}.count'] = profile.counts
+        for field, table in profile.tables.items():
+            arrays[f'{product}.{field}'] = table
+    np.savez_compressed(path, **arrays)
+
+
+def load_seasonality(path: str) -> Dict[str, SeasonalityProfile]:
+    """加载 save_seasonality 保存的季节性表"""
+    data = np.load(path)
+    products = sorted({key.rsplit('.', 1)[0] for key in data.files})
+    profiles = {}
+    for product in products:
+        tables = {field: data[f'{product}.{field}'] for field in SEASONAL_FIELDS if f'{product}.{field}' in data.files}
+        profiles[product] = SeasonalityProfile(product, data[f'{product}.minute_map'], tables,
+                                               data[f'{product}.count'])
+    return profiles
+
+
+def seasonal_spec(window: int = 20) -> Dict[str, tuple]:
+    """
+    去季节化特征规格：先除以季节性系数，再与最近 window 根K线去季节化后的均值比较
+    :return: seasonal_volume_ratio、seasonal_volatility_ratio、seasonal_range_ratio，正常水平为1
+    """
+    return {
+        '_volume_deseason': ('safe_div', 'volume', 'volume_profile'),
+        '_volume_level': ('sma', '_volume_deseason', window),
+        'seasonal_volume_ratio': ('safe_div', '_volume_deseason', '_volume_level'),
+        '_log_return': ('log_return', 'close'),
+        '_abs_return': ('abs', '_log_return'),
+        '_abs_return_deseason': ('safe_div', '_abs_return', 'abs_return_profile'),
+        '_abs_return_level': ('sma', '_abs_return_deseason', window),
+        'seasonal_volatility_ratio': ('safe_div', '_abs_return_deseason', '_abs_return_level'),
+        '_range': ('sub', 'high', 'low'),
+        '_range_pct': ('safe_div', '_range', 'close'),
+        '_range_deseason': ('safe_div', '_range_pct', 'range_profile'),
+        '_range_level': ('sma', '_range_deseason', window),
+        'seasonal_range_ratio': ('safe_div', '_range_deseason', '_range_level'),
+    }
+
+
+def compile_seasonal_features(window: int = 20):
+    return IndicatorGraph.from_spec(seasonal_spec(window), inputs=SEASONAL_INPUTS).compile()
+
+
+def seasonal_features(data, profile: SeasonalityProfile, window: int = 20) -> pd.DataFrame:
+    """
+    批量计算去季节化特征
+    :param data: 以时间为索引的标准格式DataFrame，或包含 datetime 的列式数组（BarStore.load_arrays）
+    """
+    datetimes = data.index if isinstance(data, pd.DataFrame) else data['datetime']
+    slots = profile.slots(datetimes)
+    inputs = {name: np.asarray(data[name], dtype=np.float64) for name in ('high', 'low', 'close', 'volume')}
+    for field in SEASONAL_FIELDS:
+        inputs[f'{field}_profile'] = profile.tables[field][slots]
+
+    result = compile_seasonal_features(window).transform(inputs)
+    if isinstance(data, pd.DataFrame):
+        result.index = data.index
+    return result
+
+
+class SeasonalFeatureStream:
+    """
+    实时去季节化特征：每根K线两次查表加一次计算图更新，与 seasonal_features 结果一致
+    """
+
+    def __init__(self, profile: SeasonalityProfile, window: int = 20):
+        self.profile = profile
+        self.compiled = compile_seasonal_features(window)
+        self.stream = self.compiled.create_stream()
+
+    @property
+    def names(self) -> List[str]:
+        return self.compiled.names
+
+    def update_bar(self, bar) -> np.ndarray:
+        """
+        :param bar: vnpy BarData
+        :return: 与 self.names 对应的特征值
+        """
+        slot = self.profile.minute_map[bar.datetime.hour * 60 + bar.datetime.minute]
+        tables = self.profile.tables
+        return self.stream.update([bar.high_price, bar.low_price, bar.close_price, bar.volume,
+                                   tables['volume'][slot], tables['abs_return'][slot], tables['range'][slot]])
+
+    def update_bar_dict(self, bar) -> Dict[str, float]:
+        return dict(zip(self.names, self.update_bar(bar)))
@@ -0,0 +1,256 @@
+"""
+三重障碍标注模块
+按剥头皮策略的实际出场规则（止盈跳数、止损跳数、最长持仓K线数）为每根K线生成训练标签，
+并为现有策略的开仓信号生成元标签（meta-label）
+"""
+from typing import List, Optional
+
+import numpy as np
+import pandas as pd
+from numba import njit, prange
+
+from src.data.bar_store import BarStore, symbol_to_code
+from src.trading.contract_specs import get_contract_spec
+
+
+# 单边出场结果
+OUTCOME_TAKE_PROFIT = 1   # 先触及止盈
+OUTCOME_STOP_LOSS = -1    # 先触及止损
+OUTCOME_TIMEOUT = 0       # 持仓到期（时间障碍）
+
+
+@njit(parallel=True, cache=True)
+def _triple_barrier_kernel(close, high, low, side, tp_dist, sl_dist, max_holding, use_high_low):
+    """
+    向前扫描每根K线的三重障碍，触及任一障碍即提前退出
+    :param side: 每根K线的开仓方向，1多头，-1空头，0跳过
+    :return: (出场结果, 出场K线偏移, 以价格计的收益, 标签是否有效)
+             数据末尾时间障碍不完整且未触及止盈止损的K线结果未知，标为无效
+    """
+    n = close.shape[0]
+    outcome = np.zeros(n, dtype=np.int8)
+    exit_offset = np.full(n, -1, dtype=np.int32)
+    exit_return = np.full(n, np.nan)
+    valid = np.zeros(n, dtype=np.bool_)
+
+    for i in prange(n):
+        s = side[i]
+        if s == 0:
+            continue
+
+        entry = close[i]
+        end = min(i + max_holding, n - 1)
+        if end <= i:
+            continue
+
+        take_profit = entry + s * tp_dist
+        stop_loss = entry - s * sl_dist
+
+        result = OUTCOME_TIMEOUT
+        j = end
+        for k in range(i + 1, end + 1):
+            if use_high_low:
+                favorable = high[k] if s > 0 else low[k]
+                adverse = low[k] if s > 0 else high[k]
+            else:
+                favorable = close[k]
+                adverse = close[k]
+
+            # 同一根K线内同时触及止盈止损时，保守地按止损处理
+            if s * (adverse - stop_loss) <= 0:
+                result = OUTCOME_STOP_LOSS
+                j = k
+                break
+            if s * (favorable - take_profit) >= 0:
+                result = OUTCOME_TAKE_PROFIT
+                j = k
+                break
+
+        outcome[i] = result
+        exit_offset[i] = j - i
+        if result == OUTCOME_TIMEOUT and i + max_holding > n - 1:
+            continue
+        valid[i] = True
+        if result == OUTCOME_TAKE_PROFIT:
+            exit_return[i] = tp_dist
+        elif result == OUTCOME_STOP_LOSS:
+            exit_return[i] = -sl_dist
+        else:
+            exit_return[i] = s * (close[j] - entry)
+
+    return outcome, exit_offset, exit_return, valid
+
+
+@njit(cache=True)
+def talib_ema(values, period):
+    """
+    与 talib.EMA / ArrayManager.ema 一致的EMA：以前period个值的均值为种子
+    """
+    n = values.shape[0]
+    result = np.full(n, np.nan)
+    if n < period:
+        return result
+
+    alpha = 2.0 / (period + 1)
+    seed = 0.0
+    for i in range(period):
+        seed += values[i]
+    ema = seed / period
+    result[period - 1] = ema
+    for i in range(period, n):
+        ema = alpha * values[i] + (1.0 - alpha) * ema
+        result[i] = ema
+    return result
+
+
+def triple_barrier_labels(close: np.ndarray, price_tick: float, take_profit_tick: int = 2,
+                          stop_loss_tick: int = 3, max_holding: int = 30, high: np.ndarray = None,
+                          low: np.ndarray = None, side: np.ndarray = None) -> pd.DataFrame:
+    """
+    计算三重障碍标签
+    :param close: 收盘价数组
+    :param price_tick: 最小变动价位
+    :param take_profit_tick: 止盈跳数
+    :param stop_loss_tick: 止损跳数
+    :param max_holding: 时间障碍（最长持仓K线数）
+    :param high: 最高价数组，提供high/low时按K线内极值判断触及，否则与策略一致按收盘价判断
+    :param low: 最低价数组
+    :param side: 开仓方向数组，为None时同时计算多空两个方向
+    :return: DataFrame，单方向时列为 outcome/exit_offset/ret_ticks/valid；
+             双方向时为 long_*/short_* 以及合成标签 label（1看多，-1看空，0无优势）和 valid；
+             valid 为False的K线（数据末尾时间障碍不完整）训练时应剔除
+    """
+    close = np.ascontiguousarray(close, dtype=np.float64)
+    use_high_low = high is not None and low is not None
+    if use_high_low:
+        high = np.ascontiguousarray(high, dtype=np.float64)
+        low = np.ascontiguousarray(low, dtype=np.float64)
+    else:
+        high = close
+        low = close
+
+    tp_dist = take_profit_tick * price_tick
+    sl_dist = stop_loss_tick * price_tick
+
+    def run(side_array):
+        return _triple_barrier_kernel(close, high, low, side_array.astype(np.int8),
+                                      tp_dist, sl_dist, max_holding, use_high_low)
+
+    if side is not None:
+        outcome, exit_offset, exit_return, valid = run(np.asarray(side))
+        return pd.DataFrame({
+            'outcome': outcome,
+            'exit_offset': exit_offset,
+            'ret_ticks': exit_return / price_tick,
+            'valid': valid
+        })
+
+    n = close.shape[0]
+    long_outcome, long_exit, long_return, long_valid = run(np.ones(n))
+    short_outcome, short_exit, short_return, short_valid = run(-np.ones(n))
+
+    # 合成标签：哪个方向先止盈即标注为该方向
+    long_win = long_outcome == OUTCOME_TAKE_PROFIT
+    short_win = short_outcome == OUTCOME_TAKE_PROFIT
+    label = np.zeros(n, dtype=np.int8)
+    label[long_win & (~short_win | (long_exit <= short_exit))] = 1
+    label[short_win & (~long_win | (short_exit < long_exit))] = -1
+    # 一方在数据内止盈时，另一方即使结果未知也只会更晚止盈，合成标签仍然确定
+    valid = (long_valid & short_valid) | long_win | short_win
+
+    return pd.DataFrame({
+        'label': label,
+        'long_outcome': long_outcome,
+        'long_exit_offset': long_exit,
+        'long_ret_ticks': long_return / price_tick,
+        'short_outcome': short_outcome,
+        'short_exit_offset': short_exit,
+        'short_ret_ticks': short_return / price_tick,
+        'valid': valid
+    })
+
+
+def ema_cross_signals(close: np.ndarray, fast_window: int = 5, slow_window: int = 20,
+                      trend: np.ndarray = None) -> np.ndarray:
+    """
+    复现剥头皮策略（ScalpingOrderflowStrategy / HybridTrendScalpStrategy）的开仓方向
+    盘口过滤依赖tick数据，K线上无法复现，这里只保留EMA方向（及可选的AI趋势方向）
+    :param trend: AI趋势方向数组（1/-1/0），提供时要求EMA方向与趋势一致
+    :return: 开仓方向数组，1多头，-1空头，0无信号
+    """
+    close = np.ascontiguousarray(close, dtype=np.float64)
+    ema_fast = talib_ema(close, fast_window)
+    ema_slow = talib_ema(close, slow_window)
+
+    side = np.zeros(close.shape[0], dtype=np.int8)
+    side[ema_fast > ema_slow] = 1
+    side[ema_fast < ema_slow] = -1
+
+    if trend is not None:
+        side[np.asarray(trend) != side] = 0
+
+    return side
+
+
+def meta_labels(close: np.ndarray, side: np.ndarray, price_tick: float, take_profit_tick: int = 2,
+                stop_loss_tick: int = 3, max_holding: int = 30, high: np.ndarray = None,
+                low: np.ndarray = None) -> pd.DataFrame:
+    """
+    为策略信号生成元标签：信号方向上先触及止盈记为1，否则为0
+    :param side: 策略信号方向数组
+    :return: 仅包含有信号的K线，列为 bar_index/side/meta_label/outcome/exit_offset/ret_ticks
+    """
+    side = np.asarray(side)
+    result = triple_barrier_labels(close, price_tick, take_profit_tick, stop_loss_tick,
+                                   max_holding, high=high, low=low, side=side)
+    result.insert(0, 'side', side)
+    result.insert(0, 'bar_index', np.arange(len(side)))
+    result = result[(result['side'] != 0) & result['valid']]
+    result.insert(2, 'meta_label', (result['outcome'] == OUTCOME_TAKE_PROFIT).astype(np.int8))
+    return result.reset_index(drop=True)
+
+
+def build_triple_barrier_dataset(store: BarStore, symbols: Optional[List[str]] = None,
+                                 take_profit_tick: int = 2, stop_loss_tick: int = 3,
+                                 max_holding: int = 30, use_high_low: bool = False,
+                                 fast_window: int = 5, slow_window: int = 20) -> pd.DataFrame:
+    """
+    为数据仓库中的全部合约批量生成三重障碍标签和策略元标签
+    :param store: K线数据仓库
+    :param symbols: 合约列表，默认全部
+    :return: 逐K线的标签DataFrame，包含 symbol/datetime 列，
+             以及策略信号方向 signal_side 与对应元标签 meta_label（无信号或标签无效处为-1）
+    """
+    symbols = symbols or store.symbols()
+    frames = []
+
+    for symbol in symbols:
+        arrays = store.load_arrays(symbol)
+        close = arrays['close']
+        if len(close) == 0:
+            continue
+
+        spec = get_contract_spec(symbol_to_code(symbol))
+        price_tick = spec['price_tick']
+        high = arrays['high'] if use_high_low else None
+        low = arrays['low'] if use_high_low else None
+
+        labels = triple_barrier_labels(close, price_tick, take_profit_tick, stop_loss_tick,
+                                       max_holding, high=high, low=low)
+
+        side = ema_cross_signals(close, fast_window, slow_window)
+        meta = meta_labels(close, side, price_tick, take_profit_tick, stop_loss_tick,
+                           max_holding, high=high, low=low)
+        meta_label = np.full(len(close), -1, dtype=np.int8)
+        meta_label[meta['bar_index'].values] = meta['meta_label'].values
+
+        labels.insert(0, 'datetime', pd.to_datetime(arrays['datetime']))
+        labels.insert(0, 'symbol', symbol)
+        labels['signal_side'] = side
+        labels['meta_label'] = meta_label
+        frames.append(labels)
+
+    if not frames:
+        return pd.DataFrame()
+
+    return pd.concat(frames, ignore_index=True)
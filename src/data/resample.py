@@ -0,0 +1,231 @@
+"""
+K线重采样模块
+把1分钟K线按交易时段聚合为N分钟K线，或把tick聚合为1分钟K线，分段归约一次遍历完成。
+align='vnpy' 时与 vnpy BarGenerator 的实时合成逐根一致（分钟数 (minute + 1) % window == 0 时收线，
+K线时间取窗口内第一根K线的时间），模型可以在策略实际交易的同一组K线上训练；
+align='session' 时窗口从每个交易时段的开盘起算，在休盘、收盘处截断
+"""
+from typing import Dict, List
+
+import numpy as np
+import pandas as pd
+from numba import njit
+
+from src.data.bar_store import BAR_FIELDS, BarStore
+from src.data.sampling import reduce_segments
+from src.trading.sessions import build_session_map, get_sessions
+
+
+_MINUTE_NS = 60_000_000_000
+
+
+def vnpy_window_ends(datetimes: np.ndarray, window: int) -> np.ndarray:
+    """
+    BarGenerator(window, Interval.MINUTE) 的收线下标：分钟数满足 (minute + 1) % window == 0 的K线
+    :param datetimes: int64纳秒（北京时间）
+    """
+    minute_of_hour = (np.asarray(datetimes, dtype=np.int64) // _MINUTE_NS) % 60
+    return np.flatnonzero((minute_of_hour + 1) % window == 0)
+
+
+def session_window_ends(datetimes: np.ndarray, symbol: str, window: int) -> np.ndarray:
+    """
+    按交易时段对齐的收线下标：窗口从时段开盘起每 window 分钟一段，时段结束时收线
+    :return: 每段最后一根K线的下标（末尾未走完的窗口不计入）
+    """
+    datetimes = np.asarray(datetimes, dtype=np.int64)
+    if len(datetimes) == 0:
+        return np.empty(0, dtype=np.int64)
+
+    session_index, position = build_session_map(symbol)
+    minutes = (datetimes // _MINUTE_NS) % 1440
+    session = session_index[minutes]
+    # 不在交易时段内的K线按当日分钟数单独分段
+    slot = np.where(session >= 0, position[minutes], minutes) // window
+
+    # 同一窗口内的K线相距不足 window 分钟；窗口序号或时段变化、或间隔过长（跨交易日）即换段
+    new_segment = np.empty(len(datetimes), dtype=np.bool_)
+    new_segment[0] = True
+    new_segment[1:] = ((session[1:] != session[:-1]) | (slot[1:] != slot[:-1]) |
+                       (np.diff(datetimes) >= window * _MINUTE_NS))
+    ends = np.flatnonzero(new_segment[1:])
+
+    # 最后一段只有走到窗口末尾或时段末尾才算完整
+    last = len(datetimes) - 1
+    lengths = [end - start for start, end in get_sessions(symbol)]
+    pos = position[minutes[last]]
+    if session[last] >= 0 and ((pos + 1) % window == 0 or pos + 1 == lengths[session[last]]):
+        ends = np.append(ends, last)
+    return ends
+
+
+def resample_arrays(arrays: Dict[str, np.ndarray], window: int, align: str = 'vnpy', symbol: str = None,
+                    include_partial: bool = False) -> Dict[str, np.ndarray]:
+    """
+    1分钟K线重采样为 window 分钟K线
+    :param arrays: 列式K线数据（BarStore.load_arrays 的返回值）
+    :param align: 'vnpy' 与 BarGenerator 一致 / 'session' 按交易时段对齐
+    :param symbol: align='session' 时用于确定交易时段
+    :param include_partial: 是否保留末尾未收线的窗口（实时合成中尚未推送的K线）
+    :return: 列式数据，datetime 为窗口首根K线的时间，open_oi/close_oi 分别取首根/末根
+    """
+    datetimes = arrays['datetime']
+    if align == 'vnpy':
+        ends = vnpy_window_ends(datetimes, window)
+    elif align == 'session':
+        if symbol is None:
+            raise ValueError("align='session' requires symbol")
+        ends = session_window_ends(datetimes, symbol, window)
+    else:
+        raise ValueError(f"Unsupported align mode: {align}")
+
+    last = len(datetimes) - 1
+    if include_partial and last >= 0 and (len(ends) == 0 or ends[-1] != last):
+        ends = np.append(ends, last)
+    return reduce_segments(arrays, ends)
+
+
+def resample_frame(df: pd.DataFrame, window: int, align: str = 'vnpy', symbol: str = None,
+                   include_partial: bool = False) -> pd.DataFrame:
+    """
+    标准格式DataFrame（datetime索引）重采样
+    """
+    arrays = {field: df[field].values.astype(np.float64) for field in BAR_FIELDS if field in df.columns}
+    arrays['datetime'] = df.index.values.astype('datetime64[ns]').astype(np.int64)
+    return to_frame(resample_arrays(arrays, window, align, symbol, include_partial))
+
+
+def to_frame(arrays: Dict[str, np.ndarray]) -> pd.DataFrame:
+    """列式数据转为标准格式DataFrame"""
+    df = pd.DataFrame({field: arrays[field] for field in BAR_FIELDS if field in arrays})
+    df.index = pd.to_datetime(arrays['datetime'])
+    df.index.name = 'datetime'
+    return df
+
+
+@njit(cache=True)
+def _tick_bar_kernel(datetimes, last_price, high_price, low_price, volume, turnover, open_interest):
+    """
+    逐笔复现 BarGenerator.update_tick：
+    分钟（时、分）变化时收线；高低价同时参考tick内的当日最高/最低价变化；
+    成交量、成交额取累计值的正增量；最后一根未收线的K线不输出
+    """
+    n = datetimes.shape[0]
+    out_dt = np.empty(n, dtype=np.int64)
+    out = np.empty((n, 7))      # open, high, low, close, volume, turnover, open_interest
+    count = 0
+
+    has_bar = False
+    has_last = False
+    bar_minute = -1
+    last = 0
+    for i in range(n):
+        price = last_price[i]
+        if price == 0.0 or np.isnan(price):
+            continue
+        minute = datetimes[i] // _MINUTE_NS
+
+        new_minute = not has_bar
+        if has_bar and minute != bar_minute:
+            count += 1
+            new_minute = True
+
+        if new_minute:
+            has_bar = True
+            bar_minute = minute
+            out_dt[count] = minute * _MINUTE_NS
+            out[count, 0] = price
+            out[count, 1] = price
+            out[count, 2] = price
+            out[count, 3] = price
+            out[count, 4] = 0.0
+            out[count, 5] = 0.0
+            out[count, 6] = open_interest[i]
+        else:
+            out[count, 1] = max(out[count, 1], price)
+            if high_price[i] > high_price[last]:
+                out[count, 1] = max(out[count, 1], high_price[i])
+            out[count, 2] = min(out[count, 2], price)
+            if low_price[i] < low_price[last]:
+                out[count, 2] = min(out[count, 2], low_price[i])
+            out[count, 3] = price
+            out[count, 6] = open_interest[i]
+
+        if has_last:
+            out[count, 4] += max(volume[i] - volume[last], 0.0)
+            out[count, 5] += max(turnover[i] - turnover[last], 0.0)
+        has_last = True
+        last = i
+
+    return out_dt[:count], out[:count]
+
+
+def ticks_to_bars(ticks: pd.DataFrame) -> Dict[str, np.ndarray]:
+    """
+    tick聚合为1分钟K线，与 BarGenerator.update_tick 的输出一致
+    :param ticks: 按时间排序，包含 datetime（北京时间）、last_price、high_price、low_price、
+                  volume（累计成交量）、open_interest，可选 turnover（累计成交额）的DataFrame；
+                  DataCollector.load_tick_data 的结果可用 pd.DataFrame([t.__dict__ for t in ticks]) 转换
+    :return: 列式数据，open_oi/close_oi 均为K线最后一笔tick的持仓量（BarGenerator 只记录收盘持仓）
+    """
+    datetimes = pd.to_datetime(ticks['datetime'])
+    if datetimes.dt.tz is not None:
+        datetimes = datetimes.dt.tz_localize(None)
+    column = lambda name: np.ascontiguousarray(ticks[name].values, dtype=np.float64)
+    turnover = column('turnover') if 'turnover' in ticks.columns else np.zeros(len(ticks))
+
+    out_dt, out = _tick_bar_kernel(datetimes.values.astype('datetime64[ns]').astype(np.int64),
+                                   column('last_price'), column('high_price'), column('low_price'),
+                                   column('volume'), turnover, column('open_interest'))
+    return {
+        'datetime': out_dt,
+        'open': out[:, 0],
+        'high': out[:, 1],
+        'low': out[:, 2],
+        'close': out[:, 3],
+        'volume': out[:, 4],
+        'turnover': out[:, 5],
+        'open_oi': out[:, 6],
+        'close_oi': out[:, 6],
+    }
+
+
+class ResampledBarStore:
+    """
+    重采样后的K线仓库，接口与 BarStore 相同（symbols/load_arrays/load_frame/load_many），
+    可直接传给标注、季节性、分数差分等按仓库工作的函数；结果按合约缓存
+    """
+
+    def __init__(self, store: BarStore, window: int, align: str = 'vnpy', include_partial: bool = False):
+        """
+        :param store: 1分钟K线仓库
+        :param window: 目标周期（分钟），与策略中 BarGenerator 的 window 一致
+        """
+        if align not in ('vnpy', 'session'):
+            raise ValueError(f"Unsupported align mode: {align}")
+        self.store = store
+        self.window = window
+        self.align = align
+        self.include_partial = include_partial
+        self.period = store.period * window
+        self._cache: Dict[str, Dict[str, np.ndarray]] = {}
+
+    def symbols(self, product: str = None, include_index: bool = True) -> List[str]:
+        return self.store.symbols(product, include_index)
+
+    def load_arrays(self, symbol: str) -> Dict[str, np.ndarray]:
+        if symbol not in self._cache:
+            self._cache[symbol] = resample_arrays(self.store.load_arrays(symbol), self.window, self.align,
+                                                  symbol, self.include_partial)
+        return self._cache[symbol]
+
+    def load_many(self, symbols: List[str] = None, max_workers: int = None) -> Dict[str, Dict[str, np.ndarray]]:
+        symbols = symbols or self.store.symbols()
+        self.store.load_many(symbols, max_workers)
+        return {symbol: self.load_arrays(symbol) for symbol in symbols}
+
+    def load_frame(self, symbol: str) -> pd.DataFrame:
+        return to_frame(self.load_arrays(symbol))
+
+    def clear_cache(self):
+        self._cache.clear()
@@ -0,0 +1,286 @@
+"""
+事件驱动采样模块
+由1分钟K线或实时tick构建成交量K线、成交额K线，以及CUSUM过滤的事件样本，
+只在信息量足够时产生一个训练样本，缩小训练集规模
+"""
+from typing import TYPE_CHECKING, Callable, Dict, Optional
+
+import numpy as np
+import pandas as pd
+from numba import njit
+from src.data.bar_store import BAR_FIELDS
+
+# vnpy 只有实时生成器需要，离线重采样（resample.py）不依赖vnpy
+if TYPE_CHECKING:
+    from vnpy.trader.object import BarData, TickData
+
+
+@njit(cache=True)
+def _threshold_bar_kernel(values, threshold):
+    """
+    累计值达到阈值即收一根K线
+    :return: 每根事件K线最后一根原始K线的下标
+    """
+    n = values.shape[0]
+    ends = np.empty(n, dtype=np.int64)
+    count = 0
+    acc = 0.0
+    for i in range(n):
+        acc += values[i]
+        if acc >= threshold:
+            ends[count] = i
+            count += 1
+            acc = 0.0
+    return ends[:count]
+
+
+@njit(cache=True)
+def _cusum_kernel(close, threshold):
+    """
+    对称CUSUM过滤：对数收益的正/负累计偏离超过阈值时记录事件并重置
+    :return: 事件K线下标
+    """
+    n = close.shape[0]
+    events = np.empty(n, dtype=np.int64)
+    count = 0
+    s_pos = 0.0
+    s_neg = 0.0
+    for i in range(1, n):
+        r = np.log(close[i] / close[i - 1])
+        s_pos = max(0.0, s_pos + r)
+        s_neg = min(0.0, s_neg + r)
+        if s_neg < -threshold:
+            s_neg = 0.0
+            events[count] = i
+            count += 1
+        elif s_pos > threshold:
+            s_pos = 0.0
+            events[count] = i
+            count += 1
+    return events[:count]
+
+
+def volume_bar_indices(volume: np.ndarray, threshold: float) -> np.ndarray:
+    """成交量K线的结束下标"""
+    return _threshold_bar_kernel(np.ascontiguousarray(volume, dtype=np.float64), float(threshold))
+
+
+def dollar_bar_indices(close: np.ndarray, volume: np.ndarray, threshold: float, size: float = 1) -> np.ndarray:
+    """
+    成交额K线的结束下标
+    :param size: 合约乘数，成交额 = 价格 × 成交量 × 合约乘数
+    """
+    value = np.ascontiguousarray(close * volume * size, dtype=np.float64)
+    return _threshold_bar_kernel(value, float(threshold))
+
+
+def cusum_events(close: np.ndarray, threshold: float = None, k: float = 2.0) -> np.ndarray:
+    """
+    CUSUM事件下标
+    :param threshold: 对数收益累计阈值，默认取 k 倍的单根K线收益标准差
+    """
+    close = np.ascontiguousarray(close, dtype=np.float64)
+    if threshold is None:
+        threshold = k * np.std(np.diff(np.log(close)))
+    return _cusum_kernel(close, float(threshold))
+
+
+def reduce_segments(arrays: Dict[str, np.ndarray], ends: np.ndarray) -> Dict[str, np.ndarray]:
+    """
+    按结束下标把原始K线分段归约（一次遍历）：开盘取首根、收盘取末根、最高/最低取极值、成交量求和，
+    开盘持仓取首根的 open_oi、收盘持仓取末根的 close_oi
+    :param arrays: 列式K线数据（BarStore.load_arrays 的返回值）
+    :param ends: 每段最后一根K线的下标（递增）
+    :return: 列式数据，datetime 为每段首根K线的时间，另含 end_datetime 与 bar_count
+    """
+    ends = np.asarray(ends, dtype=np.int64)
+    if len(ends) == 0:
+        empty = {field: np.empty(0) for field in BAR_FIELDS if field in arrays}
+        empty.update(datetime=np.empty(0, dtype=np.int64), end_datetime=np.empty(0, dtype=np.int64),
+                     bar_count=np.empty(0, dtype=np.int64))
+        return empty
+
+    starts = np.concatenate(([0], ends[:-1] + 1))
+    # reduceat 的最后一段会一直归约到数组末尾，先截掉最后一段之后的K线
+    n = ends[-1] + 1
+
+    result = {
+        'datetime': arrays['datetime'][starts],
+        'end_datetime': arrays['datetime'][ends],
+        'open': arrays['open'][starts],
+        'high': np.maximum.reduceat(arrays['high'][:n], starts),
+        'low': np.minimum.reduceat(arrays['low'][:n], starts),
+        'close': arrays['close'][ends],
+        'volume': np.add.reduceat(arrays['volume'][:n], starts),
+    }
+    if 'open_oi' in arrays:
+        result['open_oi'] = arrays['open_oi'][starts]
+    if 'close_oi' in arrays:
+        result['close_oi'] = arrays['close_oi'][ends]
+    result['bar_count'] = ends - starts + 1
+    return result
+
+
+def aggregate_bars(arrays: Dict[str, np.ndarray], ends: np.ndarray, period: int = 60) -> pd.DataFrame:
+    """
+    按结束下标把原始K线分段聚合为事件K线
+    :param arrays: 列式K线数据（BarStore.load_arrays 的返回值）
+    :param ends: 每段最后一根K线的下标
+    :param period: 原始K线周期（秒）
+    :return: 标准格式DataFrame，额外包含 duration（秒）与 bar_count（原始K线数）两列
+    """
+    if len(ends) == 0:
+        return pd.DataFrame(columns=BAR_FIELDS + ['duration', 'bar_count'])
+
+    reduced = reduce_segments(arrays, ends)
+    data = {field: reduced[field] for field in BAR_FIELDS if field in reduced}
+
+    # 事件K线的时间跨度不固定，作为特征保留给训练代码
+    data['duration'] = (reduced['end_datetime'] - reduced['datetime']) / 1e9 + period
+    data['bar_count'] = reduced['bar_count']
+
+    df = pd.DataFrame(data)
+    df.index = pd.to_datetime(reduced['end_datetime'])
+    df.index.name = 'datetime'
+    return df
+
+
+def build_event_bars(arrays: Dict[str, np.ndarray], mode: str = 'volume', threshold: float = None,
+                     bars_per_sample: int = 5, size: float = 1) -> pd.DataFrame:
+    """
+    由1分钟K线构建事件K线
+    :param arrays: 列式K线数据
+    :param mode: 'volume' 成交量K线 / 'dollar' 成交额K线 / 'cusum' CUSUM事件采样
+    :param threshold: 阈值，默认按平均每 bars_per_sample 根原始K线产生一个样本自动确定
+    :param size: 合约乘数（成交额K线使用）
+    """
+    close = arrays['close']
+    volume = arrays['volume']
+
+    if mode == 'volume':
+        if threshold is None:
+            threshold = volume.sum() / max(len(volume) // bars_per_sample, 1)
+        ends = volume_bar_indices(volume, threshold)
+    elif mode == 'dollar':
+        if threshold is None:
+            threshold = (close * volume * size).sum() / max(len(volume) // bars_per_sample, 1)
+        ends = dollar_bar_indices(close, volume, threshold, size)
+    elif mode == 'cusum':
+        ends = cusum_events(close, threshold)
+    else:
+        raise ValueError(f"Unsupported sampling mode: {mode}")
+
+    return aggregate_bars(arrays, ends)
+
+
+class CusumFilter:
+    """实时CUSUM过滤器，每次更新价格返回是否产生事件"""
+
+    def __init__(self, threshold: float):
+        self.threshold = threshold
+        self.s_pos = 0.0
+        self.s_neg = 0.0
+        self.last_price = None
+
+    def update(self, price: float) -> bool:
+        if not self.last_price:
+            self.last_price = price
+            return False
+
+        r = np.log(price / self.last_price)
+        self.last_price = price
+        self.s_pos = max(0.0, self.s_pos + r)
+        self.s_neg = min(0.0, self.s_neg + r)
+
+        if self.s_neg < -self.threshold:
+            self.s_neg = 0.0
+            return True
+        if self.s_pos > self.threshold:
+            self.s_pos = 0.0
+            return True
+        return False
+
+
+class EventBarGenerator:
+    """
+    实时事件K线生成器，用法与 BarGenerator 类似
+    可同时接收tick（行情推送/tick记录回放）和1分钟K线，单次遍历生成成交量/成交额K线
+    """
+
+    def __init__(self, on_event_bar: Callable, mode: str = 'volume', threshold: float = 0, size: float = 1):
+        """
+        :param on_event_bar: 事件K线回调
+        :param mode: 'volume' / 'dollar' / 'cusum'
+        :param threshold: 成交量、成交额或CUSUM对数收益阈值
+        :param size: 合约乘数
+        """
+        if mode not in ('volume', 'dollar', 'cusum'):
+            raise ValueError(f"Unsupported sampling mode: {mode}")
+
+        self.on_event_bar = on_event_bar
+        self.mode = mode
+        self.threshold = threshold
+        self.size = size
+
+        self.bar: Optional['BarData'] = None
+        self.accumulated = 0.0
+        self.last_tick: Optional['TickData'] = None
+        self.cusum = CusumFilter(threshold) if mode == 'cusum' else None
+
+    def update_tick(self, tick: 'TickData'):
+        """更新tick，成交量取累计成交量的增量"""
+        if not tick.last_price:
+            return
+
+        volume = 0.0
+        if self.last_tick:
+            volume = max(tick.volume - self.last_tick.volume, 0)
+        self.last_tick = tick
+
+        self._update(tick.symbol, tick.exchange, tick.datetime, tick.gateway_name,
+                     tick.last_price, tick.last_price, tick.last_price, tick.last_price,
+                     volume, tick.open_interest)
+
+    def update_bar(self, bar: 'BarData'):
+        """更新1分钟K线"""
+        self._update(bar.symbol, bar.exchange, bar.datetime, bar.gateway_name,
+                     bar.open_price, bar.high_price, bar.low_price, bar.close_price,
+                     bar.volume, bar.open_interest)
+
+    def _update(self, symbol, exchange, dt, gateway_name, open_price, high_price,
+                low_price, close_price, volume, open_interest):
+        if not self.bar:
+            from vnpy.trader.object import BarData
+            self.bar = BarData(
+                symbol=symbol,
+                exchange=exchange,
+                datetime=dt,
+                gateway_name=gateway_name,
+                open_price=open_price,
+                high_price=high_price,
+                low_price=low_price
+            )
+        else:
+            self.bar.high_price = max(self.bar.high_price, high_price)
+            self.bar.low_price = min(self.bar.low_price, low_price)
+
+        self.bar.close_price = close_price
+        self.bar.volume += volume
+        self.bar.turnover += close_price * volume * self.size
+        self.bar.open_interest = open_interest
+
+        if self.mode == 'volume':
+            self.accumulated += volume
+            finished = self.accumulated >= self.threshold
+        elif self.mode == 'dollar':
+            self.accumulated += close_price * volume * self.size
+            finished = self.accumulated >= self.threshold
+        else:
+            finished = self.cusum.update(close_price)
+
+        if finished:
+            # 事件K线以最后一笔数据的时间为准，与批量构建的索引一致
+            self.bar.datetime = dt
+            self.on_event_bar(self.bar)
+            self.bar = None
+            self.accumulated = 0.0
@@ -1,6 +1,36 @@
+import importlib
 from abc import ABC, abstractmethod
 import numpy as np
 
+# 模型注册表：名称 -> BaseModel 子类，策略可按配置名创建模型
+MODEL_REGISTRY = {}
+
+# 内置模型所在模块，按名称找不到时再导入（各模块依赖较重，如 tensorflow）
+_BUILTIN_MODULES = {
+    'lstm_trend': 'src.models.lstm_model',
+    'distilled_student': 'src.models.distillation',
+    'ensemble': 'src.models.ensemble_model',
+    'rl_policy': 'src.models.rl_agent',
+}
+
+
+def register_model(name: str):
+    """注册 BaseModel 实现的类装饰器"""
+    def decorator(cls):
+        MODEL_REGISTRY[name] = cls
+        return cls
+    return decorator
+
+
+def create_model(name: str, **kwargs) -> "BaseModel":
+    """按注册名创建模型"""
+    if name not in MODEL_REGISTRY and name in _BUILTIN_MODULES:
+        importlib.import_module(_BUILTIN_MODULES[name])
+    if name not in MODEL_REGISTRY:
+        raise ValueError(f"Unsupported model: {name}")
+    return MODEL_REGISTRY[name](**kwargs)
+
+
 class BaseModel(ABC):
 
     @abstractmethod
@@ -0,0 +1,270 @@
+"""
+异步检查点模块
+训练线程只把权重、优化器状态复制到预分配的暂存缓冲区（内存拷贝，毫秒级），
+由后台线程写盘，不因文件写入阻塞训练；写盘时先写临时目录再原子重命名，中断时不会留下半个检查点。
+检查点包含轮次、学习率、回调状态、缩放器与数据迭代位置，可从中断处继续训练
+"""
+import os
+import pickle
+import shutil
+import threading
+from typing import Any, Dict, List, Optional
+
+import numpy as np
+
+
+_LATEST = 'latest'
+
+
+class _StagingBuffer:
+    """与权重/优化器变量同形状的预分配数组，重复使用"""
+
+    def __init__(self):
+        self.arrays: Dict[str, List[np.ndarray]] = {}
+        self.meta: Dict[str, Any] = {}
+        self.tag: Optional[str] = None
+
+    def copy_from(self, tag: str, arrays: Dict[str, List[np.ndarray]], meta: Dict[str, Any]):
+        for name, values in arrays.items():
+            buffers = self.arrays.get(name)
+            if buffers is None or len(buffers) != len(values) or any(
+                    b.shape != np.shape(v) or b.dtype != np.asarray(v).dtype for b, v in zip(buffers, values)):
+                buffers = [np.empty(np.shape(v), dtype=np.asarray(v).dtype) for v in values]
+                self.arrays[name] = buffers
+            for buffer, value in zip(buffers, values):
+                np.copyto(buffer, value)
+        # 元数据（缩放器、训练记录等）在训练线程中序列化，后台线程只负责写入
+        self.meta = pickle.dumps(meta, protocol=pickle.HIGHEST_PROTOCOL)
+        self.tag = tag
+
+
+class AsyncCheckpointer:
+    """
+    后台检查点写入器
+    双缓冲：一个缓冲区正在写盘时，新的快照写入另一个缓冲区；若该缓冲区的快照还没开始写，直接被更新的快照覆盖
+    """
+
+    def __init__(self, directory: str, keep: int = 3):
+        """
+        :param directory: 检查点目录，每个检查点一个子目录
+        :param keep: 保留最近的检查点个数
+        """
+        self.directory = directory
+        self.keep = keep
+        os.makedirs(directory, exist_ok=True)
+
+        self._buffers = [_StagingBuffer(), _StagingBuffer()]
+        self._pending: Optional[_StagingBuffer] = None
+        self._writing: Optional[_StagingBuffer] = None
+        self._condition = threading.Condition()
+        self._closed = False
+        self.written: List[str] = []
+        self.skipped = 0
+        self.error: Optional[BaseException] = None
+
+        self._thread = threading.Thread(target=self._run, name='checkpoint-writer', daemon=True)
+        self._thread.start()
+
+    # ===== 训练线程 =====
+    def save(self, tag: str, arrays: Dict[str, List[np.ndarray]], meta: Dict[str, Any]):
+        """
+        提交一个快照，只做内存拷贝后立即返回
+        :param tag: 检查点名称，如 'epoch-0045'
+        :param arrays: {'weights': [...], 'optimizer': [...]}
+        :param meta: 可pickle的元数据
+        """
+        if self.error is not None:
+            raise RuntimeError(f"checkpoint writer failed: {self.error!r}")
+        with self._condition:
+            # 有未开始写的快照时收回其缓冲区直接覆盖（计为跳过），否则用不在写盘的缓冲区
+            if self._pending is not None:
+                buffer, self._pending = self._pending, None
+                self.skipped += 1
+            else:
+                buffer = self._buffers[0] if self._buffers[0] is not self._writing else self._buffers[1]
+        buffer.copy_from(tag, arrays, meta)
+        with self._condition:
+            self._pending = buffer
+            self._condition.notify()
+
+    def flush(self):
+        """等待所有已提交的快照写完"""
+        with self._condition:
+            while self._pending is not None or self._writing is not None:
+                self._condition.wait()
+        if self.error is not None:
+            raise RuntimeError(f"checkpoint writer failed: {self.error!r}")
+
+    def close(self):
+        self.flush()
+        with self._condition:
+            self._closed = True
+            self._condition.notify()
+        self._thread.join()
+
+    # ===== 后台线程 =====
+    def _run(self):
+        while True:
+            with self._condition:
+                while self._pending is None and not self._closed:
+                    self._condition.wait()
+                if self._pending is None:
+                    return
+                buffer, self._pending = self._pending, None
+                self._writing = buffer
+            try:
+                self._write(buffer)
+            except BaseException as e:
+                self.error = e
+            with self._condition:
+                self._writing = None
+                self._condition.notify_all()
+
+    def _write(self, buffer: _StagingBuffer):
+        final = os.path.join(self.directory, buffer.tag)
+        tmp = final + '.tmp'
+        if os.path.exists(tmp):
+            shutil.rmtree(tmp)
+        os.makedirs(tmp)
+
+        flat = {f'{name}_{i}': array for name, values in buffer.arrays.items() for i, array in enumerate(values)}
+        np.savez(os.path.join(tmp, 'arrays.npz'), **flat)
+        with open(os.path.join(tmp, 'meta.pkl'), 'wb') as f:
+            f.write(buffer.meta)
+
+        if os.path.exists(final):
+            shutil.rmtree(final)
+        os.replace(tmp, final)
+        _write_atomic(os.path.join(self.directory, _LATEST), buffer.tag)
+        self.written.append(buffer.tag)
+        self._prune()
+
+    def _prune(self):
+        tags = list_checkpoints(self.directory)
+        for tag in tags[:-self.keep] if self.keep else []:
+            shutil.rmtree(os.path.join(self.directory, tag), ignore_errors=True)
+
+
+def _write_atomic(path: str, text: str):
+    tmp = path + '.tmp'
+    with open(tmp, 'w') as f:
+        f.write(text)
+    os.replace(tmp, path)
+
+
+def list_checkpoints(directory: str) -> List[str]:
+    """已完成的检查点（按名称排序，临时目录不计）"""
+    if not os.path.isdir(directory):
+        return []
+    return sorted(name for name in os.listdir(directory)
+                  if not name.endswith('.tmp') and os.path.isfile(os.path.join(directory, name, 'meta.pkl')))
+
+
+def load_checkpoint(directory: str, tag: str = None) -> Optional[Dict[str, Any]]:
+    """
+    读取检查点，默认读取最新的一个
+    :return: {'tag', 'arrays': {'weights': [...], ...}, 'meta': {...}}，没有检查点时返回None
+    """
+    if tag is None:
+        latest = os.path.join(directory, _LATEST)
+        if os.path.exists(latest):
+            with open(latest) as f:
+                tag = f.read().strip()
+        if not tag or not os.path.isdir(os.path.join(directory, tag)):
+            tags = list_checkpoints(directory)
+            if not tags:
+                return None
+            tag = tags[-1]
+
+    path = os.path.join(directory, tag)
+    with open(os.path.join(path, 'meta.pkl'), 'rb') as f:
+        meta = pickle.load(f)
+    arrays: Dict[str, List[np.ndarray]] = {}
+    with np.load(os.path.join(path, 'arrays.npz')) as data:
+        keys = sorted(data.files, key=lambda k: (k.rsplit('_', 1)[0], int(k.rsplit('_', 1)[1])))
+        for key in keys:
+            arrays.setdefault(key.rsplit('_', 1)[0], []).append(data[key])
+    return {'tag': tag, 'arrays': arrays, 'meta': meta}
+
+
+# ===== Keras =====
+def optimizer_variables(optimizer) -> list:
+    """兼容 Keras 2（variables()方法）与 Keras 3（variables属性）"""
+    variables = optimizer.variables
+    return list(variables() if callable(variables) else variables)
+
+
+def snapshot_model(model) -> Dict[str, List[np.ndarray]]:
+    return {
+        'weights': model.get_weights(),
+        'optimizer': [np.asarray(v.numpy()) for v in optimizer_variables(model.optimizer)],
+    }
+
+
+def restore_model(model, arrays: Dict[str, List[np.ndarray]]):
+    """恢复权重与优化器状态（优化器变量需先按模型变量创建）"""
+    model.set_weights(arrays['weights'])
+    optimizer = model.optimizer
+    if not optimizer_variables(optimizer) and hasattr(optimizer, 'build'):
+        optimizer.build(model.trainable_variables)
+    variables = optimizer_variables(optimizer)
+    if len(variables) != len(arrays.get('optimizer', [])):
+        print(f"优化器状态数量不一致（{len(variables)} / {len(arrays.get('optimizer', []))}），只恢复权重")
+        return
+    for variable, value in zip(variables, arrays['optimizer']):
+        variable.assign(value)
+
+
+def make_keras_callback(checkpointer: AsyncCheckpointer, extra_meta, every_n_epochs: int = 1,
+                        callbacks_to_save: Dict[str, Any] = None, resume: Dict[str, Any] = None):
+    """
+    创建Keras回调，每 every_n_epochs 轮提交一次快照
+    应放在回调列表末尾：EarlyStopping/ReduceLROnPlateau 在 on_train_begin 中会重置计数，恢复需在其后进行
+    :param extra_meta: 返回额外元数据（如缩放器）的函数
+    :param callbacks_to_save: {名称: 回调}，保存其 wait/best 等状态（EarlyStopping、ReduceLROnPlateau）
+    :param resume: load_checkpoint 的结果，训练开始时恢复回调状态
+    """
+    from tensorflow.keras.callbacks import Callback
+
+    callbacks_to_save = callbacks_to_save or {}
+
+    class AsyncCheckpointCallback(Callback):
+        def on_train_begin(self, logs=None):
+            if resume is None:
+                return
+            for name, callback in callbacks_to_save.items():
+                restore_callback_state(callback, resume['meta'].get('callbacks', {}).get(name, {}))
+                if f'{name}.best_weights' in resume['arrays']:
+                    callback.best_weights = resume['arrays'][f'{name}.best_weights']
+
+        def on_epoch_end(self, epoch, logs=None):
+            if (epoch + 1) % every_n_epochs:
+                return
+            arrays = snapshot_model(self.model)
+            for name, callback in callbacks_to_save.items():
+                if getattr(callback, 'best_weights', None) is not None:
+                    arrays[f'{name}.best_weights'] = callback.best_weights
+            meta = dict(extra_meta())
+            meta['epoch'] = epoch
+            meta['learning_rate'] = float(np.asarray(self.model.optimizer.learning_rate.numpy()))
+            meta['logs'] = dict(logs or {})
+            meta['callbacks'] = {name: callback_state(cb) for name, cb in callbacks_to_save.items()}
+            checkpointer.save(f'epoch-{epoch + 1:04d}', arrays, meta)
+
+        def on_train_end(self, logs=None):
+            checkpointer.flush()
+
+    return AsyncCheckpointCallback()
+
+
+_CALLBACK_FIELDS = ('wait', 'best', 'cooldown_counter', 'stopped_epoch', 'best_epoch')
+
+
+def callback_state(callback) -> Dict[str, Any]:
+    """EarlyStopping/ReduceLROnPlateau 的计数状态（best_weights 作为数组单独保存）"""
+    return {field: getattr(callback, field) for field in _CALLBACK_FIELDS if hasattr(callback, field)}
+
+
+def restore_callback_state(callback, state: Dict[str, Any]):
+    for field, value in state.items():
+        setattr(callback, field, value)
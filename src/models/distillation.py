@@ -0,0 +1,274 @@
+"""
+模型蒸馏模块
+用历史数据上LSTM教师模型的预测作为目标，训练小型学生模型（摘要特征上的小MLP，或流式指标上的线性模型），
+学生模型实现 BaseModel 接口，可在tick级路径上替代教师模型
+"""
+import time
+from typing import Dict, Optional, Tuple
+
+import joblib
+import numpy as np
+import pandas as pd
+from sklearn.linear_model import Ridge
+from sklearn.metrics import mean_absolute_error, r2_score
+from sklearn.neural_network import MLPRegressor
+
+from src.models.base_model import BaseModel, register_model
+
+
+SUMMARY_LAGS = (1, 2, 5, 10, 20, 30)
+SUMMARY_MA_WINDOWS = (5, 10, 20)
+
+
+def summary_features(close_windows: np.ndarray) -> np.ndarray:
+    """
+    收盘价窗口的摘要特征（MLP学生使用）
+    :param close_windows: shape (N, timesteps)
+    :return: shape (N, n_features)
+    """
+    close_windows = np.atleast_2d(np.asarray(close_windows, dtype=np.float64))
+    last = close_windows[:, -1:]
+    timesteps = close_windows.shape[1]
+    columns = []
+
+    # 多周期收益率
+    for lag in SUMMARY_LAGS:
+        if lag < timesteps:
+            columns.append(last[:, 0] / close_windows[:, -1 - lag] - 1)
+
+    # 相对均线偏离
+    for window in SUMMARY_MA_WINDOWS:
+        if window <= timesteps:
+            columns.append(last[:, 0] / close_windows[:, -window:].mean(axis=1) - 1)
+
+    # 收益波动率与区间位置
+    returns = np.diff(close_windows, axis=1) / close_windows[:, :-1]
+    columns.append(returns.std(axis=1))
+    high = close_windows.max(axis=1)
+    low = close_windows.min(axis=1)
+    columns.append(np.where(high > low, (last[:, 0] - low) / np.where(high > low, high - low, 1), 0.5))
+
+    # 线性回归斜率（按最新价归一）
+    t = np.arange(timesteps) - (timesteps - 1) / 2
+    columns.append((close_windows @ t) / (t @ t) / last[:, 0])
+
+    return np.column_stack(columns)
+
+
+def _ema_weights(timesteps: int, window: int) -> np.ndarray:
+    """以窗口首值为种子的EMA在窗口末端的等效线性权重，EMA即一次点积"""
+    alpha = 2.0 / (window + 1)
+    weights = alpha * (1 - alpha) ** np.arange(timesteps - 1, -1, -1, dtype=np.float64)
+    weights[0] = (1 - alpha) ** (timesteps - 1)
+    return weights
+
+
+def indicator_features(close_windows: np.ndarray, fast_window: int = 5, slow_window: int = 20) -> np.ndarray:
+    """
+    流式指标特征（线性学生使用），均可逐根K线O(1)更新：EMA偏离、EMA价差、短周期收益
+    :param close_windows: shape (N, timesteps)
+    """
+    close_windows = np.atleast_2d(np.asarray(close_windows, dtype=np.float64))
+    timesteps = close_windows.shape[1]
+    ema_fast = close_windows @ _ema_weights(timesteps, fast_window)
+    ema_slow = close_windows @ _ema_weights(timesteps, slow_window)
+
+    last = close_windows[:, -1]
+    return np.column_stack([
+        last / ema_fast - 1,
+        last / ema_slow - 1,
+        ema_fast / ema_slow - 1,
+        last / close_windows[:, -2] - 1,
+        last / close_windows[:, -6] - 1,
+    ])
+
+
+FEATURE_SETS = {
+    'mlp': summary_features,
+    'linear': indicator_features,
+}
+
+
+@register_model('distilled_student')
+class DistilledStudentModel(BaseModel):
+    """
+    蒸馏得到的学生模型
+    输入最近一段收盘价，输出教师模型预测收益映射到 [-1, 1] 的信号
+    推理只用numpy完成，不依赖sklearn/tensorflow
+    """
+
+    def __init__(self, student_type: str = 'mlp', model_path: str = None):
+        """
+        :param student_type: 'mlp' 或 'linear'
+        :param model_path: 已保存的学生模型路径
+        """
+        self.student_type = student_type
+        self.feature_mean = None
+        self.feature_std = None
+        self.weights = []  # [(kernel, bias), ...]，除最后一层外使用ReLU
+        self.signal_scale = 1.0  # 该收益对应满信号 ±1
+        self.sequence_length = None
+
+        if model_path:
+            self.load(model_path)
+
+    def fit(self, close_windows: np.ndarray, teacher_returns: np.ndarray, hidden_layer_sizes=(32, 16),
+            alpha: float = 1e-4, random_state: int = 42):
+        """
+        拟合教师模型的预测收益
+        :param close_windows: shape (N, timesteps)
+        :param teacher_returns: 教师预测价相对窗口最后收盘价的收益，shape (N,)
+        """
+        features = FEATURE_SETS[self.student_type](close_windows)
+        self.sequence_length = close_windows.shape[1]
+        self.feature_mean = features.mean(axis=0)
+        self.feature_std = features.std(axis=0) + 1e-12
+        scaled = (features - self.feature_mean) / self.feature_std
+
+        # 用教师收益的99分位作为满信号幅度，学生直接拟合归一化后的信号
+        self.signal_scale = float(np.percentile(np.abs(teacher_returns), 99)) or 1.0
+        target = teacher_returns / self.signal_scale
+
+        if self.student_type == 'mlp':
+            regressor = MLPRegressor(hidden_layer_sizes=hidden_layer_sizes, alpha=alpha,
+                                     max_iter=500, early_stopping=True, random_state=random_state)
+            regressor.fit(scaled, target)
+            self.weights = list(zip(regressor.coefs_, regressor.intercepts_))
+        elif self.student_type == 'linear':
+            regressor = Ridge(alpha=alpha)
+            regressor.fit(scaled, target)
+            self.weights = [(regressor.coef_.reshape(-1, 1), np.array([regressor.intercept_]))]
+        else:
+            raise ValueError(f"Unsupported student type: {self.student_type}")
+
+        return self
+
+    def _forward(self, close_windows: np.ndarray) -> np.ndarray:
+        features = FEATURE_SETS[self.student_type](close_windows)
+        h = (features - self.feature_mean) / self.feature_std
+        for i, (kernel, bias) in enumerate(self.weights):
+            h = h @ kernel + bias
+            if i < len(self.weights) - 1:
+                h = np.maximum(h, 0.0)
+        return h[:, 0]
+
+    def predict_returns(self, close_windows: np.ndarray) -> np.ndarray:
+        """批量预测收益，shape (N,)"""
+        return self._forward(close_windows) * self.signal_scale
+
+    def predict(self, features: np.ndarray) -> float:
+        """
+        features: 最近的收盘价窗口，shape (timesteps,) / (1, timesteps) / (1, timesteps, 1)
+        多特征窗口（如 (1, T, F)）展平后列顺序错乱，直接报错
+        """
+        features = np.asarray(features, dtype=np.float64)
+        if features.ndim > 3 or (features.ndim > 1 and features.shape[0] != 1) \
+                or (features.ndim == 3 and features.shape[2] != 1):
+            raise ValueError(f"Unsupported feature shape for distilled student: {features.shape}, "
+                             f"expected a close window (timesteps,) / (1, timesteps) / (1, timesteps, 1)")
+        close_window = features.reshape(1, -1)
+        if self.sequence_length:
+            if close_window.shape[1] < self.sequence_length:
+                raise ValueError(f"Close window too short: {close_window.shape[1]} < {self.sequence_length}")
+            close_window = close_window[:, -self.sequence_length:]
+        return float(np.clip(self._forward(close_window)[0], -1.0, 1.0))
+
+    def save(self, filepath: str):
+        """保存学生模型"""
+        joblib.dump({
+            'student_type': self.student_type,
+            'feature_mean': self.feature_mean,
+            'feature_std': self.feature_std,
+            'weights': self.weights,
+            'signal_scale': self.signal_scale,
+            'sequence_length': self.sequence_length
+        }, filepath)
+
+    def load(self, filepath: str):
+        """加载学生模型"""
+        state = joblib.load(filepath)
+        self.student_type = state['student_type']
+        self.feature_mean = state['feature_mean']
+        self.feature_std = state['feature_std']
+        self.weights = state['weights']
+        self.signal_scale = state['signal_scale']
+        self.sequence_length = state['sequence_length']
+
+
+class DistillationPipeline:
+    """
+    蒸馏流程：教师模型在历史数据上打标 -> 训练学生模型 -> 对比保真度与延迟
+    """
+
+    def __init__(self, teacher):
+        """
+        :param teacher: 已加载的 PricePredictionModel（如 models/SHFE_rb_SHFE.rb2602_prediction_model.h5）
+        """
+        self.teacher = teacher
+
+    def build_dataset(self, df: pd.DataFrame, prediction_horizon: int = 30) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
+        """
+        用教师模型为历史数据打标
+        :param df: 标准格式K线数据（open/high/low/close/volume）
+        :return: (教师输入窗口X, 收盘价窗口, 教师预测收益)
+        """
+        close = df['close'].values.astype(np.float64)
+        X, _ = self.teacher.prepare_data_for_30min_prediction(df.copy(), prediction_horizon=prediction_horizon)
+
+        seq = self.teacher.sequence_length
+        # 与 prepare_data_for_30min_prediction 的窗口一一对应：第k个窗口为 [k, k + seq)
+        close_windows = np.lib.stride_tricks.sliding_window_view(close, seq)[:len(X)]
+
+        teacher_prices = self.teacher.predict(X)
+        teacher_returns = teacher_prices / close_windows[:, -1] - 1
+        return X, close_windows, teacher_returns
+
+    def distill(self, df: pd.DataFrame, student_type: str = 'mlp', test_ratio: float = 0.2,
+                latency_samples: int = 200) -> Tuple[DistilledStudentModel, Dict]:
+        """
+        训练学生模型并输出保真度和延迟对比报告
+        :return: (学生模型, 报告)
+        """
+        X, close_windows, teacher_returns = self.build_dataset(df)
+
+        # 按时间顺序切分，避免未来数据泄漏
+        split_idx = int(len(X) * (1 - test_ratio))
+        student = DistilledStudentModel(student_type=student_type)
+        student.fit(close_windows[:split_idx], teacher_returns[:split_idx])
+
+        test_teacher = teacher_returns[split_idx:]
+        test_student = student.predict_returns(close_windows[split_idx:])
+
+        report = {
+            'student_type': student_type,
+            'train_size': split_idx,
+            'test_size': len(test_teacher),
+            'fidelity_r2': float(r2_score(test_teacher, test_student)),
+            'fidelity_mae': float(mean_absolute_error(test_teacher, test_student)),
+            'fidelity_corr': float(np.corrcoef(test_teacher, test_student)[0, 1]),
+            'sign_agreement': float(np.mean(np.sign(test_teacher) == np.sign(test_student))),
+            'teacher_latency_us': self.measure_latency(lambda i: self.teacher.model(X[i:i + 1], training=False),
+                                                       len(X), latency_samples),
+            'student_latency_us': self.measure_latency(lambda i: student.predict(close_windows[i]),
+                                                       len(X), latency_samples),
+        }
+        report['speedup'] = report['teacher_latency_us'] / max(report['student_latency_us'], 1e-9)
+
+        print(f"蒸馏结果({student_type}): R²={report['fidelity_r2']:.4f}, "
+              f"方向一致率={report['sign_agreement']:.2%}, "
+              f"教师延迟={report['teacher_latency_us']:.1f}us, 学生延迟={report['student_latency_us']:.1f}us, "
+              f"加速{report['speedup']:.0f}倍")
+
+        return student, report
+
+    @staticmethod
+    def measure_latency(func, n: int, samples: int) -> float:
+        """单样本推理延迟中位数（微秒）"""
+        indices = np.linspace(0, n - 1, min(samples, n)).astype(int)
+        func(indices[0])  # 预热
+        timings = []
+        for i in indices:
+            start = time.perf_counter()
+            func(i)
+            timings.append(time.perf_counter() - start)
+        return float(np.median(timings) * 1e6)
@@ -0,0 +1,411 @@
+"""
+数据并行训练模块
+在一台或多台机器上启动 N 个训练进程，每个进程只在自己的数据分片上计算梯度，
+梯度经 allreduce 求平均后各进程用相同的梯度更新，参数始终保持一致：
+- 单机：训练数据放在共享内存中各进程直接读取；梯度通过共享内存分块归约（reduce-scatter + allgather，
+  每个进程只负责 1/N 的向量，通信量与环形allreduce相同）
+- 多机：各进程通过TCP组成环，执行环形allreduce（N-1 步 reduce-scatter + N-1 步 allgather）
+全局批大小为 batch_size × N，学习率按线性规则放大 N 倍，并在前几轮线性预热
+"""
+import multiprocessing as mp
+import queue as queue_lib
+import socket
+import threading
+import time
+from multiprocessing import shared_memory
+from typing import Callable, Dict, List, Optional, Sequence, Tuple
+
+import numpy as np
+
+
+# ===== 共享内存数据 =====
+class SharedArrays:
+    """
+    把一组numpy数组放入共享内存，子进程按 spec 挂载，不复制数据
+    """
+
+    def __init__(self, spec: Dict[str, tuple], blocks: Dict[str, shared_memory.SharedMemory], owner: bool):
+        self.spec = spec
+        self.blocks = blocks
+        self.owner = owner
+        self.arrays = {name: np.ndarray(shape, dtype=dtype, buffer=blocks[name].buf)
+                       for name, (_, shape, dtype) in spec.items()}
+
+    @classmethod
+    def create(cls, arrays: Dict[str, np.ndarray]) -> "SharedArrays":
+        spec, blocks = {}, {}
+        for name, array in arrays.items():
+            array = np.ascontiguousarray(array)
+            block = shared_memory.SharedMemory(create=True, size=max(array.nbytes, 1))
+            np.ndarray(array.shape, dtype=array.dtype, buffer=block.buf)[...] = array
+            spec[name] = (block.name, array.shape, array.dtype.str)
+            blocks[name] = block
+        return cls(spec, blocks, owner=True)
+
+    @classmethod
+    def attach(cls, spec: Dict[str, tuple]) -> "SharedArrays":
+        blocks = {name: shared_memory.SharedMemory(name=block_name) for name, (block_name, _, _) in spec.items()}
+        return cls(spec, blocks, owner=False)
+
+    def __getitem__(self, name: str) -> np.ndarray:
+        return self.arrays[name]
+
+    def close(self):
+        self.arrays = {}
+        for block in self.blocks.values():
+            block.close()
+            if self.owner:
+                block.unlink()
+
+
+# ===== allreduce =====
+class SharedMemoryAllreduce:
+    """
+    单机共享内存allreduce：各进程写入自己的梯度行，按块归约后写入结果区，再各自读取
+    """
+
+    def __init__(self, rank: int, world_size: int, spec: Dict[str, tuple], barrier):
+        self.rank = rank
+        self.world_size = world_size
+        self.shared = SharedArrays.attach(spec)
+        self.grads = self.shared['grads']       # (world_size, size)
+        self.result = self.shared['result']     # (size,)
+        self.barrier = barrier
+        size = self.result.shape[0]
+        bounds = np.linspace(0, size, world_size + 1).astype(np.int64)
+        self.lo, self.hi = bounds[rank], bounds[rank + 1]
+
+    @staticmethod
+    def create(world_size: int, size: int) -> SharedArrays:
+        """在主进程中分配通信缓冲区"""
+        return SharedArrays.create({
+            'grads': np.zeros((world_size, size)),
+            'result': np.zeros(size),
+        })
+
+    def allreduce(self, vector: np.ndarray, average: bool = True) -> np.ndarray:
+        """
+        :param average: True 返回全部进程向量的平均值，False 返回总和
+        """
+        self.grads[self.rank] = vector
+        self.barrier.wait()
+        total = self.grads[:, self.lo:self.hi].sum(axis=0)
+        self.result[self.lo:self.hi] = total / self.world_size if average else total
+        self.barrier.wait()
+        # 下一次调用写结果区之前必须经过第一个屏障，此时所有进程都已读取完本次结果
+        return self.result.copy()
+
+    def close(self):
+        self.shared.close()
+
+
+class TcpRingAllreduce:
+    """
+    多机环形allreduce：rank 向 rank+1 发送、从 rank-1 接收
+    向量分成 N 块，reduce-scatter 后每个进程持有一块的总和，allgather 后每个进程得到完整结果
+    """
+
+    def __init__(self, rank: int, addresses: Sequence[Tuple[str, int]], timeout: float = 60):
+        """
+        :param addresses: 每个rank监听的 (host, port)，所有进程传入相同的列表
+        """
+        self.rank = rank
+        self.world_size = len(addresses)
+        host, port = addresses[rank]
+
+        server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        server.bind(('', port))
+        server.listen(1)
+
+        # 先连下一个rank，再接受上一个rank的连接；下一个rank可能还没启动，重试直到超时
+        next_host, next_port = addresses[(rank + 1) % self.world_size]
+        deadline = time.time() + timeout
+        while True:
+            try:
+                self.send_sock = socket.create_connection((next_host, next_port), timeout=timeout)
+                break
+            except OSError:
+                if time.time() > deadline:
+                    raise
+                time.sleep(0.1)
+        server.settimeout(timeout)
+        self.recv_sock, _ = server.accept()
+        server.close()
+        for sock in (self.send_sock, self.recv_sock):
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            sock.settimeout(None)
+
+    def _exchange(self, send: np.ndarray, recv_size: int) -> np.ndarray:
+        """发送与接收同时进行，避免环上所有进程都阻塞在发送"""
+        sender = threading.Thread(target=self.send_sock.sendall, args=(np.ascontiguousarray(send).tobytes(),))
+        sender.start()
+        buffer = bytearray(recv_size * 8)
+        view = memoryview(buffer)
+        received = 0
+        while received < len(buffer):
+            n = self.recv_sock.recv_into(view[received:])
+            if n == 0:
+                raise ConnectionError("ring peer closed")
+            received += n
+        sender.join()
+        return np.frombuffer(buffer, dtype=np.float64)
+
+    def allreduce(self, vector: np.ndarray, average: bool = True) -> np.ndarray:
+        n = self.world_size
+        if n == 1:
+            return np.array(vector, dtype=np.float64)
+        data = np.array(vector, dtype=np.float64)
+        bounds = np.linspace(0, data.shape[0], n + 1).astype(np.int64)
+        chunk = lambda k: slice(bounds[k % n], bounds[k % n + 1])
+
+        # reduce-scatter：第 s 步发送第 rank-s 块，接收并累加第 rank-s-1 块
+        for step in range(n - 1):
+            send_k, recv_k = self.rank - step, self.rank - step - 1
+            recv = self._exchange(data[chunk(send_k)], bounds[recv_k % n + 1] - bounds[recv_k % n])
+            data[chunk(recv_k)] += recv
+        # allgather：第 s 步发送第 rank-s+1 块（已完整），接收并覆盖第 rank-s 块
+        for step in range(n - 1):
+            send_k, recv_k = self.rank - step + 1, self.rank - step
+            recv = self._exchange(data[chunk(send_k)], bounds[recv_k % n + 1] - bounds[recv_k % n])
+            data[chunk(recv_k)] = recv
+        return data / n if average else data
+
+    def close(self):
+        self.send_sock.close()
+        self.recv_sock.close()
+
+
+def broadcast(comm, vector: np.ndarray, root: int = 0) -> np.ndarray:
+    """用allreduce求和实现广播：非root进程贡献0，结果与root的值逐位相同"""
+    contribution = vector if comm.rank == root else np.zeros_like(vector)
+    return comm.allreduce(contribution, average=False)
+
+
+# ===== 训练循环 =====
+def scaled_learning_rate(base_lr: float, world_size: int, epoch: int, warmup_epochs: int) -> float:
+    """线性放大规则：lr = base_lr × N，前 warmup_epochs 轮从 base_lr 线性升到目标值"""
+    target = base_lr * world_size
+    if warmup_epochs <= 0 or epoch >= warmup_epochs:
+        return target
+    return base_lr + (target - base_lr) * (epoch + 1) / warmup_epochs
+
+
+def shard_indices(n_samples: int, rank: int, world_size: int, epoch: int, seed: int = 0) -> np.ndarray:
+    """
+    每轮全局打乱后按rank取等长分片（各进程步数相同，allreduce不会错位）
+    """
+    order = np.random.default_rng(seed + epoch).permutation(n_samples)
+    per_rank = n_samples // world_size
+    return order[rank * per_rank:(rank + 1) * per_rank]
+
+
+class _Flattener:
+    """梯度/权重列表与一维向量互转"""
+
+    def __init__(self, arrays: List[np.ndarray]):
+        self.shapes = [a.shape for a in arrays]
+        self.sizes = [int(np.prod(s)) for s in self.shapes]
+        self.offsets = np.concatenate(([0], np.cumsum(self.sizes))).astype(np.int64)
+
+    @property
+    def size(self) -> int:
+        return int(self.offsets[-1])
+
+    def flatten(self, arrays) -> np.ndarray:
+        return np.concatenate([np.asarray(a, dtype=np.float64).ravel() for a in arrays]) if arrays else np.zeros(0)
+
+    def unflatten(self, vector: np.ndarray) -> List[np.ndarray]:
+        return [vector[self.offsets[i]:self.offsets[i + 1]].reshape(shape)
+                for i, shape in enumerate(self.shapes)]
+
+
+def keras_worker(rank: int, world_size: int, comm, X: np.ndarray, y: np.ndarray, config: dict) -> dict:
+    """
+    单个训练进程：在数据分片上计算梯度，allreduce后更新
+    :param config: model_type、sequence_length、n_features、epochs、batch_size、learning_rate、
+                   warmup_epochs、validation_split、patience、threads_per_worker、seed
+    :return: rank 0 返回最终权重与训练记录，其余进程返回计时
+    """
+    import tensorflow as tf
+    from src.models.ml_model import PricePredictionModel
+
+    threads = config.get('threads_per_worker', 1)
+    tf.config.threading.set_intra_op_parallelism_threads(threads)
+    tf.config.threading.set_inter_op_parallelism_threads(1)
+
+    wrapper = PricePredictionModel(config['model_type'], config['sequence_length'], config['n_features'])
+    wrapper.build_model()
+    model = wrapper.model
+    loss_fn = tf.keras.losses.MeanSquaredError()
+    optimizer = tf.keras.optimizers.Adam(learning_rate=config['learning_rate'])
+
+    # 以rank 0的初始权重为准
+    weights = _Flattener(model.get_weights())
+    model.set_weights(weights.unflatten(broadcast(comm, weights.flatten(model.get_weights()))))
+    grads_layout = _Flattener([v.numpy() for v in model.trainable_variables])
+
+    n_val = int(len(X) * config.get('validation_split', 0.2))
+    n_train = len(X) - n_val
+    X_val, y_val = X[n_train:], y[n_train:]
+
+    @tf.function
+    def compute_gradients(xb, yb):
+        with tf.GradientTape() as tape:
+            loss = loss_fn(yb, model(xb, training=True))
+        return loss, tape.gradient(loss, model.trainable_variables)
+
+    batch_size = config['batch_size']
+    history = {'loss': [], 'val_loss': [], 'lr': []}
+    timing = {'compute': 0.0, 'comm': 0.0, 'samples': 0}
+    best_loss, best_weights, wait = np.inf, None, 0
+
+    for epoch in range(config['epochs']):
+        lr = scaled_learning_rate(config['learning_rate'], world_size, epoch, config.get('warmup_epochs', 2))
+        optimizer.learning_rate.assign(lr)
+        indices = shard_indices(n_train, rank, world_size, epoch, config.get('seed', 0))
+
+        losses = []
+        for start in range(0, len(indices) - batch_size + 1, batch_size):
+            batch = np.sort(indices[start:start + batch_size])
+            t0 = time.perf_counter()
+            loss, grads = compute_gradients(X[batch], y[batch])
+            flat = grads_layout.flatten([g.numpy() for g in grads])
+            t1 = time.perf_counter()
+            averaged = comm.allreduce(flat)
+            t2 = time.perf_counter()
+            optimizer.apply_gradients(zip([tf.convert_to_tensor(g, dtype=v.dtype) for g, v in
+                                           zip(grads_layout.unflatten(averaged), model.trainable_variables)],
+                                          model.trainable_variables))
+            timing['compute'] += t1 - t0 + time.perf_counter() - t2
+            timing['comm'] += t2 - t1
+            timing['samples'] += len(batch)
+            losses.append(float(loss))
+
+        loss = float(comm.allreduce(np.array([np.mean(losses) if losses else 0.0]))[0])
+        val_loss = float(loss_fn(y_val, model(X_val, training=False))) if n_val else loss
+        history['loss'].append(loss)
+        history['val_loss'].append(val_loss)
+        history['lr'].append(lr)
+        if rank == 0:
+            print(f"Epoch {epoch + 1}/{config['epochs']} - loss: {loss:.6f} - val_loss: {val_loss:.6f} - lr: {lr:.6f}")
+
+        if val_loss < best_loss:
+            best_loss, best_weights, wait = val_loss, model.get_weights(), 0
+        else:
+            wait += 1
+        # 早停以rank 0的判断为准，所有进程同时退出，避免其余进程阻塞在allreduce上
+        stop = 1.0 if wait >= config.get('patience', 15) else 0.0
+        if broadcast(comm, np.array([stop]))[0] > 0.5:
+            break
+
+    result = {'rank': rank, 'timing': timing}
+    if rank == 0:
+        result['weights'] = best_weights if best_weights is not None else model.get_weights()
+        result['history'] = history
+    return result
+
+
+def _process_entry(worker: Callable, rank: int, world_size: int, data_spec: dict, comm_spec: dict,
+                   barrier, config: dict, queue):
+    data = SharedArrays.attach(data_spec)
+    comm = SharedMemoryAllreduce(rank, world_size, comm_spec, barrier)
+    try:
+        result = worker(rank, world_size, comm, data['X'], data['y'], config)
+        queue.put(result)
+    except Exception as e:
+        # 中止屏障：其他进程在 barrier.wait() 上抛出 BrokenBarrierError 退出，而不是永久等待
+        barrier.abort()
+        queue.put({'rank': rank, 'error': repr(e)})
+        raise
+    finally:
+        comm.close()
+        data.close()
+
+
+def run_data_parallel(worker: Callable, X: np.ndarray, y: np.ndarray, n_workers: int, gradient_size: int,
+                      config: dict) -> List[dict]:
+    """
+    单机启动 n_workers 个训练进程
+    :param worker: 进程内的训练函数 worker(rank, world_size, comm, X, y, config)，需为模块级函数
+    :param gradient_size: 梯度向量长度（可训练参数个数）
+    :return: 按rank排序的各进程返回值
+    """
+    ctx = mp.get_context('spawn')
+    data = SharedArrays.create({'X': X, 'y': y})
+    comm_buffers = SharedMemoryAllreduce.create(n_workers, gradient_size)
+    barrier = ctx.Barrier(n_workers)
+    queue = ctx.Queue()
+
+    processes = [ctx.Process(target=_process_entry,
+                             args=(worker, rank, n_workers, data.spec, comm_buffers.spec, barrier, config, queue))
+                 for rank in range(n_workers)]
+    try:
+        for p in processes:
+            p.start()
+        results = []
+        while len(results) < len(processes):
+            try:
+                results.append(queue.get(timeout=5))
+            except queue_lib.Empty:
+                # 进程异常退出（如被系统杀死）时来不及报告错误，中止屏障让其余进程退出
+                dead = [p for p in processes if p.exitcode not in (None, 0)]
+                if dead:
+                    barrier.abort()
+                    _raise_worker_error(results)
+                    raise RuntimeError(f"worker process exited with code {dead[0].exitcode}")
+        for p in processes:
+            p.join()
+    finally:
+        for p in processes:
+            if p.is_alive():
+                p.terminate()
+        data.close()
+        comm_buffers.close()
+
+    _raise_worker_error(results)
+    return sorted(results, key=lambda r: r['rank'])
+
+
+def _raise_worker_error(results: List[dict]):
+    """报告最初出错的进程；其余进程因屏障中止报出的 BrokenBarrierError 排在后面"""
+    errors = sorted((r for r in results if 'error' in r), key=lambda r: 'BrokenBarrierError' in r['error'])
+    if errors:
+        raise RuntimeError(f"worker {errors[0]['rank']} failed: {errors[0]['error']}")
+
+
+def run_tcp_worker(rank: int, addresses: Sequence[Tuple[str, int]], X: np.ndarray, y: np.ndarray, config: dict,
+                   worker: Callable = keras_worker) -> dict:
+    """
+    多机训练：在每台机器上为其负责的每个rank调用一次，所有调用传入相同的 addresses 与数据
+    """
+    comm = TcpRingAllreduce(rank, addresses)
+    try:
+        return worker(rank, len(addresses), comm, X, y, config)
+    finally:
+        comm.close()
+
+
+def scaling_report(results: List[dict], wall_time: float, baseline_throughput: float = None) -> dict:
+    """
+    扩展效率
+    - comm_fraction：通信时间占比
+    - parallel_efficiency：提供单进程吞吐量时为 N 进程吞吐量 / (N × 单进程吞吐量)，
+      否则用 计算时间 / (计算 + 通信) 估计
+    """
+    n = len(results)
+    compute = np.mean([r['timing']['compute'] for r in results])
+    comm = np.mean([r['timing']['comm'] for r in results])
+    samples = sum(r['timing']['samples'] for r in results)
+    throughput = samples / wall_time if wall_time > 0 else np.nan
+
+    if baseline_throughput:
+        efficiency = throughput / (n * baseline_throughput)
+    else:
+        efficiency = compute / (compute + comm) if compute + comm > 0 else np.nan
+    return {
+        'workers': n,
+        'samples_per_sec': throughput,
+        'comm_fraction': comm / (compute + comm) if compute + comm > 0 else np.nan,
+        'parallel_efficiency': efficiency,
+    }
@@ -0,0 +1,279 @@
+"""
+集成模型模块
+同一合约的多个模型（LSTM、GRU、CNN-LSTM、树模型等）共享一次特征计算，
+在线程池中并发推理（TensorFlow/sklearn的计算内核执行时释放GIL），
+按学习到的权重合成信号，并对每次推理施加延迟上限，超时的成员本次不参与合成
+"""
+import time
+from concurrent.futures import Future, ThreadPoolExecutor, wait
+from typing import Dict, List, Optional
+
+import numpy as np
+import pandas as pd
+from scipy.optimize import nnls
+
+from src.models.base_model import BaseModel, register_model
+
+
+FEATURE_COLUMNS = ['open', 'high', 'low', 'close', 'volume']
+
+
+def compute_feature_matrix(df: pd.DataFrame, indicator_model) -> np.ndarray:
+    """
+    计算未标准化的特征矩阵（基础行情列 + 技术指标），列顺序与 prepare_data_for_30min_prediction 一致
+    :param indicator_model: 提供 add_technical_indicators 的 PricePredictionModel
+    """
+    df = indicator_model.add_technical_indicators(df.copy())
+    all_feature_cols = FEATURE_COLUMNS + [col for col in df.columns if col not in FEATURE_COLUMNS and col not in ['datetime']]
+    return df[all_feature_cols].values.astype(np.float64)
+
+
+class PricePredictionMember(BaseModel):
+    """
+    把 PricePredictionModel（输出价格）包装为集成成员（输出信号）
+    输入为共享的未标准化特征窗口，各成员用自己的scaler标准化
+    """
+
+    def __init__(self, model, signal_scale: float = 0.002):
+        """
+        :param model: 已加载的 PricePredictionModel
+        :param signal_scale: 该预测收益对应满信号 ±1
+        """
+        self.model = model
+        self.signal_scale = signal_scale
+        self.sequence_length = model.sequence_length
+
+    def predict(self, features: np.ndarray) -> float:
+        window = features[-self.sequence_length:]
+        scaled = self.model.scaler.transform(window)[np.newaxis, :, :]
+        # 直接调用Keras模型而非 model.predict，避免单样本推理时的数据管道开销
+        output = np.asarray(self.model.model(scaled, training=False)).reshape(-1, 1)
+        price = self.model.target_scaler.inverse_transform(output)[0, 0]
+        expected_return = price / window[-1, FEATURE_COLUMNS.index('close')] - 1
+        return float(np.clip(expected_return / self.signal_scale, -1.0, 1.0))
+
+
+class EstimatorMember(BaseModel):
+    """
+    把sklearn回归器（如 RandomForestRegressor）包装为集成成员
+    回归器输入为展平的最近 sequence_length 根K线特征，输出预测收益
+    """
+
+    def __init__(self, estimator, sequence_length: int = 10, scaler=None, signal_scale: float = 0.002):
+        self.estimator = estimator
+        self.sequence_length = sequence_length
+        self.scaler = scaler
+        self.signal_scale = signal_scale
+
+    def predict(self, features: np.ndarray) -> float:
+        window = features[-self.sequence_length:]
+        if self.scaler is not None:
+            window = self.scaler.transform(window)
+        expected_return = self.estimator.predict(window.reshape(1, -1))[0]
+        return float(np.clip(expected_return / self.signal_scale, -1.0, 1.0))
+
+
+class _Member:
+    """集成成员的运行状态"""
+
+    def __init__(self, name: str, model: BaseModel, weight: float):
+        self.name = name
+        self.model = model
+        self.weight = weight
+        self.active = True
+        self.consecutive_misses = 0
+        self.total_misses = 0
+        self.calls = 0
+        self.warmed_up = False  # 是否已完成不计时的首次推理
+        self.latency_ms = 0.0  # 最近一次完成推理的耗时
+        self.pending: Optional[Future] = None  # 上一次超时仍在执行的推理
+
+
+@register_model('ensemble')
+class EnsembleModel(BaseModel):
+    """
+    并发集成模型
+    predict 接收共享特征窗口，所有成员并发推理，在 deadline_ms 内完成的成员按权重合成信号
+    """
+
+    def __init__(self, deadline_ms: float = 5.0, max_misses: int = 3, max_workers: int = None):
+        """
+        :param deadline_ms: 单次推理的延迟上限（毫秒）
+        :param max_misses: 成员连续超时达到该次数后停用，可用 reactivate 恢复；
+                           每个成员的首次推理用于预热，不计入超时
+        :param max_workers: 线程池大小，默认等于成员数
+        """
+        self.deadline_ms = deadline_ms
+        self.max_misses = max_misses
+        self.max_workers = max_workers
+        self.members: List[_Member] = []
+        self.executor: Optional[ThreadPoolExecutor] = None
+
+        self.last_latency_ms = 0.0
+        self.last_outputs: Dict[str, float] = {}
+
+    def add_member(self, name: str, model: BaseModel, weight: float = 1.0):
+        """添加成员模型"""
+        if any(member.name == name for member in self.members):
+            raise ValueError(f"Duplicate ensemble member: {name}")
+        self.members.append(_Member(name, model, weight))
+        self._shutdown_executor()
+
+    def _get_executor(self) -> ThreadPoolExecutor:
+        if self.executor is None:
+            self.executor = ThreadPoolExecutor(max_workers=self.max_workers or max(len(self.members), 1),
+                                               thread_name_prefix='ensemble')
+        return self.executor
+
+    def _shutdown_executor(self):
+        if self.executor is not None:
+            self.executor.shutdown(wait=False)
+            self.executor = None
+
+    def close(self):
+        """关闭线程池"""
+        self._shutdown_executor()
+
+    def warmup(self, features: np.ndarray, members: List[_Member] = None):
+        """
+        不计时地在每个成员上推理一次：Keras 等模型首次调用要构图、分配内存，耗时远超延迟上限，
+        若计入超时会在启动时被停用；predict_members 对未预热的成员自动调用
+        """
+        executor = self._get_executor()
+        futures = {executor.submit(member.model.predict, features): member
+                   for member in (members if members is not None else self.members)}
+        for future, member in futures.items():
+            try:
+                future.result()
+            except Exception as e:
+                print(f"集成成员 {member.name} 预热失败: {e!r}")
+            member.warmed_up = True
+
+    @staticmethod
+    def _timed_predict(model: BaseModel, features: np.ndarray):
+        start = time.perf_counter()
+        signal = model.predict(features)
+        return signal, (time.perf_counter() - start) * 1000
+
+    def predict_members(self, features: np.ndarray) -> Dict[str, float]:
+        """
+        并发执行所有启用成员的推理
+        :param features: 共享特征窗口，shape (timesteps, n_features)，成员只读不改
+        :return: {成员名: 信号}，只包含在延迟上限内正常完成的成员；推理异常与超时同样计为一次未按时完成
+        """
+        cold = [member for member in self.members if member.active and not member.warmed_up]
+        if cold:
+            self.warmup(features, cold)
+
+        start = time.perf_counter()
+        executor = self._get_executor()
+
+        futures = {}
+        for member in self.members:
+            if not member.active:
+                continue
+            # 上一次超时的推理仍占用线程时不重复提交，避免任务堆积拖慢其他成员
+            if member.pending is not None and not member.pending.done():
+                self._record_miss(member)
+                continue
+            member.pending = None
+            member.calls += 1
+            futures[executor.submit(self._timed_predict, member.model, features)] = member
+
+        done, not_done = wait(futures, timeout=self.deadline_ms / 1000)
+
+        outputs = {}
+        for future in done:
+            member = futures[future]
+            try:
+                signal, latency_ms = future.result()
+            except Exception as e:
+                print(f"集成成员 {member.name} 推理失败: {e!r}")
+                self._record_miss(member)
+                continue
+            member.latency_ms = latency_ms
+            member.consecutive_misses = 0
+            outputs[member.name] = signal
+
+        for future in not_done:
+            member = futures[future]
+            member.pending = future
+            self._record_miss(member)
+
+        self.last_latency_ms = (time.perf_counter() - start) * 1000
+        self.last_outputs = outputs
+        return outputs
+
+    def _record_miss(self, member: _Member):
+        member.consecutive_misses += 1
+        member.total_misses += 1
+        if member.consecutive_misses >= self.max_misses:
+            member.active = False
+            print(f"集成成员 {member.name} 连续{member.consecutive_misses}次超时或失败，已停用")
+
+    def predict(self, features: np.ndarray) -> float:
+        """
+        返回按权重合成的信号，权重只在按时完成的成员间归一化
+        所有成员均超时时返回0（无信号）
+        """
+        features = np.asarray(features, dtype=np.float64)
+        if features.ndim == 3:
+            features = features[0]
+
+        outputs = self.predict_members(features)
+        weights = {member.name: member.weight for member in self.members}
+
+        total_weight = sum(weights[name] for name in outputs)
+        if total_weight <= 0:
+            return 0.0
+        signal = sum(weights[name] * value for name, value in outputs.items()) / total_weight
+        return float(np.clip(signal, -1.0, 1.0))
+
+    def predict_from_bars(self, df: pd.DataFrame, indicator_model) -> float:
+        """
+        由最近的K线计算一次共享特征窗口，然后集成推理
+        :param df: 最近的K线数据，长度需覆盖指标预热期和最长的成员窗口
+        :param indicator_model: 提供 add_technical_indicators 的 PricePredictionModel
+        """
+        return self.predict(compute_feature_matrix(df, indicator_model))
+
+    def fit_weights(self, windows: np.ndarray, target_returns: np.ndarray) -> Dict[str, float]:
+        """
+        在验证集上学习非负合成权重（NNLS），并归一化为和为1
+        :param windows: 共享特征窗口序列，shape (N, timesteps, n_features)
+        :param target_returns: 对应的实际收益，shape (N,)
+        :return: {成员名: 权重}
+        """
+        # 离线拟合不设延迟上限，逐个窗口依次调用各成员推理
+        signals = np.array([[member.model.predict(window) for member in self.members] for window in windows])
+
+        # 目标收益缩放到与信号相同的量级，避免NNLS的数值问题
+        target = np.asarray(target_returns, dtype=np.float64)
+        target = target / (np.percentile(np.abs(target), 99) or 1.0)
+
+        weights, _ = nnls(signals, target)
+        if weights.sum() <= 0:
+            weights = np.ones(len(self.members))
+        weights = weights / weights.sum()
+
+        for member, weight in zip(self.members, weights):
+            member.weight = float(weight)
+        return {member.name: member.weight for member in self.members}
+
+    def reactivate(self, name: str = None):
+        """恢复被停用的成员，默认恢复全部"""
+        for member in self.members:
+            if name is None or member.name == name:
+                member.active = True
+                member.consecutive_misses = 0
+
+    def get_stats(self) -> pd.DataFrame:
+        """成员状态：权重、是否启用、最近延迟、超时次数"""
+        return pd.DataFrame([{
+            'name': member.name,
+            'weight': member.weight,
+            'active': member.active,
+            'latency_ms': member.latency_ms,
+            'calls': member.calls,
+            'misses': member.total_misses
+        } for member in self.members])
@@ -0,0 +1,103 @@
+"""
+推理门控模块
+在模型推理前依次执行低成本的前置过滤（价差、活跃度、交易时段、冷却、风控状态），
+并按 (模型, 合约, K线序号) 缓存预测结果：同一根K线内输入不变，不重复推理
+"""
+from collections import OrderedDict
+from typing import Callable, Dict, Hashable, Optional, Tuple
+
+
+class PredictionCache:
+    """
+    按K线版本缓存的预测结果
+    每个 (模型, 合约) 只保留最新K线的结果，新K线到来时旧结果自然失效
+    """
+
+    def __init__(self):
+        self._entries: Dict[Tuple[Hashable, str], Tuple[int, object]] = {}
+        self.hits = 0
+        self.misses = 0
+
+    def get(self, model_key: Hashable, symbol: str, bar_seq: int):
+        """
+        :return: (是否命中, 缓存值)
+        """
+        entry = self._entries.get((model_key, symbol))
+        if entry is not None and entry[0] == bar_seq:
+            self.hits += 1
+            return True, entry[1]
+        self.misses += 1
+        return False, None
+
+    def put(self, model_key: Hashable, symbol: str, bar_seq: int, value):
+        self._entries[(model_key, symbol)] = (bar_seq, value)
+
+    def invalidate(self, model_key: Hashable = None, symbol: str = None):
+        """清除缓存（如模型热更新后），参数为None时匹配全部"""
+        for key in list(self._entries):
+            if (model_key is None or key[0] == model_key) and (symbol is None or key[1] == symbol):
+                del self._entries[key]
+
+
+class InferenceGate:
+    """
+    推理门控
+    过滤器按添加顺序执行，应把最便宜、拒绝率最高的放在前面；任一过滤器拒绝即不调度推理
+    """
+
+    def __init__(self):
+        self.filters: Dict[str, Callable[[], bool]] = OrderedDict()
+        self.cache = PredictionCache()
+
+        self.requests = 0
+        self.inferences = 0
+        self.rejections: Dict[str, int] = {}
+
+    def add_filter(self, name: str, func: Callable[[], bool]):
+        """
+        添加前置过滤器
+        :param name: 过滤器名称（用于统计）
+        :param func: 无参函数，返回True表示允许交易
+        """
+        self.filters[name] = func
+        self.rejections[name] = 0
+
+    def allow(self) -> bool:
+        """依次执行过滤器"""
+        for name, func in self.filters.items():
+            if not func():
+                self.rejections[name] += 1
+                return False
+        return True
+
+    def run(self, model_key: Hashable, symbol: str, bar_seq: int, infer: Callable[[], object]) -> Optional[object]:
+        """
+        门控推理：命中缓存直接返回；过滤器拒绝时返回None；否则推理并缓存
+        :param model_key: 模型标识
+        :param symbol: 合约代码
+        :param bar_seq: K线序号（输入窗口的版本号，如 ArrayManager.count）
+        :param infer: 执行推理的无参函数
+        """
+        self.requests += 1
+
+        hit, value = self.cache.get(model_key, symbol, bar_seq)
+        if hit:
+            return value
+
+        if not self.allow():
+            return None
+
+        value = infer()
+        self.inferences += 1
+        self.cache.put(model_key, symbol, bar_seq, value)
+        return value
+
+    def get_stats(self) -> Dict[str, object]:
+        """门控统计：请求数、实际推理数、缓存命中数、各过滤器拒绝数"""
+        return {
+            'requests': self.requests,
+            'inferences': self.inferences,
+            'cache_hits': self.cache.hits,
+            'rejections': dict(self.rejections),
+            'inference_ratio': self.inferences / self.requests if self.requests else 0.0
+        }
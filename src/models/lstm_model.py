@@ -1,7 +1,8 @@
 import numpy as np
 from tensorflow.keras.models import load_model
-from models.base_model import BaseModel
+from src.models.base_model import BaseModel, register_model
 
+@register_model('lstm_trend')
 class LSTMTrendModel(BaseModel):
 
     def __init__(self, model_path: str, scaler_path: str = None):
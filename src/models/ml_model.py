@@ -3,15 +3,33 @@ import numpy as np
 import pandas as pd
 import tensorflow as tf
 from tensorflow.keras.models import Sequential, Model, load_model
-from tensorflow.keras.layers import LSTM, Dense, Dropout, Input, concatenate, GRU, Conv1D, MaxPooling1D, Flatten, TimeDistributed
+from tensorflow.keras.layers import LSTM, Dense, Dropout, Input, concatenate, GRU, Conv1D, MaxPooling1D, Flatten, TimeDistributed, Add, Activation, Cropping1D
 from tensorflow.keras.optimizers import Adam
 from tensorflow.keras.callbacks import EarlyStopping, ReduceLROnPlateau
 from sklearn.ensemble import RandomForestRegressor
 from sklearn.svm import SVR
 from sklearn.metrics import mean_squared_error, mean_absolute_error, r2_score
 import os
-from typing import Tuple, Optional
+from typing import Tuple, Optional, List
 from sklearn.preprocessing import MinMaxScaler
+from src.data.features.indicator_graph import IndicatorGraph
+
+
+# 技术指标定义：{列名: (指标, 参数...)}，编译时共享相同的滚动计算（如 ma_20 与 bb_middle）
+TECHNICAL_INDICATOR_SPEC = {
+    'ma_5': ('sma', 'close', 5),
+    'ma_10': ('sma', 'close', 10),
+    'ma_20': ('sma', 'close', 20),
+    'rsi': ('rsi', 'close', 14),
+    'bb_middle': ('sma', 'close', 20),
+    'bb_upper': ('bollinger_upper', 'close', 20, 2.0),
+    'bb_lower': ('bollinger_lower', 'close', 20, 2.0),
+    'bb_width': ('bollinger_width', 'close', 20, 2.0),
+    'bb_position': ('bollinger_position', 'close', 20, 2.0),
+    'pct_change': ('pct_change', 'close'),
+    'vol_ma': ('sma', 'volume', 10),
+    'hl_diff': ('sub', 'high', 'low'),
+}
 
 
 class PricePredictionModel:
@@ -26,6 +44,12 @@ class PricePredictionModel:
         self.model = None
         self.scaler = MinMaxScaler(feature_range=(0, 1))
         self.target_scaler = MinMaxScaler(feature_range=(0, 1))
+        self.indicators = IndicatorGraph.from_spec(TECHNICAL_INDICATOR_SPEC).compile()
+        
+        # TCN参数：感受野 = 1 + 2 * (kernel_size - 1) * sum(dilations)，需不超过序列长度
+        self.tcn_filters = 32
+        self.tcn_kernel_size = 2
+        self.tcn_dilations = (1, 2, 4, 8)
         
     def _build_lstm_model(self) -> Sequential:
         """
@@ -99,6 +123,47 @@ class PricePredictionModel:
         
         return model
     
+    def _build_tcn_model(self) -> Model:
+        """
+        构建TCN模型（因果膨胀卷积残差块），训练时沿时间维并行计算
+        层命名固定为 tcn_d{膨胀率}_*，供 StreamingTCN 逐根K线增量推理时识别
+        """
+        inputs = Input(shape=(self.sequence_length, self.n_features))
+        x = inputs
+        
+        for dilation in self.tcn_dilations:
+            residual = x
+            x = Conv1D(filters=self.tcn_filters, kernel_size=self.tcn_kernel_size, padding='causal',
+                       dilation_rate=dilation, activation='relu', name=f'tcn_d{dilation}_conv1')(x)
+            x = Dropout(0.2)(x)
+            x = Conv1D(filters=self.tcn_filters, kernel_size=self.tcn_kernel_size, padding='causal',
+                       dilation_rate=dilation, activation='relu', name=f'tcn_d{dilation}_conv2')(x)
+            x = Dropout(0.2)(x)
+            
+            # 通道数不一致时用1x1卷积对齐残差
+            if residual.shape[-1] != self.tcn_filters:
+                residual = Conv1D(filters=self.tcn_filters, kernel_size=1, name=f'tcn_d{dilation}_skip')(residual)
+            x = Activation('relu')(Add()([x, residual]))
+        
+        # 只取最后一个时间步的输出
+        x = Cropping1D(cropping=(self.sequence_length - 1, 0))(x)
+        x = Flatten()(x)
+        x = Dense(units=25)(x)
+        outputs = Dense(units=1)(x)
+        
+        model = Model(inputs=inputs, outputs=outputs)
+        model.compile(
+            optimizer=Adam(learning_rate=0.001),
+            loss='mean_squared_error',
+            metrics=['mae']
+        )
+        
+        return model
+    
+    def tcn_receptive_field(self) -> int:
+        """TCN感受野（K线数）"""
+        return 1 + 2 * (self.tcn_kernel_size - 1) * sum(self.tcn_dilations)
+    
     def build_model(self):
         """
         根据指定类型构建模型
@@ -109,12 +174,19 @@ class PricePredictionModel:
             self.model = self._build_gru_model()
         elif self.model_type == 'cnn-lstm':
             self.model = self._build_cnn_lstm_model()
+        elif self.model_type == 'tcn':
+            if self.tcn_receptive_field() > self.sequence_length:
+                raise ValueError(f"TCN receptive field {self.tcn_receptive_field()} exceeds sequence length {self.sequence_length}")
+            self.model = self._build_tcn_model()
         else:
             raise ValueError(f"Unsupported model type: {self.model_type}")
     
-    def prepare_data_for_30min_prediction(self, df: pd.DataFrame, prediction_horizon: int = 30) -> Tuple[np.ndarray, np.ndarray]:
+    def prepare_data_for_30min_prediction(self, df: pd.DataFrame, prediction_horizon: int = 30,
+                                          sample_indices: Optional[np.ndarray] = None) -> Tuple[np.ndarray, np.ndarray]:
         """
         准备数据用于30分钟后价格预测
+        df 也可以是 src.data.sampling 生成的事件K线（不等间隔），此时预测步长按事件K线计
+        :param sample_indices: 只在这些K线处生成样本（如CUSUM事件下标），默认每根K线都生成
         """
         # 选择用于训练的特征列
         feature_columns = ['open', 'high', 'low', 'close', 'volume']
@@ -141,7 +213,11 @@ class PricePredictionModel:
         
         # 准备序列数据，目标是30个时间步长后的价格
         X, y = [], []
-        for i in range(self.sequence_length, len(scaled_features) - prediction_horizon + 1):
+        window_ends = range(self.sequence_length, len(scaled_features) - prediction_horizon + 1)
+        if sample_indices is not None:
+            # 事件下标是窗口最后一根K线，窗口右边界为其下一根
+            window_ends = [i + 1 for i in sample_indices if self.sequence_length <= i + 1 < window_ends.stop]
+        for i in window_ends:
             X.append(scaled_features[i - self.sequence_length:i])
             y.append(scaled_target[i + prediction_horizon - 1, 0])  # 30分钟后收盘价
         
@@ -149,47 +225,98 @@ class PricePredictionModel:
         
         return X, y
     
-    def add_technical_indicators(self, df: pd.DataFrame) -> pd.DataFrame:
+    def prepare_data_for_barrier_labels(self, df: pd.DataFrame, price_tick: float, take_profit_tick: int = 2,
+                                        stop_loss_tick: int = 3, max_holding: int = 30) -> Tuple[np.ndarray, np.ndarray]:
         """
-        添加技术指标作为额外特征
+        准备数据用于三重障碍标签训练，目标与剥头皮策略的止盈止损规则一致
+        目标为窗口最后一根K线开仓时的标签：1看多，-1看空，0无优势
         """
-        # 移动平均线
-        df['ma_5'] = df['close'].rolling(window=5).mean()
-        df['ma_10'] = df['close'].rolling(window=10).mean()
-        df['ma_20'] = df['close'].rolling(window=20).mean()
+        from src.data.labeling import triple_barrier_labels
+        
+        barrier = triple_barrier_labels(df['close'].values, price_tick, take_profit_tick,
+                                        stop_loss_tick, max_holding)
+        labels, valid = barrier['label'].values, barrier['valid'].values
+        
+        feature_columns = ['open', 'high', 'low', 'close', 'volume']
+        df = self.add_technical_indicators(df)
+        all_feature_cols = feature_columns + [col for col in df.columns if col not in feature_columns and col not in ['datetime']]
+        features = df[all_feature_cols].values
+        
+        if hasattr(self.scaler, 'n_samples_seen_') and self.scaler.n_samples_seen_ > 0:
+            scaled_features = self.scaler.transform(features)
+        else:
+            scaled_features = self.scaler.fit_transform(features)
         
-        # 相对强弱指数
-        delta = df['close'].diff()
-        gain = (delta.where(delta > 0, 0)).rolling(window=14).mean()
-        loss = (-delta.where(delta < 0, 0)).rolling(window=14).mean()
-        rs = gain / loss
-        df['rsi'] = 100 - (100 / (1 + rs))
+        # 数据末尾时间障碍不完整、结果未知的K线不参与训练
+        X, y = [], []
+        for i in range(self.sequence_length, len(scaled_features) + 1):
+            if not valid[i - 1]:
+                continue
+            X.append(scaled_features[i - self.sequence_length:i])
+            y.append(labels[i - 1])
+        
+        return np.array(X), np.array(y, dtype=np.float32)
+    
+    def prepare_data_for_stateful_training(self, dfs: List[pd.DataFrame], prediction_horizon: int = 30,
+                                           batch_size: int = 32, bptt_steps: int = None, warmup: int = None,
+                                           reset_gap_minutes: float = 240, seed: Optional[int] = 0):
+        """
+        准备有状态截断BPTT训练数据：每个合约的K线按时间连续送入，不再为每根K线生成一个重叠窗口
+        :param dfs: 每个合约一个标准格式DataFrame（datetime索引）
+        :param bptt_steps: 梯度回传步数，默认等于 sequence_length
+        :param warmup: 片段开头不计损失的步数，默认等于 bptt_steps
+        :param reset_gap_minutes: K线间隔超过该值时清零状态（默认每个交易日）
+        :return: src.models.stateful_training.TBPTTBatches
+        """
+        from src.models.stateful_training import build_tbptt_batches
         
-        # 布林带
-        df['bb_middle'] = df['close'].rolling(window=20).mean()
-        bb_std = df['close'].rolling(window=20).std()
-        df['bb_upper'] = df['bb_middle'] + (bb_std * 2)
-        df['bb_lower'] = df['bb_middle'] - (bb_std * 2)
-        df['bb_width'] = df['bb_upper'] - df['bb_lower']
-        df['bb_position'] = (df['close'] - df['bb_lower']) / df['bb_width']
+        bptt_steps = bptt_steps or self.sequence_length
+        feature_columns = ['open', 'high', 'low', 'close', 'volume']
         
-        # 价格变化率
-        df['pct_change'] = df['close'].pct_change()
+        features_list, targets, datetimes = [], [], []
+        for df in dfs:
+            df = self.add_technical_indicators(df.copy())
+            all_feature_cols = feature_columns + [col for col in df.columns if col not in feature_columns and col not in ['datetime']]
+            features_list.append(df[all_feature_cols].values)
+            targets.append(df[['close']].values)
+            if isinstance(df.index, pd.DatetimeIndex):
+                datetimes.append(df.index.values)
+            else:
+                # 无时间索引时视为一个连续片段
+                datetimes.append(np.arange(len(df)) * np.timedelta64(1, 'm') + np.datetime64(0, 'ns'))
         
-        # 成交量移动平均
-        df['vol_ma'] = df['volume'].rolling(window=10).mean()
+        # 所有合约共用一组缩放器
+        if not (hasattr(self.scaler, 'n_samples_seen_') and self.scaler.n_samples_seen_ > 0):
+            self.scaler.fit(np.vstack(features_list))
+        if not (hasattr(self.target_scaler, 'n_samples_seen_') and self.target_scaler.n_samples_seen_ > 0):
+            self.target_scaler.fit(np.vstack(targets))
         
-        # 最高价与最低价之差
-        df['hl_diff'] = df['high'] - df['low']
+        series = [(self.scaler.transform(features), self.target_scaler.transform(target)[:, 0], dt)
+                  for features, target, dt in zip(features_list, targets, datetimes)]
+        return build_tbptt_batches(series, prediction_horizon, bptt_steps, batch_size, warmup,
+                                   reset_gap_minutes, seed)
+    
+    def add_technical_indicators(self, df: pd.DataFrame) -> pd.DataFrame:
+        """
+        添加技术指标作为额外特征
+        指标由 TECHNICAL_INDICATOR_SPEC 编译的计算图一次计算完成，实时推理可用 self.indicators.create_stream() 逐根更新
+        """
+        indicators = self.indicators.transform(df)
+        for col in indicators.columns:
+            df[col] = indicators[col]
         
         # 填充NaN值
         df = df.fillna(method='bfill').fillna(method='ffill')
         
         return df
     
-    def train(self, X: np.ndarray, y: np.ndarray, validation_split: float = 0.2, epochs: int = 100, batch_size: int = 32):
+    def train(self, X: np.ndarray, y: np.ndarray, validation_split: float = 0.2, epochs: int = 100, batch_size: int = 32,
+              checkpoint_dir: str = None, checkpoint_every: int = 1, resume: bool = True):
         """
         训练模型
+        :param checkpoint_dir: 检查点目录，设置后每 checkpoint_every 轮在后台线程异步保存权重、优化器状态、
+                               学习率、回调计数与缩放器（src.models.checkpoint），不阻塞训练
+        :param resume: 目录中已有检查点时从其下一轮继续训练
         """
         if self.model is None:
             self.build_model()
@@ -200,19 +327,134 @@ class PricePredictionModel:
         # 定义回调函数
         early_stopping = EarlyStopping(monitor='val_loss', patience=15, restore_best_weights=True)
         reduce_lr = ReduceLROnPlateau(monitor='val_loss', factor=0.2, patience=5, min_lr=0.0001)
+        callbacks = [early_stopping, reduce_lr]
+        
+        checkpointer = None
+        initial_epoch = 0
+        if checkpoint_dir is not None:
+            from src.models.checkpoint import AsyncCheckpointer, load_checkpoint, make_keras_callback, restore_model
+            
+            # 数据迭代位置：Keras fit 按轮次迭代，样本数、验证比例、批大小一致时从下一轮开始即可接续
+            data = {'shape': tuple(X.shape), 'validation_split': validation_split, 'batch_size': batch_size}
+            state = load_checkpoint(checkpoint_dir) if resume else None
+            if state is not None:
+                meta = state['meta']
+                if meta.get('data') != data:
+                    raise ValueError(f"Checkpoint data mismatch: {meta.get('data')} != {data}")
+                restore_model(self.model, state['arrays'])
+                self.model.optimizer.learning_rate.assign(meta['learning_rate'])
+                self.scaler = meta['scaler']
+                self.target_scaler = meta['target_scaler']
+                initial_epoch = meta['epoch'] + 1
+                print(f"从检查点 {state['tag']} 恢复，第 {initial_epoch + 1} 轮开始，学习率 {meta['learning_rate']:.6f}")
+            
+            checkpointer = AsyncCheckpointer(checkpoint_dir)
+            extra_meta = lambda: {'data': data, 'scaler': self.scaler, 'target_scaler': self.target_scaler}
+            callbacks.append(make_keras_callback(checkpointer, extra_meta, checkpoint_every,
+                                                 {'early_stopping': early_stopping, 'reduce_lr': reduce_lr}, state))
         
         # 训练模型
-        history = self.model.fit(
-            X, y,
-            validation_split=validation_split,
-            epochs=epochs,
-            batch_size=batch_size,
-            callbacks=[early_stopping, reduce_lr],
-            verbose=1
-        )
+        try:
+            history = self.model.fit(
+                X, y,
+                validation_split=validation_split,
+                epochs=epochs,
+                batch_size=batch_size,
+                callbacks=callbacks,
+                initial_epoch=initial_epoch,
+                verbose=1
+            )
+        finally:
+            if checkpointer is not None:
+                checkpointer.close()
+        
+        return history
+    
+    def train_distributed(self, X: np.ndarray, y: np.ndarray, n_workers: int = 4, validation_split: float = 0.2,
+                          epochs: int = 100, batch_size: int = 32, learning_rate: float = 0.001,
+                          warmup_epochs: int = 2, threads_per_worker: int = 1):
+        """
+        单机多进程数据并行训练（src.models.distributed_training）
+        每个进程处理 batch_size 个样本，全局批大小为 batch_size × n_workers，学习率按进程数线性放大并预热
+        :return: (训练记录, 扩展效率报告)
+        """
+        import time
+        from src.models.distributed_training import keras_worker, run_data_parallel, scaling_report
+        
+        if self.model is None:
+            self.build_model()
+        gradient_size = int(sum(np.prod(v.shape) for v in self.model.trainable_variables))
+        config = {
+            'model_type': self.model_type,
+            'sequence_length': self.sequence_length,
+            'n_features': self.n_features,
+            'epochs': epochs,
+            'batch_size': batch_size,
+            'learning_rate': learning_rate,
+            'warmup_epochs': warmup_epochs,
+            'validation_split': validation_split,
+            'threads_per_worker': threads_per_worker,
+        }
+        
+        start = time.time()
+        results = run_data_parallel(keras_worker, np.asarray(X, dtype=np.float32), np.asarray(y, dtype=np.float32),
+                                    n_workers, gradient_size, config)
+        report = scaling_report(results, time.time() - start)
+        print(f"并行训练完成: {n_workers} 个进程, {report['samples_per_sec']:.0f} 样本/秒, "
+              f"通信占比 {report['comm_fraction']:.1%}, 并行效率 {report['parallel_efficiency']:.1%}")
+        
+        self.model.set_weights(results[0]['weights'])
+        return results[0]['history'], report
+    
+    def train_stateful(self, batches, validation_batches=None, epochs: int = 100, checkpoint_dir: str = None,
+                       checkpoint_every_chunks: int = 0, resume: bool = True):
+        """
+        有状态截断BPTT训练（仅支持 lstm/gru）
+        训练完成后把权重复制到窗口模型 self.model，predict、save_model 等接口不变
+        :param batches: prepare_data_for_stateful_training 的结果
+        :param validation_batches: 验证数据，批大小需与 batches 相同
+        :param checkpoint_dir: 检查点目录，每轮（及轮内每 checkpoint_every_chunks 个批次）异步保存，可从中断的批次继续
+        """
+        from src.models.stateful_training import build_stateful_model, train_stateful
+        
+        stateful_model = build_stateful_model(self.model_type, batches.batch_size, batches.bptt_steps, self.n_features)
+        print(f"有状态训练: {batches.n_chunks} 个批次, 有效步占比 {batches.efficiency():.1%}")
+        
+        checkpointer, state = None, None
+        if checkpoint_dir is not None:
+            from src.models.checkpoint import AsyncCheckpointer, load_checkpoint
+            state = load_checkpoint(checkpoint_dir) if resume else None
+            if state is not None:
+                self.scaler = state['meta']['scaler']
+                self.target_scaler = state['meta']['target_scaler']
+            checkpointer = AsyncCheckpointer(checkpoint_dir)
         
+        try:
+            history = train_stateful(stateful_model, batches, validation_batches, epochs,
+                                     checkpointer=checkpointer, checkpoint_every_chunks=checkpoint_every_chunks,
+                                     resume=state,
+                                     extra_meta=lambda: {'scaler': self.scaler, 'target_scaler': self.target_scaler})
+        finally:
+            if checkpointer is not None:
+                checkpointer.close()
+        
+        self.build_model()
+        self.model.set_weights(stateful_model.get_weights())
         return history
     
+    def create_stateful_predictor(self):
+        """
+        创建逐根K线推理的有状态模型（batch=1, 每次1步），循环层状态在调用之间保留，每根K线只计算一步
+        输入为已标准化的单根K线特征，形状 (1, 1, n_features)；换交易日或合约时用 stateful_training.reset_all 清零状态
+        """
+        if self.model is None:
+            raise ValueError("Model not built yet. Call build_model() or load_model() first.")
+        
+        from src.models.stateful_training import build_stateful_model
+        predictor = build_stateful_model(self.model_type, 1, 1, self.n_features)
+        predictor.set_weights(self.model.get_weights())
+        return predictor
+    
     def predict(self, X: np.ndarray) -> np.ndarray:
         """
         预测
@@ -225,6 +467,16 @@ class PricePredictionModel:
         predictions = self.target_scaler.inverse_transform(predictions.reshape(-1, 1))
         return predictions.flatten()
     
+    def create_streaming_predictor(self):
+        """
+        创建TCN的增量推理器：每根新K线只计算一列卷积，而不是整个感受野
+        """
+        if self.model is None:
+            raise ValueError("Model not built yet. Call build_model() or load_model() first.")
+        
+        from src.models.tcn_model import StreamingTCN
+        return StreamingTCN(self.model, self.target_scaler)
+    
     def save_model(self, filepath: str):
         """
         保存模型
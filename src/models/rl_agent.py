@@ -0,0 +1,491 @@
+"""
+强化学习交易智能体（PPO）
+- 策略与价值网络为小型MLP，用numpy实现前向与反向，CPU上对整批观测一次矩阵运算
+- 采样：actor进程推进 VecFuturesEnv 中的全部环境，每步对所有观测做一次批量前向计算
+- 学习：learner（主进程）在一段采样上做GAE与多轮小批量PPO更新
+- actor与learner在不同进程中并行：采样缓冲区与最新参数放在共享内存中，
+  learner更新第k段数据时actor已在用稍旧的参数采集后续数据（滞后不超过缓冲区数 2 × n_actors 个版本，
+  比率按采样时的对数概率计算，由PPO的截断吸收）
+训练结果导出为 RLPolicyModel，实现 BaseModel 接口，可直接用于现有策略
+"""
+import multiprocessing as mp
+import queue as queue_lib
+import time
+from typing import Dict, List, Sequence, Tuple
+
+import joblib
+import numpy as np
+
+from src.models.base_model import BaseModel, register_model
+from src.models.distributed_training import SharedArrays
+from src.models.vec_env import HOLD, LONG, SHORT, VecFuturesEnv, price_observations
+
+
+PPO_DEFAULTS = {
+    'hidden': (64, 64),
+    'learning_rate': 3e-4,
+    'gamma': 0.99,
+    'gae_lambda': 0.95,
+    'clip': 0.2,
+    'epochs': 4,
+    'minibatches': 4,
+    'vf_coef': 0.5,
+    'ent_coef': 0.01,
+    'max_grad_norm': 0.5,
+}
+
+
+# ===== 网络 =====
+def _layer_shapes(sizes: Sequence[int]) -> List[Tuple[tuple, tuple]]:
+    return [((sizes[i], sizes[i + 1]), (sizes[i + 1],)) for i in range(len(sizes) - 1)]
+
+
+def _views(flat: np.ndarray, shapes: List[Tuple[tuple, tuple]], offset: int) -> Tuple[list, int]:
+    """在一维参数向量上按层切出 (W, b) 视图"""
+    layers = []
+    for w_shape, b_shape in shapes:
+        size = int(np.prod(w_shape))
+        W = flat[offset:offset + size].reshape(w_shape)
+        offset += size
+        b = flat[offset:offset + b_shape[0]]
+        offset += b_shape[0]
+        layers.append((W, b))
+    return layers, offset
+
+
+def _mlp_forward(layers, x: np.ndarray) -> Tuple[np.ndarray, list]:
+    """tanh 隐层，线性输出层；返回输出与各层输入（反向传播用）"""
+    inputs = []
+    h = x
+    for i, (W, b) in enumerate(layers):
+        inputs.append(h)
+        h = h @ W + b
+        if i < len(layers) - 1:
+            h = np.tanh(h)
+    return h, inputs
+
+
+def _mlp_backward(layers, grads, inputs: list, d_out: np.ndarray):
+    """反向传播，梯度累加进 grads（与 layers 结构相同的视图）"""
+    d = d_out
+    for i in range(len(layers) - 1, -1, -1):
+        W, _ = layers[i]
+        gW, gb = grads[i]
+        gW += inputs[i].T @ d
+        gb += d.sum(axis=0)
+        if i > 0:
+            # inputs[i] 为上一层的tanh输出
+            d = (d @ W.T) * (1.0 - inputs[i] ** 2)
+
+
+def _log_softmax(logits: np.ndarray) -> np.ndarray:
+    z = logits - logits.max(axis=1, keepdims=True)
+    return z - np.log(np.exp(z).sum(axis=1, keepdims=True))
+
+
+class ActorCritic:
+    """
+    策略网络与价值网络（不共享隐层），全部参数存放在一个一维向量中，
+    在进程间同步参数只需复制一个数组
+    """
+
+    def __init__(self, obs_dim: int, n_actions: int, hidden: Sequence[int] = (64, 64), params: np.ndarray = None,
+                 seed: int = 0):
+        self.obs_dim = obs_dim
+        self.n_actions = n_actions
+        self.hidden = tuple(hidden)
+        self.pi_shapes = _layer_shapes((obs_dim,) + self.hidden + (n_actions,))
+        self.v_shapes = _layer_shapes((obs_dim,) + self.hidden + (1,))
+        self.size = sum(int(np.prod(w)) + b[0] for w, b in self.pi_shapes + self.v_shapes)
+
+        if params is None:
+            params = np.zeros(self.size, dtype=np.float32)
+            self._bind(params)
+            rng = np.random.default_rng(seed)
+            # 正交初始化的简化：按 fan_in 缩放的正态分布，策略输出层取小值使初始策略接近均匀
+            for layers in (self.pi_layers, self.v_layers):
+                for i, (W, _) in enumerate(layers):
+                    gain = 0.01 if (layers is self.pi_layers and i == len(layers) - 1) else 1.0
+                    W[...] = rng.normal(0.0, gain / np.sqrt(W.shape[0]), W.shape)
+        else:
+            self._bind(params)
+
+    def _bind(self, params: np.ndarray):
+        self.params = params
+        self.pi_layers, offset = _views(params, self.pi_shapes, 0)
+        self.v_layers, _ = _views(params, self.v_shapes, offset)
+
+    def logits(self, obs: np.ndarray) -> np.ndarray:
+        return _mlp_forward(self.pi_layers, obs)[0]
+
+    def values(self, obs: np.ndarray) -> np.ndarray:
+        return _mlp_forward(self.v_layers, obs)[0][:, 0]
+
+    def act(self, obs: np.ndarray, rng: np.random.Generator) -> Tuple[np.ndarray, np.ndarray]:
+        """对一批观测采样动作，返回 (动作, 对数概率)"""
+        logp = _log_softmax(self.logits(obs))
+        cumulative = np.exp(logp).cumsum(axis=1)
+        u = rng.random((len(obs), 1)) * cumulative[:, -1:]
+        actions = np.minimum((cumulative < u).sum(axis=1), self.n_actions - 1)
+        return actions, logp[np.arange(len(obs)), actions]
+
+    def ppo_gradients(self, obs, actions, old_logp, advantages, returns, clip: float, vf_coef: float,
+                      ent_coef: float) -> Tuple[np.ndarray, Dict[str, float]]:
+        """
+        PPO截断目标 + 价值损失 - 熵奖励 的梯度
+        :return: (与 self.params 同形的梯度向量, 统计量)
+        """
+        n = len(obs)
+        grad = np.zeros_like(self.params)
+        grad_pi, offset = _views(grad, self.pi_shapes, 0)
+        grad_v, _ = _views(grad, self.v_shapes, offset)
+        rows = np.arange(n)
+
+        # 策略
+        logits, pi_inputs = _mlp_forward(self.pi_layers, obs)
+        logp_all = _log_softmax(logits)
+        p = np.exp(logp_all)
+        logp = logp_all[rows, actions]
+        ratio = np.exp(logp - old_logp)
+        surrogate = ratio * advantages
+        clipped = np.clip(ratio, 1.0 - clip, 1.0 + clip) * advantages
+        # min(surrogate, clipped) 取到截断分支且比率越界时梯度为0
+        active = (surrogate <= clipped) | ((ratio > 1.0 - clip) & (ratio < 1.0 + clip))
+        d_logp = -(advantages * ratio * active) / n
+        d_logits = -p * d_logp[:, None]
+        d_logits[rows, actions] += d_logp
+        entropy = -(p * logp_all).sum(axis=1)
+        d_logits += ent_coef * p * (logp_all + entropy[:, None]) / n
+        _mlp_backward(self.pi_layers, grad_pi, pi_inputs, d_logits.astype(np.float32))
+
+        # 价值
+        values, v_inputs = _mlp_forward(self.v_layers, obs)
+        values = values[:, 0]
+        d_values = 2.0 * vf_coef * (values - returns) / n
+        _mlp_backward(self.v_layers, grad_v, v_inputs, d_values[:, None].astype(np.float32))
+
+        stats = {
+            'policy_loss': float(-np.minimum(surrogate, clipped).mean()),
+            'value_loss': float(((values - returns) ** 2).mean()),
+            'entropy': float(entropy.mean()),
+            'approx_kl': float((old_logp - logp).mean()),
+            'clip_fraction': float((np.abs(ratio - 1.0) > clip).mean()),
+        }
+        return grad, stats
+
+
+class Adam:
+    """作用于一维参数向量的Adam，带全局梯度范数截断"""
+
+    def __init__(self, size: int, learning_rate: float = 3e-4, beta1: float = 0.9, beta2: float = 0.999,
+                 eps: float = 1e-8, max_grad_norm: float = None):
+        self.learning_rate = learning_rate
+        self.beta1, self.beta2, self.eps = beta1, beta2, eps
+        self.max_grad_norm = max_grad_norm
+        self.m = np.zeros(size, dtype=np.float64)
+        self.v = np.zeros(size, dtype=np.float64)
+        self.t = 0
+
+    def step(self, params: np.ndarray, grad: np.ndarray):
+        if self.max_grad_norm:
+            norm = float(np.sqrt((grad.astype(np.float64) ** 2).sum()))
+            if norm > self.max_grad_norm:
+                grad = grad * (self.max_grad_norm / norm)
+        self.t += 1
+        self.m = self.beta1 * self.m + (1 - self.beta1) * grad
+        self.v = self.beta2 * self.v + (1 - self.beta2) * grad.astype(np.float64) ** 2
+        m_hat = self.m / (1 - self.beta1 ** self.t)
+        v_hat = self.v / (1 - self.beta2 ** self.t)
+        params -= (self.learning_rate * m_hat / (np.sqrt(v_hat) + self.eps)).astype(params.dtype)
+
+
+# ===== 采样与学习 =====
+ROLLOUT_FIELDS = ('obs', 'last_obs', 'actions', 'logp', 'rewards', 'dones')
+
+
+def rollout_buffers(n_buffers: int, steps: int, n_envs: int, obs_dim: int) -> Dict[str, np.ndarray]:
+    return {
+        'obs': np.zeros((n_buffers, steps, n_envs, obs_dim), dtype=np.float32),
+        'last_obs': np.zeros((n_buffers, n_envs, obs_dim), dtype=np.float32),
+        'actions': np.zeros((n_buffers, steps, n_envs), dtype=np.int64),
+        'logp': np.zeros((n_buffers, steps, n_envs), dtype=np.float32),
+        'rewards': np.zeros((n_buffers, steps, n_envs), dtype=np.float32),
+        'dones': np.zeros((n_buffers, steps, n_envs), dtype=np.bool_),
+    }
+
+
+def collect_rollout(env: VecFuturesEnv, net: ActorCritic, obs: np.ndarray, buffers: Dict[str, np.ndarray], k: int,
+                    rng: np.random.Generator) -> Tuple[np.ndarray, dict]:
+    """
+    推进全部环境 steps 步，写入第k个缓冲区；每步一次批量前向计算
+    :return: (最后的观测, 本段结束回合的统计)
+    """
+    steps = buffers['obs'].shape[1]
+    episode_pnl, episode_trades = [], []
+    for t in range(steps):
+        actions, logp = net.act(obs, rng)
+        buffers['obs'][k, t] = obs
+        buffers['actions'][k, t] = actions
+        buffers['logp'][k, t] = logp
+        obs, rewards, dones, info = env.step(actions)
+        buffers['rewards'][k, t] = rewards
+        buffers['dones'][k, t] = dones
+        if 'episode_pnl' in info:
+            episode_pnl.extend(info['episode_pnl'].tolist())
+            episode_trades.extend(info['episode_trades'].tolist())
+    buffers['last_obs'][k] = obs
+    return obs, {'episode_pnl': episode_pnl, 'episode_trades': episode_trades}
+
+
+def compute_gae(rewards: np.ndarray, dones: np.ndarray, values: np.ndarray, gamma: float,
+                gae_lambda: float) -> Tuple[np.ndarray, np.ndarray]:
+    """
+    :param values: shape (steps + 1, n_envs)，最后一行为采样结束后观测的价值
+    :return: (优势, 回报)
+    """
+    steps = rewards.shape[0]
+    advantages = np.zeros_like(rewards, dtype=np.float64)
+    last = np.zeros(rewards.shape[1])
+    for t in range(steps - 1, -1, -1):
+        not_done = 1.0 - dones[t]
+        delta = rewards[t] + gamma * values[t + 1] * not_done - values[t]
+        last = delta + gamma * gae_lambda * not_done * last
+        advantages[t] = last
+    return advantages, advantages + values[:-1]
+
+
+def ppo_update(net: ActorCritic, optimizer: Adam, buffers: Dict[str, np.ndarray], k: int, config: dict,
+               rng: np.random.Generator) -> Dict[str, float]:
+    """在第k个缓冲区的数据上做PPO更新，价值用当前参数重新计算"""
+    obs = buffers['obs'][k]
+    steps, n_envs, obs_dim = obs.shape
+    values = np.vstack([net.values(obs.reshape(-1, obs_dim)).reshape(steps, n_envs),
+                        net.values(buffers['last_obs'][k])[None]])
+    advantages, returns = compute_gae(buffers['rewards'][k], buffers['dones'][k], values,
+                                      config['gamma'], config['gae_lambda'])
+
+    flat_obs = obs.reshape(-1, obs_dim)
+    flat_actions = buffers['actions'][k].reshape(-1)
+    flat_logp = buffers['logp'][k].reshape(-1).astype(np.float64)
+    flat_adv = advantages.reshape(-1)
+    flat_adv = (flat_adv - flat_adv.mean()) / (flat_adv.std() + 1e-8)
+    flat_returns = returns.reshape(-1)
+
+    n = len(flat_obs)
+    batch = n // config['minibatches']
+    stats = []
+    for _ in range(config['epochs']):
+        order = rng.permutation(n)
+        for start in range(0, n - batch + 1, batch):
+            idx = order[start:start + batch]
+            grad, s = net.ppo_gradients(flat_obs[idx], flat_actions[idx], flat_logp[idx], flat_adv[idx],
+                                        flat_returns[idx], config['clip'], config['vf_coef'], config['ent_coef'])
+            optimizer.step(net.params, grad)
+            stats.append(s)
+    return {key: float(np.mean([s[key] for s in stats])) for key in stats[0]}
+
+
+def _actor_entry(rank: int, shared_spec: dict, env_args: dict, net_args: dict, free_queue, full_queue, lock,
+                 seed: int):
+    """actor进程：取空闲缓冲区 -> 复制最新参数 -> 采样 -> 交给learner"""
+    shared = SharedArrays.attach(shared_spec)
+    try:
+        env = VecFuturesEnv(**env_args, seed=seed + rank)
+        params = np.empty_like(shared['params'])
+        net = ActorCritic(params=params, **net_args)
+        rng = np.random.default_rng(seed + 1000 + rank)
+        buffers = {name: shared[name] for name in ROLLOUT_FIELDS}
+        obs = env.reset()
+        while True:
+            k = free_queue.get()
+            if k is None:
+                break
+            with lock:
+                params[...] = shared['params']
+                version = int(shared['version'][0])
+            t0 = time.perf_counter()
+            obs, episodes = collect_rollout(env, net, obs, buffers, k, rng)
+            full_queue.put((k, rank, version, time.perf_counter() - t0, episodes))
+    finally:
+        shared.close()
+
+
+def train_ppo(closes: Sequence[np.ndarray], iterations: int = 200, n_envs: int = 64, rollout_steps: int = 128,
+              n_actors: int = 2, env_config: dict = None, ppo_config: dict = None,
+              seed: int = 0) -> Tuple["RLPolicyModel", Dict[str, list]]:
+    """
+    PPO训练
+    :param closes: 各合约的收盘价序列（vec_env.closes_from_store）
+    :param iterations: learner 更新次数，每次使用 rollout_steps × n_envs 步数据
+    :param n_envs: 每个actor的并行环境数
+    :param n_actors: actor进程数，0 时在主进程中交替采样与学习
+    :param env_config: VecFuturesEnv 的其余参数（window_size、episode_length、transaction_cost、n_actions）
+    :param ppo_config: 覆盖 PPO_DEFAULTS
+    :return: (导出的策略模型, 训练记录)
+    """
+    config = dict(PPO_DEFAULTS, **(ppo_config or {}))
+    env_args = dict(env_config or {}, closes=[np.asarray(c, dtype=np.float64) for c in closes], n_envs=n_envs)
+    probe = VecFuturesEnv(**env_args, seed=seed)
+    env_args['return_scale'] = probe.return_scale
+    net_args = {'obs_dim': probe.obs_dim, 'n_actions': probe.n_actions, 'hidden': config['hidden']}
+
+    net = ActorCritic(**net_args, seed=seed)
+    optimizer = Adam(net.size, config['learning_rate'], max_grad_norm=config['max_grad_norm'])
+    rng = np.random.default_rng(seed)
+    history = {key: [] for key in ('episode_pnl', 'episode_trades', 'policy_loss', 'value_loss', 'entropy',
+                                   'approx_kl', 'clip_fraction', 'policy_lag', 'env_time',
+                                   'learn_time')}
+
+    def record(stats: dict, episodes: dict, lag: int, env_time: float, learn_time: float, iteration: int):
+        for key, value in stats.items():
+            history[key].append(value)
+        history['episode_pnl'].append(float(np.mean(episodes['episode_pnl'])) if episodes['episode_pnl'] else np.nan)
+        history['episode_trades'].append(
+            float(np.mean(episodes['episode_trades'])) if episodes['episode_trades'] else np.nan)
+        history['policy_lag'].append(lag)
+        history['env_time'].append(env_time)
+        history['learn_time'].append(learn_time)
+        if (iteration + 1) % 10 == 0:
+            recent = [x for x in history['episode_pnl'][-10:] if not np.isnan(x)]
+            print(f"PPO {iteration + 1}/{iterations} - 回合收益 {np.mean(recent) if recent else np.nan:.5f} - "
+                  f"熵 {stats['entropy']:.3f} - KL {stats['approx_kl']:.4f}")
+
+    start = time.time()
+    if n_actors == 0:
+        env = probe
+        buffers = rollout_buffers(1, rollout_steps, n_envs, probe.obs_dim)
+        obs = env.reset()
+        for iteration in range(iterations):
+            t0 = time.perf_counter()
+            obs, episodes = collect_rollout(env, net, obs, buffers, 0, rng)
+            t1 = time.perf_counter()
+            stats = ppo_update(net, optimizer, buffers, 0, config, rng)
+            record(stats, episodes, 0, t1 - t0, time.perf_counter() - t1, iteration)
+    else:
+        ctx = mp.get_context('spawn')
+        n_buffers = 2 * n_actors
+        arrays = rollout_buffers(n_buffers, rollout_steps, n_envs, probe.obs_dim)
+        arrays['params'] = net.params
+        arrays['version'] = np.zeros(1, dtype=np.int64)
+        shared = SharedArrays.create(arrays)
+        lock = ctx.Lock()
+        free_queue, full_queue = ctx.Queue(), ctx.Queue()
+        for k in range(n_buffers):
+            free_queue.put(k)
+        buffers = {name: shared[name] for name in ROLLOUT_FIELDS}
+
+        processes = [ctx.Process(target=_actor_entry, args=(rank, shared.spec, env_args, net_args, free_queue,
+                                                            full_queue, lock, seed), daemon=True)
+                     for rank in range(n_actors)]
+        try:
+            for p in processes:
+                p.start()
+            for iteration in range(iterations):
+                while True:
+                    try:
+                        k, rank, version, env_time, episodes = full_queue.get(timeout=5)
+                        break
+                    except queue_lib.Empty:
+                        dead = [p for p in processes if not p.is_alive()]
+                        if dead:
+                            raise RuntimeError(f"actor process exited with code {dead[0].exitcode}")
+                t0 = time.perf_counter()
+                stats = ppo_update(net, optimizer, buffers, k, config, rng)
+                with lock:
+                    shared['params'][...] = net.params
+                    shared['version'][0] = iteration + 1
+                free_queue.put(k)
+                record(stats, episodes, iteration - version, env_time, time.perf_counter() - t0, iteration)
+        finally:
+            for _ in processes:
+                free_queue.put(None)
+            for p in processes:
+                p.join(timeout=10)
+                if p.is_alive():
+                    p.terminate()
+            net = ActorCritic(params=net.params.copy(), **net_args)
+            shared.close()
+
+    wall = time.time() - start
+    env_steps = iterations * rollout_steps * n_envs
+    print(f"PPO训练完成: {env_steps} 步, {env_steps / wall:.0f} 步/秒, "
+          f"learner 占用 {sum(history['learn_time']) / wall:.1%}")
+
+    model = RLPolicyModel()
+    model.set_network(net, probe.window_size, probe.return_scale)
+    return model, history
+
+
+# ===== 导出 =====
+@register_model('rl_policy')
+class RLPolicyModel(BaseModel):
+    """
+    PPO训练得到的交易策略
+    输入最近的收盘价窗口，输出按动作概率加权的目标仓位（-1 ~ +1）；推理只用numpy
+    策略的观测包含当前仓位，使用前用 set_position 同步策略的实际持仓方向
+    """
+
+    def __init__(self, model_path: str = None):
+        self.window_size = None
+        self.return_scale = 1.0
+        self.n_actions = 4
+        self.layers = []
+        self.position = 0.0
+
+        if model_path:
+            self.load(model_path)
+
+    def set_network(self, net: ActorCritic, window_size: int, return_scale: float):
+        self.window_size = window_size
+        self.return_scale = return_scale
+        self.n_actions = net.n_actions
+        self.layers = [(W.copy(), b.copy()) for W, b in net.pi_layers]
+
+    def set_position(self, position: float):
+        """当前持仓方向：1 多 / -1 空 / 0 无仓位"""
+        self.position = float(np.sign(position))
+
+    def action_probabilities(self, close_windows: np.ndarray, positions: np.ndarray = None) -> np.ndarray:
+        """
+        批量计算动作概率
+        :param close_windows: shape (N, >= window_size + 1)
+        :return: shape (N, n_actions)，列顺序为 持有/做多/做空/平仓
+        """
+        close_windows = np.atleast_2d(np.asarray(close_windows, dtype=np.float64))[:, -(self.window_size + 1):]
+        if positions is None:
+            positions = np.full(len(close_windows), self.position)
+        obs = price_observations(np.diff(np.log(close_windows), axis=1), np.asarray(positions, dtype=np.float64),
+                                 self.return_scale)
+        return np.exp(_log_softmax(_mlp_forward(self.layers, obs)[0]))
+
+    def target_positions(self, close_windows: np.ndarray, positions: np.ndarray = None) -> np.ndarray:
+        """概率加权的目标仓位"""
+        p = self.action_probabilities(close_windows, positions)
+        if positions is None:
+            positions = np.full(len(p), self.position)
+        # 平仓动作的目标仓位为0，不计入
+        return p[:, LONG] - p[:, SHORT] + p[:, HOLD] * positions
+
+    def predict(self, features: np.ndarray) -> float:
+        """
+        features: 最近的收盘价窗口，shape (timesteps,) / (1, timesteps) / (1, timesteps, 1)，timesteps >= window_size + 1
+        """
+        close_window = np.asarray(features, dtype=np.float64).reshape(1, -1)
+        return float(np.clip(self.target_positions(close_window)[0], -1.0, 1.0))
+
+    def save(self, filepath: str):
+        """保存策略"""
+        joblib.dump({
+            'window_size': self.window_size,
+            'return_scale': self.return_scale,
+            'n_actions': self.n_actions,
+            'layers': self.layers,
+        }, filepath)
+
+    def load(self, filepath: str):
+        """加载策略"""
+        state = joblib.load(filepath)
+        self.window_size = state['window_size']
+        self.return_scale = state['return_scale']
+        self.n_actions = state['n_actions']
+        self.layers = state['layers']
@@ -0,0 +1,333 @@
+"""
+有状态截断BPTT训练模块
+滑动窗口训练中每根K线要在约 sequence_length 个重叠窗口里重复计算；这里改为把每个合约的序列切成连续片段，
+分配到 batch_size 条并行的数据流中，每次送入每条流接下来的 bptt_steps 根K线，循环层的状态在相邻批次之间延续，
+梯度只回传 bptt_steps 步。每根K线每轮只计算一次，计算量与内存约为窗口方式的 1 / sequence_length。
+片段在换合约或换交易日处切开，新片段开始时清零该条流的状态，
+片段开头的 warmup 根K线状态尚未充分积累，不计入损失
+"""
+from typing import Dict, List, Optional, Sequence, Tuple
+
+import numpy as np
+
+
+class TBPTTBatches:
+    """
+    截断BPTT批数据
+    X: (n_chunks, batch_size, bptt_steps, n_features)
+    y / weight: (n_chunks, batch_size, bptt_steps)，weight 为0的步（预热、填充、预测目标越过合约末尾）不计入损失
+    reset: (n_chunks, batch_size)，为True的流在该批开始前清零状态
+    """
+
+    def __init__(self, X: np.ndarray, y: np.ndarray, weight: np.ndarray, reset: np.ndarray):
+        self.X = X
+        self.y = y
+        self.weight = weight
+        self.reset = reset
+
+    @property
+    def n_chunks(self) -> int:
+        return self.X.shape[0]
+
+    @property
+    def batch_size(self) -> int:
+        return self.X.shape[1]
+
+    @property
+    def bptt_steps(self) -> int:
+        return self.X.shape[2]
+
+    def efficiency(self) -> float:
+        """有效训练步占全部步数的比例（其余为填充与预热）"""
+        return float(self.weight.mean()) if self.weight.size else 0.0
+
+
+def split_segments(datetimes: np.ndarray, reset_gap_minutes: float = 240, join_night: bool = True) -> List[Tuple[int, int]]:
+    """
+    按时间间隔切分连续片段
+    :param datetimes: int64纳秒或datetime64（北京时间）
+    :param reset_gap_minutes: 相邻K线间隔超过该值时切开，默认4小时，午休与小节休息不切开
+    :param join_night: 夜盘与其后的日盘属于同一交易日，二者之间（含周末）不切开，即每个交易日一个片段
+    :return: [(开始下标, 结束下标)]，左闭右开
+    """
+    ns = np.asarray(datetimes).astype('datetime64[ns]').astype(np.int64)
+    if len(ns) == 0:
+        return []
+    split = np.diff(ns) > reset_gap_minutes * 60_000_000_000
+    if join_night:
+        minute = (ns // 60_000_000_000) % 1440
+        night = (minute >= 20 * 60) | (minute < 3 * 60)
+        split &= ~(night[:-1] & ~night[1:])
+    breaks = np.flatnonzero(split) + 1
+    bounds = np.concatenate(([0], breaks, [len(ns)]))
+    return [(int(bounds[i]), int(bounds[i + 1])) for i in range(len(bounds) - 1)]
+
+
+def build_tbptt_batches(series: Sequence[Tuple[np.ndarray, np.ndarray, np.ndarray]], prediction_horizon: int = 30,
+                        bptt_steps: int = 60, batch_size: int = 32, warmup: int = None,
+                        reset_gap_minutes: float = 240, seed: Optional[int] = 0) -> TBPTTBatches:
+    """
+    构建截断BPTT批数据
+    :param series: 每个合约一项 (特征[n, F], 标准化目标[n], 时间[n])
+    :param prediction_horizon: 第 t 步的目标为 t + prediction_horizon 步的值（与滑动窗口方式一致）
+    :param warmup: 片段开头不计损失的步数，默认等于 bptt_steps
+    :param seed: 片段打乱顺序的随机种子，None 时按时间顺序
+    """
+    warmup = bptt_steps if warmup is None else warmup
+
+    # 切片段：片段内时间连续，目标不越过合约末尾
+    segments = []
+    for features, target, datetimes in series:
+        n = len(target)
+        for start, end in split_segments(datetimes, reset_gap_minutes):
+            if end - start <= warmup:
+                continue
+            segments.append((features, target, start, end, n))
+    if not segments:
+        raise ValueError("No segment longer than warmup")
+
+    order = np.arange(len(segments))
+    if seed is not None:
+        np.random.default_rng(seed).shuffle(order)
+
+    # 每个片段补齐到 bptt_steps 的整数倍，使新片段总是从批次边界开始，状态按流清零
+    padded = [int(np.ceil((segments[i][3] - segments[i][2]) / bptt_steps)) for i in order]
+    streams: List[List[int]] = [[] for _ in range(batch_size)]
+    lengths = np.zeros(batch_size, dtype=np.int64)
+    for k, i in enumerate(order):
+        s = int(lengths.argmin())
+        streams[s].append(i)
+        lengths[s] += padded[k]
+    chunk_of = dict(zip(order, padded))
+
+    n_chunks = int(lengths.max())
+    n_features = segments[0][0].shape[1]
+    X = np.zeros((n_chunks, batch_size, bptt_steps, n_features), dtype=np.float32)
+    y = np.zeros((n_chunks, batch_size, bptt_steps), dtype=np.float32)
+    weight = np.zeros((n_chunks, batch_size, bptt_steps), dtype=np.float32)
+    reset = np.zeros((n_chunks, batch_size), dtype=np.bool_)
+
+    for s, stream in enumerate(streams):
+        chunk = 0
+        for i in stream:
+            features, target, start, end, n = segments[i]
+            length = end - start
+            steps = chunk_of[i] * bptt_steps
+
+            seg_X = np.zeros((steps, n_features), dtype=np.float32)
+            seg_y = np.zeros(steps, dtype=np.float32)
+            seg_w = np.zeros(steps, dtype=np.float32)
+            seg_X[:length] = features[start:end]
+            t = np.arange(start, end)
+            valid = t + prediction_horizon < n
+            seg_y[:length][valid] = target[t[valid] + prediction_horizon]
+            seg_w[:length] = valid
+            seg_w[:warmup] = 0.0
+
+            count = chunk_of[i]
+            X[chunk:chunk + count, s] = seg_X.reshape(count, bptt_steps, n_features)
+            y[chunk:chunk + count, s] = seg_y.reshape(count, bptt_steps)
+            weight[chunk:chunk + count, s] = seg_w.reshape(count, bptt_steps)
+            reset[chunk, s] = True
+            chunk += count
+        # 流末尾的填充：权重为0，状态清零
+        if chunk < n_chunks:
+            reset[chunk, s] = True
+
+    return TBPTTBatches(X, y, weight, reset)
+
+
+def build_stateful_model(model_type: str, batch_size: int, bptt_steps: int, n_features: int,
+                         learning_rate: float = 0.001):
+    """
+    与 PricePredictionModel 的LSTM/GRU结构相同的有状态版本：每一步都输出预测（TimeDistributed），
+    权重顺序与窗口模型一致，训练后可直接 set_weights 到窗口模型
+    """
+    from tensorflow.keras.layers import GRU, LSTM, Dense, Dropout, Input, TimeDistributed
+    from tensorflow.keras.models import Sequential
+    from tensorflow.keras.optimizers import Adam
+
+    if model_type == 'lstm':
+        rnn = LSTM
+    elif model_type == 'gru':
+        rnn = GRU
+    else:
+        raise ValueError(f"Unsupported model type for stateful training: {model_type}")
+
+    model = Sequential([
+        Input(batch_shape=(batch_size, bptt_steps, n_features)),
+        rnn(units=50, return_sequences=True, stateful=True),
+        Dropout(0.2),
+        rnn(units=50, return_sequences=True, stateful=True),
+        Dropout(0.2),
+        rnn(units=50, return_sequences=True, stateful=True),
+        Dropout(0.2),
+        TimeDistributed(Dense(units=25)),
+        TimeDistributed(Dense(units=1))
+    ])
+    model.compile(
+        optimizer=Adam(learning_rate=learning_rate),
+        loss='mean_squared_error',
+        weighted_metrics=['mae']
+    )
+    return model
+
+
+def _recurrent_layers(model):
+    return [layer for layer in model.layers if getattr(layer, 'stateful', False)]
+
+
+def reset_rows(model, rows: np.ndarray):
+    """清零指定数据流（批内行）的循环层状态，其余流的状态保留"""
+    if not rows.any():
+        return
+    keep = (~rows).astype(np.float32)[:, None]
+    for layer in _recurrent_layers(model):
+        for state in layer.states:
+            state.assign(state.numpy() * keep)
+
+
+def reset_all(model):
+    for layer in _recurrent_layers(model):
+        layer.reset_states()
+
+
+def recurrent_states(model) -> List[np.ndarray]:
+    """各循环层的当前状态，用于检查点"""
+    return [np.asarray(state.numpy()) for layer in _recurrent_layers(model) for state in layer.states]
+
+
+def set_recurrent_states(model, values: List[np.ndarray]):
+    states = [state for layer in _recurrent_layers(model) for state in layer.states]
+    for state, value in zip(states, values):
+        state.assign(value)
+
+
+def run_epoch(model, batches: TBPTTBatches, train: bool = True, start_chunk: int = 0,
+              totals: Tuple[float, float] = (0.0, 0.0), on_chunk=None) -> float:
+    """
+    按时间顺序遍历全部批次，状态在批次之间延续
+    :param start_chunk: 从该批次继续（检查点恢复时，循环层状态需已恢复）
+    :param totals: 已完成批次的 (加权损失和, 有效步数)
+    :param on_chunk: 每个批次后调用 on_chunk(下一批次, 加权损失和, 有效步数)
+    :return: 按有效步加权的平均损失
+    """
+    if start_chunk == 0:
+        reset_all(model)
+    total, count = totals
+    for c in range(start_chunk, batches.n_chunks):
+        reset_rows(model, batches.reset[c])
+        w = batches.weight[c]
+        valid = float(w.sum())
+        if valid == 0:
+            # 全部为预热/填充的批次也要前向计算，以推进状态
+            model.predict_on_batch(batches.X[c])
+        else:
+            y = batches.y[c][..., None]
+            if train:
+                result = model.train_on_batch(batches.X[c], y, sample_weight=w)
+            else:
+                result = model.test_on_batch(batches.X[c], y, sample_weight=w)
+            loss = result[0] if isinstance(result, (list, tuple)) else result
+            # Keras 的加权损失按批内全部步平均，换算为按有效步平均
+            total += float(loss) * w.size
+            count += valid
+        if on_chunk is not None:
+            on_chunk(c + 1, total, count)
+    return total / count if count else np.nan
+
+
+def train_stateful(model, batches: TBPTTBatches, validation: TBPTTBatches = None, epochs: int = 100,
+                   patience: int = 15, lr_patience: int = 5, lr_factor: float = 0.2,
+                   min_lr: float = 0.0001, checkpointer=None, checkpoint_every_chunks: int = 0,
+                   resume: Dict = None, extra_meta=None) -> Dict[str, List[float]]:
+    """
+    有状态训练循环，早停与学习率衰减规则与 PricePredictionModel.train 的回调一致
+    验证集的批大小需与训练集相同
+    :param checkpointer: src.models.checkpoint.AsyncCheckpointer，每轮结束时保存
+    :param checkpoint_every_chunks: 大于0时轮内每隔该批次数也保存一次（含循环层状态与迭代位置），
+                                    单轮很长的多合约训练中断后可从轮内继续
+    :param resume: load_checkpoint 的结果
+    :param extra_meta: 返回额外元数据（如缩放器）的函数
+    :return: {'loss': [...], 'val_loss': [...]}
+    """
+    history = {'loss': [], 'val_loss': []}
+    best_loss, best_weights = np.inf, None
+    wait, lr_wait = 0, 0
+    start_epoch, start_chunk, totals = 0, 0, (0.0, 0.0)
+
+    if resume is not None:
+        from src.models.checkpoint import restore_model
+        meta, arrays = resume['meta'], resume['arrays']
+        if meta.get('n_chunks') != batches.n_chunks:
+            raise ValueError(f"Checkpoint has {meta.get('n_chunks')} chunks, batches have {batches.n_chunks}")
+        restore_model(model, arrays)
+        model.optimizer.learning_rate.assign(meta['learning_rate'])
+        history = meta['history']
+        best_loss, wait, lr_wait = meta['best_loss'], meta['wait'], meta['lr_wait']
+        best_weights = arrays.get('best_weights')
+        start_epoch, start_chunk, totals = meta['epoch'], meta['chunk'], meta['totals']
+        if meta.get('stopped'):
+            start_epoch = epochs
+        elif start_chunk >= batches.n_chunks:
+            start_epoch, start_chunk, totals = start_epoch + 1, 0, (0.0, 0.0)
+        elif start_chunk > 0:
+            set_recurrent_states(model, arrays['states'])
+        print(f"从检查点 {resume['tag']} 恢复: 第 {start_epoch + 1} 轮, 批次 {start_chunk}/{batches.n_chunks}")
+
+    def save(epoch: int, chunk: int, chunk_totals: Tuple[float, float], stopped: bool = False):
+        from src.models.checkpoint import snapshot_model
+        arrays = snapshot_model(model)
+        if best_weights is not None:
+            arrays['best_weights'] = best_weights
+        if 0 < chunk < batches.n_chunks:
+            arrays['states'] = recurrent_states(model)
+        meta = dict(extra_meta()) if extra_meta is not None else {}
+        meta.update({
+            'epoch': epoch, 'chunk': chunk, 'totals': chunk_totals, 'n_chunks': batches.n_chunks,
+            'learning_rate': float(model.optimizer.learning_rate.numpy()), 'history': history,
+            'best_loss': best_loss, 'wait': wait, 'lr_wait': lr_wait, 'stopped': stopped,
+        })
+        checkpointer.save(f'epoch-{epoch + 1:04d}-chunk-{chunk:06d}', arrays, meta)
+
+    def on_chunk(chunk: int, total: float, count: float):
+        if checkpointer is not None and checkpoint_every_chunks > 0 and chunk % checkpoint_every_chunks == 0 \
+                and chunk < batches.n_chunks:
+            save(epoch, chunk, (total, count))
+
+    for epoch in range(start_epoch, epochs):
+        loss = run_epoch(model, batches, train=True, start_chunk=start_chunk, totals=totals, on_chunk=on_chunk)
+        start_chunk, totals = 0, (0.0, 0.0)
+        val_loss = run_epoch(model, validation, train=False) if validation is not None else loss
+        history['loss'].append(loss)
+        history['val_loss'].append(val_loss)
+        print(f"Epoch {epoch + 1}/{epochs} - loss: {loss:.6f} - val_loss: {val_loss:.6f}")
+
+        stop = False
+        if val_loss < best_loss:
+            best_loss, best_weights = val_loss, model.get_weights()
+            wait, lr_wait = 0, 0
+        else:
+            wait += 1
+            lr_wait += 1
+            if lr_wait >= lr_patience:
+                lr = float(model.optimizer.learning_rate.numpy())
+                new_lr = max(lr * lr_factor, min_lr)
+                if new_lr < lr:
+                    model.optimizer.learning_rate.assign(new_lr)
+                    print(f"学习率降至 {new_lr:.6f}")
+                lr_wait = 0
+            if wait >= patience:
+                print(f"验证损失 {patience} 轮未改善，提前停止")
+                stop = True
+
+        if checkpointer is not None:
+            save(epoch, batches.n_chunks, (0.0, 0.0), stop)
+        if stop:
+            break
+
+    if checkpointer is not None:
+        checkpointer.flush()
+    if best_weights is not None:
+        model.set_weights(best_weights)
+    return history
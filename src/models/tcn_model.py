@@ -0,0 +1,162 @@
+"""
+TCN增量推理模块
+从训练好的Keras TCN模型中取出权重，用numpy逐根K线推理：
+每个卷积层缓存最近 (kernel_size - 1) * dilation + 1 个输入，新K线到来时只计算一列输出
+"""
+import re
+from typing import List, Optional
+
+import numpy as np
+
+
+def _activation(name: str):
+    if name == 'relu':
+        return lambda x: np.maximum(x, 0.0)
+    if name == 'linear':
+        return lambda x: x
+    raise ValueError(f"Unsupported activation: {name}")
+
+
+class _CausalConvCache:
+    """单个因果膨胀卷积层的输入环形缓存"""
+
+    def __init__(self, layer):
+        kernel, bias = layer.get_weights()
+        config = layer.get_config()
+        dilation = config['dilation_rate']
+        if isinstance(dilation, (tuple, list)):
+            dilation = dilation[0]
+
+        self.kernel = kernel.astype(np.float64)  # (kernel_size, in_channels, out_channels)
+        self.bias = bias.astype(np.float64)
+        self.activation = _activation(config['activation'])
+
+        kernel_size = self.kernel.shape[0]
+        self.span = (kernel_size - 1) * dilation + 1
+        # 第i个卷积核对应 t - (kernel_size - 1 - i) * dilation 时刻的输入
+        self.offsets = (kernel_size - 1 - np.arange(kernel_size)) * dilation
+        self.buffer = np.zeros((self.span, self.kernel.shape[1]))
+        self.pos = -1
+
+        # 展平卷积核，一次矩阵乘完成所有抽头的计算
+        self.flat_kernel = self.kernel.reshape(-1, self.kernel.shape[2])
+
+    def reset(self):
+        self.buffer[:] = 0.0
+        self.pos = -1
+
+    def step(self, x: np.ndarray) -> np.ndarray:
+        self.pos = (self.pos + 1) % self.span
+        self.buffer[self.pos] = x
+        taps = self.buffer[(self.pos - self.offsets) % self.span]
+        return self.activation(taps.reshape(-1) @ self.flat_kernel + self.bias)
+
+
+class _TcnBlock:
+    """残差块：两层因果卷积 + 残差连接"""
+
+    def __init__(self, conv1, conv2, skip=None):
+        self.conv1 = _CausalConvCache(conv1)
+        self.conv2 = _CausalConvCache(conv2)
+        self.skip_kernel = None
+        if skip is not None:
+            kernel, bias = skip.get_weights()
+            self.skip_kernel = kernel[0].astype(np.float64)
+            self.skip_bias = bias.astype(np.float64)
+
+    def reset(self):
+        self.conv1.reset()
+        self.conv2.reset()
+
+    def step(self, x: np.ndarray) -> np.ndarray:
+        h = self.conv2.step(self.conv1.step(x))
+        residual = x @ self.skip_kernel + self.skip_bias if self.skip_kernel is not None else x
+        return np.maximum(h + residual, 0.0)
+
+
+class StreamingTCN:
+    """
+    TCN增量推理器
+    与 PricePredictionModel._build_tcn_model 的结构对应，推理前需先用不少于感受野长度的K线预热
+    """
+
+    def __init__(self, keras_model, target_scaler=None):
+        """
+        :param keras_model: 训练好的TCN模型（层名为 tcn_d{膨胀率}_conv1/conv2/skip）
+        :param target_scaler: 目标变量缩放器，提供时输出反标准化后的价格
+        """
+        self.target_scaler = target_scaler
+        self.blocks: List[_TcnBlock] = []
+
+        layers = {layer.name: layer for layer in keras_model.layers}
+        dilations = sorted({int(m.group(1)) for name in layers
+                            for m in [re.match(r'tcn_d(\d+)_conv1$', name)] if m})
+        if not dilations:
+            raise ValueError("Model has no TCN layers")
+
+        for dilation in dilations:
+            self.blocks.append(_TcnBlock(
+                layers[f'tcn_d{dilation}_conv1'],
+                layers[f'tcn_d{dilation}_conv2'],
+                layers.get(f'tcn_d{dilation}_skip')
+            ))
+
+        # 输出头：最后两层全连接
+        dense_layers = [layer for layer in keras_model.layers if layer.__class__.__name__ == 'Dense']
+        self.head = []
+        for layer in dense_layers:
+            kernel, bias = layer.get_weights()
+            self.head.append((kernel.astype(np.float64), bias.astype(np.float64),
+                              _activation(layer.get_config()['activation'])))
+
+        self.receptive_field = 1 + sum(block.conv1.span - 1 + block.conv2.span - 1 for block in self.blocks)
+        self.steps = 0
+
+    def reset(self):
+        """清空所有层缓存（如换日或断线重连后）"""
+        for block in self.blocks:
+            block.reset()
+        self.steps = 0
+
+    @property
+    def ready(self) -> bool:
+        """是否已积累足够的K线，输出与整窗推理一致"""
+        return self.steps >= self.receptive_field
+
+    def update(self, features: np.ndarray) -> Optional[float]:
+        """
+        输入一根K线的（已标准化）特征向量，返回预测值
+        :param features: shape (n_features,)
+        :return: 预测值，预热未完成时返回None
+        """
+        h = np.asarray(features, dtype=np.float64).reshape(-1)
+        for block in self.blocks:
+            h = block.step(h)
+
+        for kernel, bias, activation in self.head:
+            h = activation(h @ kernel + bias)
+
+        self.steps += 1
+        if not self.ready:
+            return None
+
+        prediction = float(h[0])
+        if self.target_scaler is not None:
+            if hasattr(self.target_scaler, 'scale_') and hasattr(self.target_scaler, 'min_'):
+                # MinMaxScaler 直接按参数反算，避免每根K线调用 inverse_transform 的开销
+                prediction = (prediction - self.target_scaler.min_[0]) / self.target_scaler.scale_[0]
+            else:
+                prediction = float(self.target_scaler.inverse_transform([[prediction]])[0, 0])
+        return prediction
+
+    def warmup(self, window: np.ndarray) -> Optional[float]:
+        """
+        用一段历史特征预热缓存
+        :param window: shape (timesteps, n_features)
+        :return: 最后一根K线的预测值
+        """
+        self.reset()
+        prediction = None
+        for row in window:
+            prediction = self.update(row)
+        return prediction
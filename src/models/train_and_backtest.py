@@ -7,6 +7,7 @@ warnings.filterwarnings('ignore')
 
 from .ml_model import PricePredictionModel
 from src.data.data_processor import DataProcessor
+from src.data.fast_csv import read_tqsdk_csv
 
 
 class ModelTrainerAndBacktester:
@@ -37,18 +38,17 @@ class ModelTrainerAndBacktester:
         file_path = os.path.join(contract_dir, latest_file)
         
         print(f"加载数据文件: {file_path}")
-        df = pd.read_csv(file_path)
-        
-        # 转换时间列为datetime格式
-        df['datetime'] = pd.to_datetime(df['datetime'])
-        df.set_index('datetime', inplace=True)
+        # 时间索引由整数列 datetime_nano 换算，不解析 datetime 字符串列
+        df = read_tqsdk_csv(file_path)
         
         return df
     
-    def convert_to_standard_format(self, df):
+    def convert_to_standard_format(self, df, include_oi=False):
         """
         将数据转换为标准格式，适配data_processor
         :param df: 原始数据
+        :param include_oi: 是否保留 open_oi/close_oi 列（供 src.data.features.oi_flow 使用）；
+                           默认不保留，避免改变已训练模型的特征维度
         :return: 标准格式的DataFrame
         """
         # 找到第一个合约的列名模式（如SHFE.rb2602）
@@ -70,6 +70,11 @@ class ModelTrainerAndBacktester:
         standard_df['close'] = df[f'{contract_prefix}.close']
         standard_df['volume'] = df[f'{contract_prefix}.volume']
         
+        if include_oi:
+            for field in ['open_oi', 'close_oi']:
+                if f'{contract_prefix}.{field}' in df.columns:
+                    standard_df[field] = df[f'{contract_prefix}.{field}']
+        
         return standard_df
     
     def prepare_training_data(self, df, target_col='SHFE.rb2602.close', sequence_length=60):
@@ -288,7 +293,7 @@ def main():
         contract_dir = "./data/rb_1min_2026_01_01_2026_01_26"
         contract_pattern = "SHFE.rb2602"
     
-    model_type = input("请选择模型类型 (lstm/cnn-lstm/random_forest/svm，默认lstm): ").strip() or "lstm"
+    model_type = input("请选择模型类型 (lstm/cnn-lstm/tcn/random_forest/svm，默认lstm): ").strip() or "lstm"
     
     # 训练模型
     result = trainer.train_model(
@@ -0,0 +1,119 @@
+"""
+向量化期货交易环境
+一个对象同时推进 n_envs 个环境，所有环境的观测、动作、奖励都是数组，单步为几次numpy数组运算，
+策略对全部观测做一次批量前向计算即可，不需要逐个环境调用 step。
+动作与 env_trade.FuturesTradingEnv 相同（0-持有, 1-做多, 2-做空），另加 3-平仓；
+奖励为持仓在下一根K线上的对数收益减去换仓成本，按收益率标准差缩放
+"""
+from typing import Dict, List, Sequence
+
+import numpy as np
+
+
+HOLD, LONG, SHORT, FLAT = 0, 1, 2, 3
+
+
+def price_observations(log_returns: np.ndarray, positions: np.ndarray, return_scale: float) -> np.ndarray:
+    """
+    观测：最近 window_size 个对数收益（除以 return_scale）+ 当前仓位
+    :param log_returns: shape (N, window_size)
+    :param positions: shape (N,)
+    """
+    return np.concatenate([log_returns / return_scale, positions[:, None]], axis=1).astype(np.float32)
+
+
+class VecFuturesEnv:
+    """
+    在多段收盘价序列上随机起点采样的向量化环境，回合结束的环境自动重置
+    回合不跨越序列边界（换合约）
+    """
+
+    def __init__(self, closes: Sequence[np.ndarray], n_envs: int = 64, window_size: int = 30,
+                 episode_length: int = 240, transaction_cost: float = 1e-4, n_actions: int = 4,
+                 return_scale: float = None, seed: int = 0):
+        """
+        :param closes: 各合约的收盘价序列
+        :param window_size: 观测中的收益个数
+        :param episode_length: 每回合的K线数
+        :param transaction_cost: 单位换仓成本（收益率，手续费加滑点），反手为2倍
+        :param n_actions: 3 与 FuturesTradingEnv 相同，4 增加平仓动作
+        :param return_scale: 收益缩放系数，默认为样本收益率标准差
+        """
+        if n_actions not in (3, 4):
+            raise ValueError(f"Unsupported n_actions: {n_actions}")
+        self.n_envs = n_envs
+        self.window_size = window_size
+        self.episode_length = episode_length
+        self.transaction_cost = transaction_cost
+        self.n_actions = n_actions
+        self.obs_dim = window_size + 1
+        self.rng = np.random.default_rng(seed)
+
+        # 各序列的对数收益首尾相接，记录每段可作为回合起点的下标范围
+        returns, starts = [], []
+        offset = 0
+        for close in closes:
+            close = np.asarray(close, dtype=np.float64)
+            r = np.diff(np.log(close), prepend=np.log(close[0]))
+            lo, hi = offset + window_size, offset + len(close) - episode_length - 1
+            if hi > lo:
+                starts.append(np.arange(lo, hi))
+            returns.append(r)
+            offset += len(close)
+        if not starts:
+            raise ValueError("No series longer than window_size + episode_length")
+        self.returns = np.concatenate(returns)
+        self.starts = np.concatenate(starts)
+        self.return_scale = float(return_scale or np.std(self.returns[self.starts]) or 1.0)
+        self._window = np.arange(-window_size + 1, 1)
+
+        self.t = np.zeros(n_envs, dtype=np.int64)
+        self.steps = np.zeros(n_envs, dtype=np.int64)
+        self.positions = np.zeros(n_envs, dtype=np.float64)
+        self.episode_pnl = np.zeros(n_envs, dtype=np.float64)
+        self.episode_trades = np.zeros(n_envs, dtype=np.int64)
+
+    def _observe(self) -> np.ndarray:
+        return price_observations(self.returns[self.t[:, None] + self._window], self.positions, self.return_scale)
+
+    def _reset_envs(self, mask: np.ndarray):
+        n = int(mask.sum())
+        self.t[mask] = self.starts[self.rng.integers(0, len(self.starts), n)]
+        self.steps[mask] = 0
+        self.positions[mask] = 0.0
+        self.episode_pnl[mask] = 0.0
+        self.episode_trades[mask] = 0
+
+    def reset(self) -> np.ndarray:
+        self._reset_envs(np.ones(self.n_envs, dtype=np.bool_))
+        return self._observe()
+
+    def step(self, actions: np.ndarray):
+        """
+        :param actions: shape (n_envs,)
+        :return: (观测, 奖励, 是否结束, info)，结束的环境返回的是重置后的新观测；
+                 info['episode_pnl'] / info['episode_trades'] 为本步结束回合的累计收益与换仓次数
+        """
+        actions = np.asarray(actions)
+        target = np.select([actions == LONG, actions == SHORT, actions == FLAT], [1.0, -1.0, 0.0], self.positions)
+        turnover = np.abs(target - self.positions)
+        self.t += 1
+        self.steps += 1
+        pnl = target * self.returns[self.t] - self.transaction_cost * turnover
+        self.positions = target
+        self.episode_pnl += pnl
+        self.episode_trades += turnover > 0
+
+        dones = self.steps >= self.episode_length
+        info: Dict[str, np.ndarray] = {}
+        if dones.any():
+            info['episode_pnl'] = self.episode_pnl[dones].copy()
+            info['episode_trades'] = self.episode_trades[dones].copy()
+            self._reset_envs(dones)
+        return self._observe(), (pnl / self.return_scale).astype(np.float32), dones, info
+
+
+def closes_from_store(store, symbols: List[str] = None) -> List[np.ndarray]:
+    """从K线仓库（BarStore / ResampledBarStore）读取各合约收盘价"""
+    symbols = symbols or store.symbols(include_index=False)
+    return [store.load_arrays(symbol)['close'] for symbol in symbols]
@@ -0,0 +1,203 @@
+"""
+跨合约协方差引擎
+对所有订阅合约的K线收益率增量维护指数加权（EW）均值、协方差矩阵，
+每根K线收盘做一次原地秩1更新；任意两合约的协方差、相关系数、beta均为O(1)读取
+"""
+from datetime import datetime
+from typing import Callable, Dict, List, Optional
+
+import numpy as np
+import pandas as pd
+from numba import njit
+
+
+@njit(cache=True)
+def _ew_update(cov, mean, returns, mask, alpha):
+    """
+    EW均值与协方差的原地秩1更新：
+        diff = r - mean
+        mean += alpha * diff
+        cov = (1 - alpha) * (cov + alpha * diff diff^T)
+    :param mask: 本根K线有行情的合约，无行情的合约收益率按0处理
+    """
+    n = mean.shape[0]
+    diff = np.empty(n)
+    for i in range(n):
+        r = returns[i] if mask[i] else 0.0
+        diff[i] = r - mean[i]
+        mean[i] += alpha * diff[i]
+
+    decay = 1.0 - alpha
+    for i in range(n):
+        di = alpha * diff[i]
+        for j in range(i, n):
+            value = decay * (cov[i, j] + di * diff[j])
+            cov[i, j] = value
+            cov[j, i] = value
+
+
+@njit(cache=True)
+def _ew_batch(cov, mean, returns, mask, alpha):
+    """按时间顺序批量更新（历史数据预热）"""
+    for t in range(returns.shape[0]):
+        _ew_update(cov, mean, returns[t], mask[t], alpha)
+
+
+def bar_returns(prices: pd.DataFrame, symbols: List[str]):
+    """
+    收盘价表 -> 逐K线对数收益率与有效掩码（无K线的合约收益率为0）
+    :return: (returns, mask, 前向填充后的价格表)
+    """
+    prices = prices.reindex(columns=symbols)
+    filled = prices.ffill()
+    returns = np.diff(np.log(filled.values), axis=0)
+    mask = ~np.isnan(returns) & ~np.isnan(prices.values[1:])
+    return np.where(mask, returns, 0.0), mask, filled
+
+
+class EWCovarianceEngine:
+    """
+    指数加权协方差引擎
+    用法：每个合约的K线收盘时调用 update_bar；同一时间戳的K线收齐后（或下一时间戳到来时）做一次矩阵更新
+    """
+
+    def __init__(self, symbols: List[str], halflife: float = 60, min_periods: int = 30):
+        """
+        :param symbols: 合约列表（vt_symbol 或数据文件中的合约代码）
+        :param halflife: 半衰期（K线根数）
+        :param min_periods: 更新次数少于此值时读取结果为NaN
+        """
+        self.symbols = list(symbols)
+        self.index: Dict[str, int] = {symbol: i for i, symbol in enumerate(self.symbols)}
+        self.alpha = 1.0 - np.exp(np.log(0.5) / halflife)
+        self.min_periods = min_periods
+
+        n = len(self.symbols)
+        self.mean = np.zeros(n)
+        self.cov = np.zeros((n, n))
+        self.count = 0
+
+        # 当前时间戳尚未提交的K线
+        self.last_price = np.full(n, np.nan)
+        self.pending_returns = np.zeros(n)
+        self.pending_mask = np.zeros(n, dtype=np.bool_)
+        self.pending_dt: Optional[datetime] = None
+
+        # 每次提交收益率向量后回调 listener(returns, mask)，如组合风险引擎的情景库
+        self.listeners: List[Callable[[np.ndarray, np.ndarray], None]] = []
+
+    # ===== 更新 =====
+    def update_bar(self, bar):
+        """
+        输入一根K线（vnpy BarData）
+        """
+        symbol = bar.vt_symbol if bar.vt_symbol in self.index else bar.symbol
+        self.update_price(symbol, bar.close_price, bar.datetime)
+
+    def update_price(self, symbol: str, close_price: float, dt: datetime):
+        """
+        输入某合约在 dt 时刻的收盘价
+        dt 比待提交的时间戳新时，先提交上一时间戳的收益率向量
+        """
+        i = self.index.get(symbol)
+        if i is None:
+            return
+
+        if self.pending_dt is not None and dt > self.pending_dt:
+            self.commit()
+        self.pending_dt = dt
+
+        last = self.last_price[i]
+        if last > 0 and close_price > 0:
+            self.pending_returns[i] = np.log(close_price / last)
+            self.pending_mask[i] = True
+        self.last_price[i] = close_price
+
+        # 所有合约都已到齐时立即提交，不必等待下一根K线
+        if self.pending_mask.all():
+            self.commit()
+
+    def commit(self):
+        """提交当前时间戳的收益率向量"""
+        if self.pending_mask.any():
+            self.update_returns(self.pending_returns, self.pending_mask)
+        self.pending_returns[:] = 0.0
+        self.pending_mask[:] = False
+        self.pending_dt = None
+
+    def update_returns(self, returns: np.ndarray, mask: np.ndarray = None):
+        """
+        直接输入一根K线的收益率向量
+        :param mask: 有效合约，默认全部有效
+        """
+        if mask is None:
+            mask = np.ones(len(self.symbols), dtype=np.bool_)
+        returns = np.asarray(returns, dtype=np.float64)
+        if self.count == 0:
+            # 与 pandas ewm(adjust=False) 一致，以第一根K线的收益率作为初始均值
+            self.mean[:] = np.where(mask, returns, 0.0)
+        else:
+            _ew_update(self.cov, self.mean, returns, mask, self.alpha)
+        self.count += 1
+        for listener in self.listeners:
+            listener(returns, mask)
+
+    def warmup(self, prices: pd.DataFrame):
+        """
+        用历史收盘价预热
+        :param prices: 以时间为索引、合约为列的收盘价表（缺失值表示该合约此时无K线）
+        """
+        returns, mask, filled = bar_returns(prices, self.symbols)
+        if len(returns) == 0:
+            return
+
+        if self.count == 0:
+            self.mean[:] = returns[0]
+            returns, mask = returns[1:], mask[1:]
+            self.count = 1
+        _ew_batch(self.cov, self.mean, np.ascontiguousarray(returns), np.ascontiguousarray(mask), self.alpha)
+        self.count += len(returns)
+
+        last = filled.iloc[-1].values if len(filled) else self.last_price
+        self.last_price = np.where(np.isnan(last), self.last_price, last)
+
+    # ===== 读取 =====
+    @property
+    def ready(self) -> bool:
+        return self.count >= self.min_periods
+
+    def covariance(self, a: str, b: str) -> float:
+        if not self.ready:
+            return np.nan
+        return self.cov[self.index[a], self.index[b]]
+
+    def volatility(self, symbol: str) -> float:
+        """单根K线收益率的EW标准差"""
+        if not self.ready:
+            return np.nan
+        i = self.index[symbol]
+        return float(np.sqrt(self.cov[i, i]))
+
+    def correlation(self, a: str, b: str) -> float:
+        if not self.ready:
+            return np.nan
+        i, j = self.index[a], self.index[b]
+        denom = np.sqrt(self.cov[i, i] * self.cov[j, j])
+        return self.cov[i, j] / denom if denom > 0 else np.nan
+
+    def beta(self, a: str, b: str) -> float:
+        """a 对 b 的beta：cov(a, b) / var(b)，如近月合约对指数、跨期价差的对冲比例"""
+        if not self.ready:
+            return np.nan
+        i, j = self.index[a], self.index[b]
+        var = self.cov[j, j]
+        return self.cov[i, j] / var if var > 0 else np.nan
+
+    def covariance_matrix(self) -> pd.DataFrame:
+        return pd.DataFrame(self.cov.copy(), index=self.symbols, columns=self.symbols)
+
+    def correlation_matrix(self) -> pd.DataFrame:
+        std = np.sqrt(np.diag(self.cov))
+        with np.errstate(divide='ignore', invalid='ignore'):
+            corr = self.cov / np.outer(std, std)
+        return pd.DataFrame(corr, index=self.symbols, columns=self.symbols)
@@ -1,4 +1,4 @@
-from datetime import date
+from src.utils.trading_day import trading_day
 
 
 class DailyDrawdownRisk:
@@ -6,20 +6,24 @@ class DailyDrawdownRisk:
     日内最大回撤熔断（实盘硬风控）
     """
 
-    def __init__(self, max_daily_loss: float):
+    def __init__(self, max_daily_loss: float, kill_switch=None):
+        """
+        :param kill_switch: 全局熔断开关（KillSwitch），回撤超限时立即触发撤单/平仓
+        """
         self.max_daily_loss = max_daily_loss
+        self.kill_switch = kill_switch
 
         self.trading_enabled = True
         self.day_start_balance = None
-        self.current_day = date.today()
+        self.current_day = trading_day()
 
     def update_account(self, account):
         """
         每次收到账户回报时调用
         """
-        today = date.today()
+        today = trading_day()
 
-        # 新交易日，重置
+        # 新交易日（夜盘开盘时切换，跨零点不重置），重置
         if today != self.current_day:
             self.current_day = today
             self.day_start_balance = account.balance
@@ -34,6 +38,10 @@ class DailyDrawdownRisk:
         drawdown = self.day_start_balance - account.balance
         if drawdown >= self.max_daily_loss:
             self.trading_enabled = False
+            if self.kill_switch is not None:
+                self.kill_switch.trip(f"daily_drawdown {drawdown:.2f}")
 
     def allow_trade(self) -> bool:
+        if self.kill_switch is not None and self.kill_switch.tripped:
+            return False
         return self.trading_enabled
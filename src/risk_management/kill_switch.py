@@ -0,0 +1,293 @@
+"""
+全局熔断开关（kill switch）
+触发后在同一次调用内：
+1. 置位唯一的熔断标志，MainEngine.send_order 入口检查该标志，所有策略/网关的新委托一律拒绝
+2. 停止所有CTA策略的交易，撤销全部本地停止单
+3. 一次遍历撤销 OMS 中所有网关的全部活动委托
+4. 可选：以可成交限价单（对手价外加若干跳，限制在涨跌停内）平掉全部持仓
+触发来源：代码调用 trip()、DailyDrawdownRisk 回撤超限、本地文件、信号（SIGUSR1）、本地TCP端口
+触发到撤单发出、撤单全部确认的延迟写入指标系统（src.utils.metrics）
+"""
+import os
+import signal
+import socket
+import threading
+import time
+from typing import Dict, Optional, Set
+
+from vnpy.event import Event, EventEngine
+from vnpy.trader.constant import Direction, Exchange, Offset, OrderType
+from vnpy.trader.event import EVENT_ORDER
+from vnpy.trader.object import OrderRequest
+
+from src.trading.contract_specs import get_contract_spec
+from src.utils.metrics import METRICS, MetricsRegistry
+
+# 区分平今/平昨的交易所
+_CLOSE_TODAY_EXCHANGES = {Exchange.SHFE, Exchange.INE}
+
+
+def _elapsed_ms(start_ns: int) -> float:
+    return (time.perf_counter_ns() - start_ns) / 1e6
+
+
+class KillSwitch:
+    """
+    用法：
+        kill_switch = KillSwitch(main_engine, event_engine, flatten=True)
+        kill_switch.install()                      # 接管 send_order 入口并监听委托回报
+        kill_switch.watch_file("KILL")             # 文件出现即触发
+        kill_switch.listen_signal()                # kill -USR1 <pid> 触发
+        kill_switch.listen_socket(port=7070)       # echo KILL | nc 127.0.0.1 7070 触发
+    """
+
+    def __init__(self, main_engine, event_engine: EventEngine, flatten: bool = False, slippage_ticks: int = 5,
+                 metrics: MetricsRegistry = None):
+        """
+        :param flatten: 触发后是否平掉全部持仓
+        :param slippage_ticks: 平仓限价相对对手价的跳数
+        """
+        self.main_engine = main_engine
+        self.event_engine = event_engine
+        self.flatten = flatten
+        self.slippage_ticks = slippage_ticks
+        self.metrics = metrics or METRICS
+
+        # 熔断标志：只在 _lock 内由 False 置为 True，读取无需加锁
+        self.tripped = False
+        self.reason = ""
+        self._lock = threading.Lock()
+        # 撤单/平仓状态：触发可能来自监听线程，委托回报在事件线程，二者互斥
+        self._state_lock = threading.RLock()
+        self._send_order = main_engine.send_order
+
+        self.trip_ns = 0
+        self.pending_cancels: Set[str] = set()
+        self.flatten_orders: Dict[str, list] = {}  # 平仓委托号 -> [(vt_symbol, 持仓方向), 未成交量]
+        self.cancel_done_ms: Optional[float] = None
+
+        self._stop = threading.Event()
+        self._threads = []
+
+    # ===== 安装 =====
+    def install(self):
+        """接管 MainEngine.send_order：熔断后拒绝所有新委托（返回空委托号），并监听委托回报"""
+        def guarded_send_order(*args, **kwargs):
+            if self.tripped:
+                return ""
+            return self._send_order(*args, **kwargs)
+
+        self.main_engine.send_order = guarded_send_order
+        self.event_engine.register(EVENT_ORDER, self.process_order_event)
+
+    def allow_trade(self) -> bool:
+        return not self.tripped
+
+    # ===== 触发 =====
+    def trip(self, reason: str = "manual") -> bool:
+        """
+        触发熔断，重复触发无效
+        :param reason: 触发原因，第一个词作为触发来源写入指标标签
+        :return: 本次调用是否完成了触发
+        """
+        start = time.perf_counter_ns()
+        with self._lock:
+            if self.tripped:
+                return False
+            self.tripped = True
+        with self._state_lock:
+            self.trip_ns = start
+            self.reason = reason
+            self._stop_strategies()
+            self._cancel_all()
+            sent_ms = _elapsed_ms(start)
+            if self.flatten:
+                self._flatten()
+            self._check_cancels_done()
+
+        self.metrics.observe('kill_switch_cancel_sent_ms', sent_ms)
+        self.metrics.counter('kill_switch_trips_total', source=reason.split(' ')[0]).inc()
+        self.metrics.gauge('kill_switch_tripped').set(1)
+        print(f"熔断已触发（{reason}）：撤销 {len(self.pending_cancels)} 笔委托，撤单发出耗时 {sent_ms:.3f}ms")
+        return True
+
+    def reset(self):
+        """人工确认后解除熔断"""
+        with self._lock, self._state_lock:
+            self.tripped = False
+            self.reason = ""
+            self.pending_cancels.clear()
+            self.flatten_orders.clear()
+            self.cancel_done_ms = None
+        self.metrics.gauge('kill_switch_tripped').set(0)
+
+    def _stop_strategies(self):
+        """停止CTA策略交易并撤销本地停止单（停止单不经过网关，OMS中没有）"""
+        cta_engine = self.main_engine.get_engine("CtaStrategy")
+        if cta_engine is None:
+            return
+        for strategy in list(cta_engine.strategies.values()):
+            strategy.trading = False
+        for stop_orderid, stop_order in list(cta_engine.stop_orders.items()):
+            strategy = cta_engine.strategies.get(stop_order.strategy_name)
+            if strategy is not None:
+                cta_engine.cancel_local_stop_order(strategy, stop_orderid)
+
+    def _cancel_all(self):
+        """一次遍历撤销所有网关的全部活动委托"""
+        for order in self.main_engine.get_all_active_orders():
+            self._cancel(order)
+
+    def _cancel(self, order):
+        if order.vt_orderid in self.pending_cancels or order.vt_orderid in self.flatten_orders:
+            return
+        self.pending_cancels.add(order.vt_orderid)
+        self.main_engine.cancel_order(order.create_cancel_request(), order.gateway_name)
+
+    # ===== 平仓 =====
+    def _flatten(self):
+        """
+        按持仓发可成交限价平仓单；被挂单冻结的持仓在撤单确认后再平（由 _check_cancels_done 再次调用）
+        冻结量可能已包含本开关的平仓单，也可能尚未更新，取两者较大值扣除；
+        宁可多发（超出持仓的平仓单会被交易所拒绝）也不少平
+        """
+        outstanding: Dict[tuple, float] = {}
+        for key, remaining in self.flatten_orders.values():
+            outstanding[key] = outstanding.get(key, 0) + remaining
+
+        for position in self.main_engine.get_all_positions():
+            key = (position.vt_symbol, position.direction)
+            volume = position.volume - max(position.frozen, outstanding.get(key, 0))
+            if volume <= 0:
+                continue
+            if position.direction == Direction.LONG:
+                direction = Direction.SHORT
+            elif position.direction == Direction.SHORT:
+                direction = Direction.LONG
+            else:
+                continue
+            price = self._marketable_price(position.vt_symbol, direction)
+            if price is None:
+                print(f"熔断平仓：{position.vt_symbol} 无行情，跳过")
+                continue
+
+            # 上期所/能源中心先平昨再平今
+            if position.exchange in _CLOSE_TODAY_EXCHANGES:
+                yd_volume = min(getattr(position, 'yd_volume', 0), volume)
+                legs = [(Offset.CLOSEYESTERDAY, yd_volume), (Offset.CLOSETODAY, volume - yd_volume)]
+            else:
+                legs = [(Offset.CLOSE, volume)]
+
+            for offset, leg_volume in legs:
+                if leg_volume <= 0:
+                    continue
+                req = OrderRequest(symbol=position.symbol, exchange=position.exchange, direction=direction,
+                                   type=OrderType.LIMIT, volume=leg_volume, price=price, offset=offset,
+                                   reference="kill_switch")
+                vt_orderid = self._send_order(req, position.gateway_name)
+                if vt_orderid:
+                    self.flatten_orders[vt_orderid] = [key, leg_volume]
+
+    def _marketable_price(self, vt_symbol: str, direction: Direction) -> Optional[float]:
+        """对手价外加 slippage_ticks 跳，限制在涨跌停价内"""
+        tick = self.main_engine.get_tick(vt_symbol)
+        if tick is None:
+            return None
+        contract = self.main_engine.get_contract(vt_symbol)
+        pricetick = contract.pricetick if contract else get_contract_spec(tick.symbol)['price_tick']
+        if direction == Direction.LONG:
+            price = (tick.ask_price_1 or tick.last_price) + self.slippage_ticks * pricetick
+            return min(price, tick.limit_up) if tick.limit_up else price
+        price = (tick.bid_price_1 or tick.last_price) - self.slippage_ticks * pricetick
+        return max(price, tick.limit_down) if tick.limit_down else price
+
+    # ===== 回报 =====
+    def process_order_event(self, event: Event):
+        """熔断后：触发前已发出、回报晚到的委托立即撤销；全部撤单确认后记录延迟并补平冻结的持仓"""
+        if not self.tripped:
+            return
+        order = event.data
+        with self._state_lock:
+            flatten = self.flatten_orders.get(order.vt_orderid)
+            if flatten is not None:
+                flatten[1] = order.volume - order.traded if order.is_active() else 0
+            elif order.is_active():
+                self._cancel(order)
+            else:
+                self.pending_cancels.discard(order.vt_orderid)
+            self._check_cancels_done()
+
+    def _check_cancels_done(self):
+        if self.cancel_done_ms is not None or self.pending_cancels:
+            return
+        self.cancel_done_ms = _elapsed_ms(self.trip_ns)
+        self.metrics.observe('kill_switch_cancel_done_ms', self.cancel_done_ms)
+        print(f"熔断撤单全部确认，耗时 {self.cancel_done_ms:.3f}ms")
+        if self.flatten:
+            self._flatten()
+
+    # ===== 本地触发 =====
+    def watch_file(self, path: str = "KILL", interval: float = 0.01):
+        """轮询文件，出现即触发（文件内容记入触发原因）"""
+        def run():
+            while not self._stop.wait(interval):
+                if os.path.exists(path):
+                    try:
+                        with open(path, 'r', encoding='utf-8') as f:
+                            reason = f"file {f.read().strip()}".strip()
+                        detect_ms = (time.time() - os.path.getmtime(path)) * 1000
+                        self.metrics.observe('kill_switch_detect_ms', detect_ms, source='file')
+                    except OSError:
+                        reason = 'file'
+                    self.trip(reason)
+                    return
+
+        self._start_thread(run, "kill-switch-file")
+
+    def listen_signal(self, signum: int = signal.SIGUSR1):
+        """收到信号即触发（只能在主线程调用）"""
+        signal.signal(signum, lambda s, frame: self.trip(f"signal {s}"))
+
+    def listen_socket(self, port: int = 7070, host: str = "127.0.0.1"):
+        """
+        本地TCP端口，按行接收命令：
+        KILL [原因] -> 触发并回复撤单发出耗时；STATUS -> 回复当前状态
+        """
+        server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        server.bind((host, port))
+        server.listen(1)
+        server.settimeout(0.2)
+
+        def run():
+            with server:
+                while not self._stop.is_set():
+                    try:
+                        conn, _ = server.accept()
+                    except socket.timeout:
+                        continue
+                    with conn:
+                        line = conn.makefile('r', encoding='utf-8').readline().strip()
+                        command, _, reason = line.partition(' ')
+                        if command.upper() == 'KILL':
+                            tripped = self.trip(f"socket {reason}".strip())
+                            reply = f"OK {_elapsed_ms(self.trip_ns):.3f}ms" if tripped else "ALREADY"
+                        elif command.upper() == 'STATUS':
+                            reply = f"{'TRIPPED ' + self.reason if self.tripped else 'ARMED'} " \
+                                    f"pending={len(self.pending_cancels)}"
+                        else:
+                            reply = f"Unsupported command: {command}"
+                        conn.sendall((reply + "\n").encode('utf-8'))
+
+        self._start_thread(run, "kill-switch-socket")
+
+    def _start_thread(self, target, name: str):
+        thread = threading.Thread(target=target, name=name, daemon=True)
+        thread.start()
+        self._threads.append(thread)
+
+    def close(self):
+        self._stop.set()
+        for thread in self._threads:
+            thread.join(timeout=1)
+        self._threads.clear()
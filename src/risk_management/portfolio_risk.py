@@ -0,0 +1,280 @@
+"""
+组合风险引擎
+在 EWCovarianceEngine 之上增量维护组合 VaR / ES 与压力损失：
+- 参数法：sigma^2 = e^T C e，e 为各合约名义敞口（持仓 * 价格 * 合约乘数），
+  缓存 C e，单个合约敞口变化时 O(n) 更新，K线提交（协方差变化）时 O(n^2) 重算
+- 历史模拟：最近 scenario_window 根K线的收益率向量组成环形情景库，缓存每个情景下当前组合的盈亏，
+  敞口变化时整列向量化更新 O(W)，新K线只替换一个情景 O(n)，VaR/ES 由 np.partition 取尾部 O(W)
+- 压力测试：自定义冲击情景（各合约涨跌幅）下的组合损失
+所有结果为单根K线周期的损失（正数为亏损），horizon > 1 时按 sqrt(horizon) 放大
+"""
+import math
+from typing import Dict, List
+
+import numpy as np
+import pandas as pd
+from scipy.stats import norm
+
+from src.utils.direction import direction_sign
+from src.data.bar_store import symbol_to_code
+from src.risk_management.covariance_engine import EWCovarianceEngine, bar_returns
+from src.trading.contract_specs import get_contract_spec
+from src.utils.metrics import METRICS, MetricsRegistry
+
+
+def _contract_code(symbol: str) -> str:
+    """合约规格查询代码，兼容 SHFE.rb2605 与 vnpy 的 rb2605.SHFE"""
+    code = symbol_to_code(symbol)
+    if code.isalpha() and code.isupper() and '.' in symbol:
+        return symbol.split('.')[0]
+    return code
+
+
+class PortfolioRiskEngine:
+    """
+    用法：K线收盘调用 update_bar（同时更新协方差、情景库与盯市价格），
+    成交或持仓变化调用 on_trade / set_position，下单前用 what_if 预估成交后的风险
+    """
+
+    def __init__(self, symbols: List[str], confidence: float = 0.99, scenario_window: int = 500,
+                 halflife: float = 60, min_periods: int = 30, horizon: int = 1,
+                 specs: Dict[str, dict] = None, cov_engine: EWCovarianceEngine = None):
+        """
+        :param symbols: 合约列表
+        :param confidence: VaR置信度
+        :param scenario_window: 历史模拟的情景数（K线根数）
+        :param halflife: 协方差半衰期（K线根数），传入 cov_engine 时忽略
+        :param min_periods: 协方差与情景库的最少K线数，不足时对应结果为NaN
+        :param horizon: 风险期限（K线根数）
+        :param specs: {合约: {'size', ...}}，默认取 contract_specs
+        :param cov_engine: 复用已有的协方差引擎（合约列表以其为准）
+        """
+        self.cov_engine = cov_engine or EWCovarianceEngine(symbols, halflife, min_periods)
+        self.symbols = self.cov_engine.symbols
+        self.index = self.cov_engine.index
+        self.confidence = confidence
+        self.min_periods = min_periods
+        self.horizon_scale = math.sqrt(horizon)
+        self.z = norm.ppf(confidence)
+        self.es_factor = norm.pdf(self.z) / (1.0 - confidence)
+
+        specs = specs or {}
+        self.size = np.array([(specs.get(s) or get_contract_spec(_contract_code(s)))['size']
+                              for s in self.symbols], dtype=np.float64)
+
+        n = len(self.symbols)
+        self.position = np.zeros(n)
+        self.price = np.full(n, np.nan)
+        self.exposure = np.zeros(n)  # 名义敞口
+        self.cov_exposure = np.zeros(n)  # C e
+        self.variance = 0.0  # e^T C e
+
+        # 环形情景库：简单收益率，未写入的行为0
+        self.scenarios = np.zeros((scenario_window, n))
+        self.scenario_pnl = np.zeros(scenario_window)  # 各情景下当前组合的盈亏
+        self.n_scenarios = 0
+        self.cursor = 0
+
+        self.stress_names: List[str] = []
+        self.stress_shocks = np.zeros((0, n))
+
+        self.cov_engine.listeners.append(self._on_returns)
+
+    # ===== 行情 =====
+    def update_bar(self, bar):
+        """输入一根K线（vnpy BarData）"""
+        symbol = bar.vt_symbol if bar.vt_symbol in self.index else bar.symbol
+        self.update_price(symbol, bar.close_price, bar.datetime)
+
+    def update_price(self, symbol: str, close_price: float, dt):
+        """K线收盘价：更新协方差与情景库（时间戳提交时），并按收盘价盯市"""
+        self.cov_engine.update_price(symbol, close_price, dt)
+        self.mark(symbol, close_price)
+
+    def update_tick(self, tick):
+        """tick 只盯市，不进入协方差与情景库"""
+        self.mark(tick.symbol, tick.last_price)
+
+    def mark(self, symbol: str, price: float):
+        i = self.index.get(symbol)
+        if i is None or not price > 0:
+            return
+        self.price[i] = price
+        self._set_exposure(i, self.position[i] * price * self.size[i])
+
+    def warmup(self, prices: pd.DataFrame):
+        """
+        用历史收盘价预热协方差与情景库
+        :param prices: 以时间为索引、合约为列的收盘价表
+        """
+        self.cov_engine.warmup(prices)
+        returns, mask, filled = bar_returns(prices, self.symbols)
+        for r, m in zip(returns[-len(self.scenarios):], mask[-len(self.scenarios):]):
+            self._push_scenario(r, m)
+        if len(filled):
+            last = filled.iloc[-1].values
+            self.price = np.where(np.isnan(last), self.price, last)
+        self.exposure = np.where(np.isnan(self.price), 0.0, self.position * self.price * self.size)
+        self._recompute()
+
+    # ===== 持仓 =====
+    def set_position(self, symbol: str, volume: float):
+        """设置净持仓（多为正、空为负，单位：手）"""
+        i = self.index.get(symbol)
+        if i is None:
+            return
+        self.position[i] = volume
+        if self.price[i] > 0:
+            self._set_exposure(i, volume * self.price[i] * self.size[i])
+
+    def on_trade(self, trade):
+        """成交回报（vnpy TradeData）：按方向累加净持仓"""
+        symbol = trade.vt_symbol if getattr(trade, 'vt_symbol', None) in self.index else trade.symbol
+        i = self.index.get(symbol)
+        if i is None:
+            return
+        self.set_position(symbol, self.position[i] + direction_sign(trade.direction) * trade.volume)
+
+    # ===== 增量更新 =====
+    def _set_exposure(self, i: int, value: float):
+        delta = value - self.exposure[i]
+        if delta == 0.0:
+            return
+        column = self.cov_engine.cov[:, i]
+        self.variance += delta * (2.0 * self.cov_exposure[i] + delta * column[i])
+        self.cov_exposure += delta * column
+        self.scenario_pnl += delta * self.scenarios[:, i]
+        self.exposure[i] = value
+
+    def _push_scenario(self, returns: np.ndarray, mask: np.ndarray):
+        row = self.scenarios[self.cursor]
+        np.expm1(returns, out=row)
+        row[~mask] = 0.0
+        self.scenario_pnl[self.cursor] = row @ self.exposure
+        self.cursor = (self.cursor + 1) % len(self.scenarios)
+        self.n_scenarios = min(self.n_scenarios + 1, len(self.scenarios))
+
+    def _on_returns(self, returns: np.ndarray, mask: np.ndarray):
+        """协方差引擎提交一根K线后：写入情景库，协方差已变化，重算 C e"""
+        self._push_scenario(returns, mask)
+        self.cov_exposure = self.cov_engine.cov @ self.exposure
+        self.variance = float(self.exposure @ self.cov_exposure)
+
+    def _recompute(self):
+        """全量重算（预热后，或消除增量更新的累计误差）"""
+        self.cov_exposure = self.cov_engine.cov @ self.exposure
+        self.variance = float(self.exposure @ self.cov_exposure)
+        self.scenario_pnl[:] = self.scenarios @ self.exposure
+
+    # ===== 读取 =====
+    def _parametric(self, variance: float):
+        if not self.cov_engine.ready:
+            return np.nan, np.nan
+        sigma = math.sqrt(max(variance, 0.0)) * self.horizon_scale
+        return self.z * sigma, self.es_factor * sigma
+
+    def _historical(self, pnl: np.ndarray):
+        k = len(pnl)
+        if k < self.min_periods:
+            return np.nan, np.nan
+        m = max(1, int(math.ceil(k * (1.0 - self.confidence))))
+        tail = np.partition(-pnl, k - m)[k - m:]
+        return tail.min() * self.horizon_scale, tail.mean() * self.horizon_scale
+
+    def parametric_var(self) -> float:
+        return self._parametric(self.variance)[0]
+
+    def parametric_es(self) -> float:
+        return self._parametric(self.variance)[1]
+
+    def historical_var(self) -> float:
+        return self._historical(self.scenario_pnl[:self.n_scenarios])[0]
+
+    def historical_es(self) -> float:
+        return self._historical(self.scenario_pnl[:self.n_scenarios])[1]
+
+    @staticmethod
+    def _combine(parametric: float, historical: float, method: str) -> float:
+        if method == 'parametric':
+            return parametric
+        if method == 'historical':
+            return historical
+        if method == 'max':
+            return np.nanmax([parametric, historical]) if not (np.isnan(parametric) and np.isnan(historical)) \
+                else np.nan
+        raise ValueError(f"Unsupported VaR method: {method}")
+
+    def var(self, method: str = 'max') -> float:
+        """
+        组合VaR
+        :param method: 'parametric'、'historical' 或 'max'（两者取大，保守）
+        """
+        return self._combine(self.parametric_var(), self.historical_var(), method)
+
+    def es(self, method: str = 'max') -> float:
+        return self._combine(self.parametric_es(), self.historical_es(), method)
+
+    def what_if(self, symbol: str, volume: float, method: str = 'max') -> Dict[str, float]:
+        """
+        预估净持仓变化 volume 手后的VaR/ES，不改变引擎状态
+        :return: {'var', 'es', 'var_change'}
+        """
+        i = self.index[symbol]
+        delta = volume * self.price[i] * self.size[i] if self.price[i] > 0 else 0.0
+        variance = self.variance + delta * (2.0 * self.cov_exposure[i] + delta * self.cov_engine.cov[i, i])
+        k = self.n_scenarios
+        pnl = self.scenario_pnl[:k] + delta * self.scenarios[:k, i]
+        p_var, p_es = self._parametric(variance)
+        h_var, h_es = self._historical(pnl)
+        var = self._combine(p_var, h_var, method)
+        return {'var': var, 'es': self._combine(p_es, h_es, method), 'var_change': var - self.var(method)}
+
+    def component_var(self) -> pd.Series:
+        """参数法VaR的欧拉分解，各合约之和等于组合VaR"""
+        var = self.parametric_var()
+        if not var > 0:
+            return pd.Series(np.nan, index=self.symbols)
+        sigma = math.sqrt(self.variance)
+        return pd.Series(self.exposure * self.cov_exposure / sigma * self.z * self.horizon_scale,
+                         index=self.symbols)
+
+    # ===== 压力测试 =====
+    def add_stress_scenario(self, name: str, shocks: Dict[str, float]):
+        """
+        :param shocks: {合约: 涨跌幅}，如 {'rb2605': -0.05, 'hc2605': -0.06}，未列出的合约不变
+        """
+        row = np.zeros(len(self.symbols))
+        for symbol, shock in shocks.items():
+            row[self.index[symbol]] = shock
+        if name in self.stress_names:
+            self.stress_shocks[self.stress_names.index(name)] = row
+        else:
+            self.stress_names.append(name)
+            self.stress_shocks = np.vstack([self.stress_shocks, row])
+
+    def stress_losses(self) -> pd.Series:
+        """各压力情景与历史最差情景下的组合损失"""
+        losses = pd.Series(-(self.stress_shocks @ self.exposure), index=self.stress_names, dtype=np.float64)
+        if self.n_scenarios:
+            losses['historical_worst'] = -self.scenario_pnl[:self.n_scenarios].min()
+        return losses
+
+    # ===== 输出 =====
+    def snapshot(self) -> Dict[str, float]:
+        stress = self.stress_losses()
+        return {
+            'parametric_var': self.parametric_var(),
+            'parametric_es': self.parametric_es(),
+            'historical_var': self.historical_var(),
+            'historical_es': self.historical_es(),
+            'gross_exposure': float(np.abs(self.exposure).sum()),
+            'net_exposure': float(self.exposure.sum()),
+            'worst_stress_loss': float(stress.max()) if len(stress) else np.nan,
+            'scenarios': self.n_scenarios,
+        }
+
+    def publish(self, metrics: MetricsRegistry = None, **labels):
+        """把当前风险写入指标系统（gauge：risk_<名称>）"""
+        metrics = metrics or METRICS
+        for name, value in self.snapshot().items():
+            metrics.gauge(f'risk_{name}', **labels).set(value)
@@ -1,24 +1,79 @@
+from src.utils.direction import direction_sign
+from src.utils.trading_day import trading_day
+
+
 class RiskManager:
 
     def __init__(
         self,
         max_pos: int = 1,
-        max_daily_loss: float = 5000
+        max_daily_loss: float = 5000,
+        risk_engine=None,
+        max_var: float = None,
+        var_method: str = 'max'
     ):
+        """
+        :param max_daily_loss: 当日亏损上限（相对当日首次检查时的账户权益）
+        :param risk_engine: 组合风险引擎（PortfolioRiskEngine），提供时按组合VaR限额
+        :param max_var: 组合VaR上限
+        :param var_method: 'parametric'、'historical' 或 'max'
+        """
         self.max_pos = max_pos
         self.max_daily_loss = max_daily_loss
         self.trading_enabled = True
 
+        self.risk_engine = risk_engine
+        self.max_var = max_var
+        self.var_method = var_method
+
+        self.day_start_balance = None
+        self.current_day = None
+
+    def daily_loss(self, account) -> float:
+        """
+        当日亏损 = 当日起始权益 - 当前权益
+        （balance - available 是占用的保证金，不是亏损）
+        按交易日切换：夜盘跨零点时仍属同一交易日，止损不会在午夜被重置
+        """
+        today = trading_day()
+        if today != self.current_day or self.day_start_balance is None:
+            self.current_day = today
+            self.day_start_balance = account.balance
+            self.trading_enabled = True
+        return self.day_start_balance - account.balance
+
+    def var_limit_ok(self, var: float) -> bool:
+        """VaR在限额内；未配置限额或风险引擎尚未预热完成时不限制"""
+        return self.max_var is None or not var > self.max_var
+
     def check(self, strategy) -> bool:
+        if self.daily_loss(strategy.cta_engine.get_account()) > self.max_daily_loss:
+            self.trading_enabled = False
+
         if not self.trading_enabled:
             return False
 
         if abs(strategy.pos) >= self.max_pos:
             return False
 
-        if strategy.cta_engine.get_account().balance - \
-           strategy.cta_engine.get_account().available > self.max_daily_loss:
-            self.trading_enabled = False
+        if self.risk_engine is not None and not self.var_limit_ok(self.risk_engine.var(self.var_method)):
             return False
 
         return True
+
+    def check_order(self, order) -> bool:
+        """
+        委托前/委托回报时检查（vnpy OrderData）：
+        按未成交部分预估成交后的组合VaR，超限且增加风险的委托不通过，减仓委托总是放行
+        """
+        if not self.trading_enabled:
+            return False
+        if self.risk_engine is None or self.max_var is None:
+            return True
+
+        symbol = order.vt_symbol if order.vt_symbol in self.risk_engine.index else order.symbol
+        if symbol not in self.risk_engine.index:
+            return True
+        volume = direction_sign(order.direction) * (order.volume - order.traded)
+        after = self.risk_engine.what_if(symbol, volume, self.var_method)
+        return self.var_limit_ok(after['var']) or after['var_change'] <= 0
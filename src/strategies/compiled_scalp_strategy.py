@@ -0,0 +1,138 @@
+from vnpy_ctastrategy import CtaTemplate
+from vnpy.trader.constant import Offset
+from vnpy.trader.utility import BarGenerator
+import pandas as pd
+
+from src.strategies.strategy_dsl import StrategySpec, ACTION_LONG, ACTION_SHORT, ACTION_EXIT
+
+
+def scalp_spec(orderflow: bool = True) -> StrategySpec:
+    """
+    均线剥头皮策略定义（对应 ScalpingOrderflowStrategy 的规则）
+    :param orderflow: 是否包含盘口过滤（价差、买卖盘不平衡），K线数据回测时没有盘口，设为False
+    """
+    inputs = ['open', 'high', 'low', 'close', 'volume', 'prediction']
+    long_rule = "ema_fast > ema_slow and prediction >= prediction_threshold"
+    short_rule = "ema_fast < ema_slow and prediction <= -prediction_threshold"
+    if orderflow:
+        inputs += ['bid_price_1', 'ask_price_1', 'bid_volume_1', 'ask_volume_1']
+        book = " and ask_price_1 - bid_price_1 <= max_spread_tick * price_tick"
+        long_rule += book + " and bid_volume_1 >= ask_volume_1 * order_imbalance_ratio"
+        short_rule += book + " and ask_volume_1 >= bid_volume_1 * order_imbalance_ratio"
+
+    return StrategySpec(
+        inputs=tuple(inputs),
+        indicators={
+            'ema_fast': ('ewm', 'close', 5),
+            'ema_slow': ('ewm', 'close', 20),
+        },
+        params={
+            'take_profit_tick': 2,
+            'stop_loss_tick': 3,
+            'trailing_percent': 0.0,
+            'cooldown_seconds': 10,
+            'max_trades_per_day': 50,
+            'order_imbalance_ratio': 1.5,
+            'max_spread_tick': 2,
+            'prediction_threshold': 0.0,
+        },
+        entry_long=long_rule,
+        entry_short=short_rule,
+    )
+
+
+def _cst_ns(dt) -> int:
+    """vnpy 的带时区时间 -> 北京时间纳秒（与 BarStore 一致）"""
+    ts = pd.Timestamp(dt)
+    if ts.tz is not None:
+        ts = ts.tz_convert('Asia/Shanghai').tz_localize(None)
+    return ts.value
+
+
+class CompiledScalpStrategy(CtaTemplate):
+    """
+    编译版剥头皮策略
+    规则由 scalp_spec 定义，实盘与回测/参数扫描执行同一个编译内核（src.strategies.strategy_dsl）
+    """
+
+    author = "justseven"
+
+    # ===== 参数（与 scalp_spec 的参数同名）=====
+    take_profit_tick = 2
+    stop_loss_tick = 3
+    trailing_percent = 0.0
+    cooldown_seconds = 10
+    max_trades_per_day = 50
+    order_imbalance_ratio = 1.5
+    max_spread_tick = 2
+    prediction_threshold = 0.0
+    fixed_size = 1
+
+    # ===== 变量 =====
+    prediction = 0.0  # 外部模型的预测值，可由其他模块写入
+
+    def __init__(self, cta_engine, strategy_name, vt_symbol, setting):
+        super().__init__(cta_engine, strategy_name, vt_symbol, setting)
+
+        self.bg = BarGenerator(self.on_bar)
+        self.last_tick = None
+        self.runner = None
+
+    def on_init(self):
+        self.write_log("编译版剥头皮策略初始化")
+        spec = scalp_spec(orderflow=True)
+        contract = self.cta_engine.main_engine.get_contract(self.vt_symbol)
+        compiled = spec.compile(price_tick=contract.pricetick, size=contract.size)
+        params = {name: getattr(self, name) for name in spec.params}
+        self.runner = compiled.runner(params)
+        self.load_bar(50)
+
+    def on_tick(self, tick):
+        self.last_tick = tick
+        self.bg.update_tick(tick)
+
+    def on_bar(self, bar):
+        tick = self.last_tick
+        values = {
+            'open': bar.open_price,
+            'high': bar.high_price,
+            'low': bar.low_price,
+            'close': bar.close_price,
+            'volume': bar.volume,
+            'prediction': self.prediction,
+            'bid_price_1': tick.bid_price_1 if tick else bar.close_price,
+            'ask_price_1': tick.ask_price_1 if tick else bar.close_price,
+            'bid_volume_1': tick.bid_volume_1 if tick else 0,
+            'ask_volume_1': tick.ask_volume_1 if tick else 0,
+        }
+
+        # 加载历史K线时只预热指标
+        if not self.trading:
+            self.runner.warmup(values)
+            return
+
+        action = self.runner.update(values, _cst_ns(bar.datetime))
+        price = bar.close_price
+        if action == ACTION_LONG:
+            self.buy(price, self.fixed_size)
+        elif action == ACTION_SHORT:
+            self.short(price, self.fixed_size)
+        elif action == ACTION_EXIT:
+            if self.pos > 0:
+                self.sell(price, abs(self.pos))
+            elif self.pos < 0:
+                self.cover(price, abs(self.pos))
+
+    def on_order(self, order):
+        """委托结束（含未成交撤单）后按实际持仓校正状态机"""
+        if not order.is_active():
+            self.runner.sync(self.pos)
+
+    def on_trade(self, trade):
+        """开仓成交后以实际成交价作为止盈止损的成本价"""
+        if trade.offset == Offset.OPEN:
+            self.runner.sync(self.pos, trade.price)
+        else:
+            self.runner.sync(self.pos)
+        self.write_log(f"成交记录: {trade.direction.value} {trade.offset.value} "
+                       f"{trade.volume}手 @ {trade.price}")
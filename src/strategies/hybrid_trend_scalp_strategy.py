@@ -4,6 +4,9 @@ from vnpy.trader.constant import Interval
 import time
 import numpy as np
 from src.models.ml_model import PricePredictionModel
+from src.models.inference_gate import InferenceGate
+from src.risk_management.daily_drawdown_risk import DailyDrawdownRisk
+from src.trading.sessions import is_trading_time
 import os
 
 
@@ -29,6 +32,8 @@ class HybridTrendScalpStrategy(CtaTemplate):
     order_imbalance_ratio = 1.5
     max_spread_tick = 2
 
+    max_daily_loss = 5000  # 日内回撤上限（相对当日起始权益）
+
     # AI模型相关参数
     model_prediction_threshold = 0.005  # 预测阈值，当AI预测涨跌幅超过此值时才考虑交易
 
@@ -56,6 +61,17 @@ class HybridTrendScalpStrategy(CtaTemplate):
         self.am_15min = ArrayManager(100)
 
         self.last_tick = None
+        self.pricetick = None
+        self.drawdown_risk = DailyDrawdownRisk(self.max_daily_loss)
+
+        # 推理门控：同一根K线只推理一次，且只在可能开仓时推理
+        self.inference_gate = InferenceGate()
+        self.inference_gate.add_filter("position", lambda: self.trading and self.pos == 0)
+        self.inference_gate.add_filter("risk", self.check_risk)
+        self.inference_gate.add_filter("cooldown", self.check_cooldown)
+        self.inference_gate.add_filter("session", lambda: is_trading_time(self.symbol, self.last_tick.datetime))
+        self.inference_gate.add_filter("spread", self.check_spread)
+        self.inference_gate.add_filter("activity", lambda: self.am.volume[-1] > 0)
 
         # 初始化AI模型
         self.initialize_ai_model()
@@ -90,16 +106,41 @@ class HybridTrendScalpStrategy(CtaTemplate):
         if self.ai_model and self.am.inited:
             self.update_trend_with_ai(tick)
 
+    def check_cooldown(self) -> bool:
+        """交易次数与冷却时间检查"""
+        if self.trade_count >= self.max_trades_per_day:
+            return False
+        return time.time() - self.last_trade_time >= self.cooldown_seconds
+
+    def check_risk(self) -> bool:
+        """风控状态检查：日内回撤超限后当日不再推理和开仓"""
+        accounts = self.cta_engine.main_engine.get_all_accounts()
+        if accounts:
+            self.drawdown_risk.update_account(accounts[0])
+        return self.drawdown_risk.allow_trade()
+
+    def check_spread(self) -> bool:
+        """价差检查（推理门控与开仓前的盘口过滤共用）"""
+        if self.pricetick is None:
+            contract = self.cta_engine.main_engine.get_contract(self.vt_symbol)
+            self.pricetick = contract.pricetick
+        tick = self.last_tick
+        return tick.ask_price_1 - tick.bid_price_1 <= self.max_spread_tick * self.pricetick
+
     def update_trend_with_ai(self, tick):
         """使用AI模型更新趋势方向"""
         try:
             # 使用历史数据进行预测
             if len(self.am.close) > 60:  # 确保有足够的数据进行预测
-                # 获取最近60个收盘价作为输入
-                recent_prices = self.am.close[-60:].tolist()
-                
-                # 进行预测
-                prediction = self.ai_model.predict([recent_prices])
+                # 输入窗口只在K线完成时变化，以K线计数作为版本号缓存预测结果
+                inferences = self.inference_gate.inferences
+                prediction = self.inference_gate.run("price_prediction", self.symbol, self.am.count,
+                                                     self.predict_trend)
+                if prediction is None:
+                    # 过滤器拒绝时没有当前K线的预测，清除旧趋势，避免按过期预测开仓
+                    self.trend_direction = 0
+                    self.prediction_confidence = 0
+                    return
                 
                 # 更新趋势方向和置信度
                 if prediction[0] > self.model_prediction_threshold:
@@ -112,11 +153,21 @@ class HybridTrendScalpStrategy(CtaTemplate):
                     self.trend_direction = 0  # 无明确趋势
                     self.prediction_confidence = 0
 
-                self.write_log(f"AI预测: 方向{'看涨' if self.trend_direction == 1 else '看跌' if self.trend_direction == -1 else '无趋势'}, "
-                              f"置信度: {self.prediction_confidence:.4f}, 预测值: {prediction[0]:.4f}")
+                # 只在实际推理后输出日志，缓存命中时不重复输出
+                if self.inference_gate.inferences != inferences:
+                    self.write_log(f"AI预测: 方向{'看涨' if self.trend_direction == 1 else '看跌' if self.trend_direction == -1 else '无趋势'}, "
+                                  f"置信度: {self.prediction_confidence:.4f}, 预测值: {prediction[0]:.4f}")
         except Exception as e:
             self.write_log(f"❌ AI模型预测时发生错误: {e}")
 
+    def predict_trend(self):
+        """执行一次模型推理，只由推理门控在新K线上调用"""
+        # 获取最近60个收盘价作为输入
+        recent_prices = self.am.close[-60:].tolist()
+        
+        # 进行预测
+        return self.ai_model.predict([recent_prices])
+
     def check_orderflow(self, direction: str) -> bool:
         """
         direction: "long" / "short"
@@ -125,12 +176,9 @@ class HybridTrendScalpStrategy(CtaTemplate):
             return False
 
         tick = self.last_tick
-        contract = self.cta_engine.main_engine.get_contract(self.vt_symbol)
-        pricetick = contract.pricetick
 
         # 1️⃣ 价差过滤
-        spread = tick.ask_price_1 - tick.bid_price_1
-        if spread > self.max_spread_tick * pricetick:
+        if not self.check_spread():
             return False
 
         # 2️⃣ 买卖盘不平衡
@@ -175,6 +223,10 @@ class HybridTrendScalpStrategy(CtaTemplate):
 
         # ===== 开仓 =====
         if self.pos == 0:
+            # 风控触发后趋势方向可能是触发前的旧值，不再开仓
+            if not self.drawdown_risk.allow_trade():
+                return
+
             # AI模型判断趋势方向，剥头皮策略寻找入场时机
             if (self.trend_direction == 1 and ema_fast > ema_slow and self.check_orderflow("long")):
                 self.buy(price, self.fixed_size)
@@ -1,7 +1,7 @@
 from vnpy_ctastrategy import CtaTemplate
-from data.features.feature_pipeline import FeaturePipeline
-from models.lstm_model import LSTMTrendModel
-from risk.risk_manager import RiskManager
+from src.data.features.feature_pipeline import FeaturePipeline
+from src.models.base_model import create_model
+from src.risk_management.risk_manager import RiskManager
 
 class ModelCtaStrategy(CtaTemplate):
 
@@ -15,10 +15,11 @@ class ModelCtaStrategy(CtaTemplate):
 
         self.feature_pipeline = FeaturePipeline(window=30)
 
-        self.model = LSTMTrendModel(
-            model_path=setting["model_path"],
-            scaler_path=setting.get("scaler_path")
-        )
+        # model_name 为 src.models.base_model 注册表中的名称，默认LSTM趋势模型
+        model_kwargs = {"model_path": setting["model_path"]}
+        if setting.get("scaler_path"):
+            model_kwargs["scaler_path"] = setting["scaler_path"]
+        self.model = create_model(setting.get("model_name", "lstm_trend"), **model_kwargs)
 
         self.risk = RiskManager(
             max_pos=setting.get("max_pos", 1),
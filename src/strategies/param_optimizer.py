@@ -0,0 +1,478 @@
+"""
+策略参数贝叶斯优化
+在编译策略（src.strategies.strategy_dsl）的回测内核上搜索参数：
+- 代理模型：高斯过程（Matern 5/2、各维独立长度尺度），超参数按边际似然拟合
+- 采集函数：带约束的期望改进 EI × P(回撤 <= 上限) × P(交易次数 >= 下限)，约束各用一个高斯过程建模；
+  每轮用 Kriging Believer（以预测均值作为虚拟观测）选出一批候选，整批并行评估
+- 并行评估：特征矩阵只计算一次放入共享内存，工作进程挂载后调用 sweep_arrays，不复制数据
+- 检查点：每批评估后异步保存全部试验（src.models.checkpoint），中断后可从检查点继续
+"""
+import multiprocessing as mp
+import os
+import queue as queue_lib
+import time
+from typing import Dict, List, Optional, Sequence, Tuple, Union
+
+import numpy as np
+import pandas as pd
+from scipy.linalg import cho_factor, cho_solve
+from scipy.optimize import minimize
+from scipy.stats import norm, qmc
+
+from src.models.checkpoint import AsyncCheckpointer, load_checkpoint
+from src.models.distributed_training import SharedArrays
+from src.strategies.strategy_dsl import SWEEP_COLUMNS, CompiledStrategy, StrategySpec
+
+
+# ===== 搜索空间 =====
+class SearchSpace:
+    """
+    参数搜索空间，内部统一映射到单位超立方体
+    定义：{参数名: (下限, 上限)} 或 (下限, 上限, 'int' / 'log' / 'float')
+    """
+
+    def __init__(self, bounds: Dict[str, tuple]):
+        self.names = list(bounds)
+        self.low = np.array([float(b[0]) for b in bounds.values()])
+        self.high = np.array([float(b[1]) for b in bounds.values()])
+        self.kinds = [b[2] if len(b) > 2 else 'float' for b in bounds.values()]
+        for name, kind, low in zip(self.names, self.kinds, self.low):
+            if kind not in ('float', 'int', 'log'):
+                raise ValueError(f"Unsupported parameter kind: {kind}")
+            if kind == 'log' and low <= 0:
+                raise ValueError(f"Log-scaled parameter {name} needs a positive lower bound")
+        self.bounds = dict(bounds)
+
+    @property
+    def dim(self) -> int:
+        return len(self.names)
+
+    def decode(self, unit: np.ndarray) -> np.ndarray:
+        """单位超立方体 -> 参数值"""
+        unit = np.clip(np.atleast_2d(unit), 0.0, 1.0)
+        values = np.empty_like(unit)
+        for j, kind in enumerate(self.kinds):
+            if kind == 'log':
+                values[:, j] = np.exp(np.log(self.low[j]) + unit[:, j] * (np.log(self.high[j]) - np.log(self.low[j])))
+            else:
+                values[:, j] = self.low[j] + unit[:, j] * (self.high[j] - self.low[j])
+            if kind == 'int':
+                values[:, j] = np.round(values[:, j])
+        return values
+
+    def snap(self, unit: np.ndarray) -> np.ndarray:
+        """整数参数吸附到取整后的坐标，使同一组参数只对应一个点"""
+        return self.encode(self.decode(unit))
+
+    def encode(self, values: np.ndarray) -> np.ndarray:
+        """参数值 -> 单位超立方体"""
+        values = np.atleast_2d(values).astype(np.float64)
+        unit = np.empty_like(values)
+        for j, kind in enumerate(self.kinds):
+            if kind == 'log':
+                unit[:, j] = (np.log(values[:, j]) - np.log(self.low[j])) / (np.log(self.high[j]) - np.log(self.low[j]))
+            else:
+                unit[:, j] = (values[:, j] - self.low[j]) / (self.high[j] - self.low[j])
+        return unit
+
+
+# ===== 高斯过程 =====
+def _matern52(a: np.ndarray, b: np.ndarray, lengthscales: np.ndarray, variance: float) -> np.ndarray:
+    d = (a[:, None, :] - b[None, :, :]) / lengthscales
+    r = np.sqrt(np.maximum((d * d).sum(-1), 0.0))
+    s5r = np.sqrt(5.0) * r
+    return variance * (1.0 + s5r + 5.0 / 3.0 * r * r) * np.exp(-s5r)
+
+
+class GaussianProcess:
+    """标准化目标值上的GP回归"""
+
+    def __init__(self, dim: int):
+        # theta = [log 长度尺度 * dim, log 信号方差, log 噪声方差]
+        self.theta = np.r_[np.full(dim, np.log(0.3)), 0.0, np.log(1e-2)]
+        self.bounds = [(np.log(0.01), np.log(5.0))] * dim + [(np.log(0.05), np.log(20.0)), (np.log(1e-6), 0.0)]
+
+    def _unpack(self, theta):
+        dim = len(theta) - 2
+        return np.exp(theta[:dim]), np.exp(theta[dim]), np.exp(theta[dim + 1])
+
+    def _neg_log_likelihood(self, theta, x, y):
+        lengthscales, variance, noise = self._unpack(theta)
+        k = _matern52(x, x, lengthscales, variance) + (noise + 1e-8) * np.eye(len(x))
+        try:
+            factor = cho_factor(k, lower=True)
+        except np.linalg.LinAlgError:
+            return 1e10
+        alpha = cho_solve(factor, y)
+        return 0.5 * y @ alpha + np.log(np.diag(factor[0])).sum()
+
+    def fit(self, x: np.ndarray, y: np.ndarray, optimize: bool = True):
+        self.x = np.asarray(x, dtype=np.float64)
+        y = np.asarray(y, dtype=np.float64)
+        self.y_mean = y.mean()
+        self.y_std = y.std() if y.std() > 0 else 1.0
+        self.y = (y - self.y_mean) / self.y_std
+        if optimize and len(x) > 2:
+            # 从上次的超参数出发（热启动），另加一个默认起点防止陷入局部最优
+            starts = [self.theta, np.r_[np.full(x.shape[1], np.log(0.3)), 0.0, np.log(1e-2)]]
+            best = None
+            for start in starts:
+                result = minimize(self._neg_log_likelihood, start, args=(self.x, self.y), method='L-BFGS-B',
+                                  bounds=self.bounds, options={'maxiter': 100})
+                if best is None or result.fun < best.fun:
+                    best = result
+            self.theta = best.x
+        self._factorize()
+        return self
+
+    def _factorize(self):
+        lengthscales, variance, noise = self._unpack(self.theta)
+        k = _matern52(self.x, self.x, lengthscales, variance) + (noise + 1e-8) * np.eye(len(self.x))
+        self.factor = cho_factor(k, lower=True)
+        self.alpha = cho_solve(self.factor, self.y)
+
+    def add_fantasy(self, x: np.ndarray, y_scaled: np.ndarray):
+        """追加虚拟观测（标准化尺度），不重新拟合超参数"""
+        self.x = np.vstack([self.x, x])
+        self.y = np.r_[self.y, y_scaled]
+        self._factorize()
+
+    def predict(self, x: np.ndarray, scaled: bool = False) -> Tuple[np.ndarray, np.ndarray]:
+        """:return: (均值, 标准差)，scaled 为True时返回标准化尺度"""
+        lengthscales, variance, _ = self._unpack(self.theta)
+        k_star = _matern52(x, self.x, lengthscales, variance)
+        mean = k_star @ self.alpha
+        v = cho_solve(self.factor, k_star.T)
+        var = np.maximum(variance - (k_star * v.T).sum(1), 1e-12)
+        std = np.sqrt(var)
+        if scaled:
+            return mean, std
+        return mean * self.y_std + self.y_mean, std * self.y_std
+
+
+# ===== 并行评估 =====
+def _worker_entry(spec: StrategySpec, price_tick: float, size: float, shared_spec: dict, close_at_end: bool,
+                  threads: int, tasks, results):
+    """工作进程：挂载共享特征矩阵，循环评估参数矩阵"""
+    import numba
+    numba.set_num_threads(threads)
+    compiled = spec.compile(price_tick, size)
+    shared = SharedArrays.attach(shared_spec)
+    try:
+        features, times = shared['features'], shared['times']
+        while True:
+            task = tasks.get()
+            if task is None:
+                break
+            key, matrix = task
+            results.put((key, compiled.sweep_arrays(features, times, matrix, close_at_end)))
+    finally:
+        shared.close()
+
+
+class _Evaluator:
+    """参数矩阵评估：n_workers 为0时在本进程内并行（numba prange），否则分块交给工作进程"""
+
+    def __init__(self, compiled: CompiledStrategy, features: np.ndarray, times: np.ndarray, n_workers: int,
+                 close_at_end: bool):
+        self.compiled = compiled
+        self.n_workers = n_workers
+        self.close_at_end = close_at_end
+        self.processes = []
+        if n_workers == 0:
+            self.features, self.times = features, times
+            return
+
+        ctx = mp.get_context('spawn')
+        self.shared = SharedArrays.create({'features': features, 'times': times})
+        self.tasks, self.results = ctx.Queue(), ctx.Queue()
+        threads = max(1, (os.cpu_count() or 1) // n_workers)
+        self.processes = [ctx.Process(target=_worker_entry,
+                                      args=(compiled.spec, compiled.price_tick, compiled.size, self.shared.spec,
+                                            close_at_end, threads, self.tasks, self.results), daemon=True)
+                          for _ in range(n_workers)]
+        for p in self.processes:
+            p.start()
+
+    def __call__(self, matrix: np.ndarray) -> np.ndarray:
+        if self.n_workers == 0:
+            return self.compiled.sweep_arrays(self.features, self.times, matrix, self.close_at_end)
+
+        chunks = np.array_split(np.arange(len(matrix)), min(self.n_workers, len(matrix)))
+        for i, rows in enumerate(chunks):
+            self.tasks.put((i, np.ascontiguousarray(matrix[rows])))
+        out = np.empty((len(matrix), len(SWEEP_COLUMNS)))
+        for _ in chunks:
+            while True:
+                try:
+                    i, result = self.results.get(timeout=5)
+                    break
+                except queue_lib.Empty:
+                    dead = [p for p in self.processes if not p.is_alive()]
+                    if dead:
+                        raise RuntimeError(f"optimizer worker exited with code {dead[0].exitcode}")
+            out[chunks[i]] = result
+        return out
+
+    def close(self):
+        if not self.processes:
+            return
+        for _ in self.processes:
+            self.tasks.put(None)
+        for p in self.processes:
+            p.join(timeout=10)
+            if p.is_alive():
+                p.terminate()
+        self.processes = []
+        self.shared.close()
+
+
+# ===== 优化器 =====
+class BayesianOptimizer:
+    """
+    用法：
+        compiled = scalp_spec(orderflow=False).compile(price_tick=1, size=10)
+        optimizer = BayesianOptimizer(compiled, store.load_arrays('SHFE.rb2605'),
+                                      {'take_profit_tick': (1, 20, 'int'), 'stop_loss_tick': (1, 20, 'int'),
+                                       'prediction_threshold': (1e-5, 1e-2, 'log')},
+                                      max_drawdown=5000, min_trades=30, n_workers=4, checkpoint_dir='studies/rb')
+        trials = optimizer.run(300)
+        best = optimizer.best()
+    多进程评估（n_workers > 0）时调用方脚本需要 if __name__ == '__main__' 保护
+    """
+
+    def __init__(self, compiled: CompiledStrategy, data: Union[pd.DataFrame, Dict[str, np.ndarray]],
+                 space: Union[SearchSpace, Dict[str, tuple]], objective: str = 'pnl',
+                 max_drawdown: float = None, min_trades: float = None, fixed_params: Dict[str, float] = None,
+                 batch_size: int = 8, n_initial: int = None, n_candidates: int = 2048, n_workers: int = 0,
+                 close_at_end: bool = True, checkpoint_dir: str = None, resume: bool = True, seed: int = 0):
+        """
+        :param objective: 最大化的指标，SWEEP_COLUMNS 之一
+        :param max_drawdown: 最大回撤上限（金额）
+        :param min_trades: 最少交易次数
+        :param fixed_params: 不参与搜索的参数（如 slippage_tick）
+        :param batch_size: 每批并行评估的参数组数
+        :param n_initial: 初始Sobol采样数，默认 2*维数+2 向上取整到 batch_size 的倍数
+        :param n_candidates: 每次选点时评估采集函数的候选点数
+        :param n_workers: 工作进程数，0为本进程内评估
+        :param checkpoint_dir: 检查点目录，提供时每批评估后保存
+        :param resume: 检查点目录中已有试验时从中继续
+        """
+        if objective not in SWEEP_COLUMNS:
+            raise ValueError(f"Unsupported objective: {objective}")
+        self.compiled = compiled
+        self.space = space if isinstance(space, SearchSpace) else SearchSpace(space)
+        for name in self.space.names:
+            if name not in compiled.param_index:
+                raise ValueError(f"Unknown strategy parameter: {name}")
+        self.objective = objective
+        self.max_drawdown = max_drawdown
+        self.min_trades = min_trades
+        self.fixed_params = dict(fixed_params or {})
+        self.batch_size = batch_size
+        # 初始采样默认凑满整批
+        self.n_initial = n_initial or -(-(2 * self.space.dim + 2) // batch_size) * batch_size
+        self.n_candidates = n_candidates
+        self.n_workers = n_workers
+        self.close_at_end = close_at_end
+        self.rng = np.random.default_rng(seed)
+        self.sobol = qmc.Sobol(self.space.dim, scramble=True, seed=seed)
+
+        self.features = compiled.features(data)
+        self.times = compiled._times(data)
+
+        # 试验记录：单位超立方体坐标与回测指标
+        self.x = np.zeros((0, self.space.dim))
+        self.y = np.zeros((0, len(SWEEP_COLUMNS)))
+        self.batch = np.zeros(0, dtype=np.int64)
+        self.eval_time = 0.0
+
+        self.checkpoint_dir = checkpoint_dir
+        self.checkpointer = AsyncCheckpointer(checkpoint_dir, keep=2) if checkpoint_dir else None
+        if checkpoint_dir and resume:
+            self._restore()
+
+        self.gp_objective = GaussianProcess(self.space.dim)
+        self.gp_drawdown = GaussianProcess(self.space.dim)
+        self.gp_trades = GaussianProcess(self.space.dim)
+
+    # ===== 检查点 =====
+    def _signature(self) -> dict:
+        return {'space': self.space.bounds, 'objective': self.objective, 'fixed_params': self.fixed_params,
+                'param_names': self.compiled.param_names, 'n_rows': len(self.times)}
+
+    def _save(self):
+        if self.checkpointer is None:
+            return
+        n_batches = int(self.batch.max()) + 1 if len(self.batch) else 0
+        self.checkpointer.save(f'batch-{n_batches:05d}', {'x': [self.x], 'y': [self.y], 'batch': [self.batch]},
+                               {'signature': self._signature(), 'rng': self.rng.bit_generator.state,
+                                'sobol_drawn': self.sobol.num_generated, 'eval_time': self.eval_time})
+
+    def _restore(self):
+        checkpoint = load_checkpoint(self.checkpoint_dir)
+        if checkpoint is None:
+            return
+        meta = checkpoint['meta']
+        if meta['signature'] != self._signature():
+            raise ValueError(f"Checkpoint in {self.checkpoint_dir} belongs to a different study")
+        self.x = checkpoint['arrays']['x'][0]
+        self.y = checkpoint['arrays']['y'][0]
+        self.batch = checkpoint['arrays']['batch'][0]
+        self.rng.bit_generator.state = meta['rng']
+        self.sobol.fast_forward(meta['sobol_drawn'])
+        self.eval_time = meta['eval_time']
+        print(f"从检查点 {checkpoint['tag']} 恢复 {len(self.x)} 次试验")
+
+    # ===== 约束 =====
+    def _feasible(self, y: np.ndarray) -> np.ndarray:
+        ok = np.isfinite(y[:, SWEEP_COLUMNS.index(self.objective)])
+        if self.max_drawdown is not None:
+            ok &= y[:, SWEEP_COLUMNS.index('max_drawdown')] <= self.max_drawdown
+        if self.min_trades is not None:
+            ok &= y[:, SWEEP_COLUMNS.index('trades')] >= self.min_trades
+        return ok
+
+    def _objective_values(self) -> np.ndarray:
+        """目标值，无法计算（如无交易时的平均每笔盈亏）的记为已有结果的最小值"""
+        values = self.y[:, SWEEP_COLUMNS.index(self.objective)].copy()
+        finite = np.isfinite(values)
+        values[~finite] = values[finite].min() if finite.any() else 0.0
+        return values
+
+    # ===== 选点 =====
+    def _new_points(self, unit: np.ndarray) -> np.ndarray:
+        """
+        吸附整数参数后去重，并去掉已评估过的参数组合（回测是确定性的，重复评估没有信息）
+        """
+        unit = self.space.snap(unit)
+        seen = {tuple(row) for row in np.round(self.x, 9)}
+        keep = []
+        for i, row in enumerate(np.round(unit, 9)):
+            key = tuple(row)
+            if key not in seen:
+                seen.add(key)
+                keep.append(i)
+        return unit[keep]
+
+    def _candidates(self) -> np.ndarray:
+        """随机候选 + 当前最优若干点附近的局部扰动，均为未评估过的参数组合"""
+        candidates = [self.rng.random((self.n_candidates, self.space.dim))]
+        feasible = self._feasible(self.y)
+        if feasible.any():
+            values = np.where(feasible, self._objective_values(), -np.inf)
+            top = self.x[np.argsort(values)[-5:]]
+            local = top[self.rng.integers(len(top), size=self.n_candidates // 4)]
+            local = local + self.rng.normal(0.0, 0.05, local.shape)
+            candidates.append(np.clip(local, 0.0, 1.0))
+        return self._new_points(np.vstack(candidates))
+
+    def _feasibility_probability(self, x: np.ndarray) -> np.ndarray:
+        prob = np.ones(len(x))
+        if self.max_drawdown is not None:
+            mean, std = self.gp_drawdown.predict(x)
+            prob *= norm.cdf((self.max_drawdown - mean) / std)
+        if self.min_trades is not None:
+            mean, std = self.gp_trades.predict(x)
+            prob *= norm.cdf((mean - np.log1p(self.min_trades)) / std)
+        return prob
+
+    def _propose(self, n: int) -> np.ndarray:
+        """带约束EI + Kriging Believer 选出一批互不相同的新点，候选耗尽时可能少于n个"""
+        values = self._objective_values()
+        self.gp_objective.fit(self.x, values)
+        if self.max_drawdown is not None:
+            self.gp_drawdown.fit(self.x, self.y[:, SWEEP_COLUMNS.index('max_drawdown')])
+        if self.min_trades is not None:
+            self.gp_trades.fit(self.x, np.log1p(self.y[:, SWEEP_COLUMNS.index('trades')]))
+
+        feasible = self._feasible(self.y)
+        candidates = self._candidates()
+        feasibility = self._feasibility_probability(candidates)
+        best = (values[feasible].max() - self.gp_objective.y_mean) / self.gp_objective.y_std \
+            if feasible.any() else None
+
+        chosen = []
+        for _ in range(min(n, len(candidates))):
+            mean, std = self.gp_objective.predict(candidates, scaled=True)
+            if best is None:
+                # 尚无可行解时先找可行区域
+                score = feasibility
+            else:
+                z = (mean - best) / std
+                score = ((mean - best) * norm.cdf(z) + std * norm.pdf(z)) * feasibility
+            i = int(np.argmax(score))
+            chosen.append(candidates[i])
+            self.gp_objective.add_fantasy(candidates[i:i + 1], mean[i:i + 1])
+            candidates = np.delete(candidates, i, axis=0)
+            feasibility = np.delete(feasibility, i)
+        return np.array(chosen).reshape(-1, self.space.dim)
+
+    # ===== 主循环 =====
+    def _param_sets(self, unit: np.ndarray) -> List[Dict[str, float]]:
+        values = self.space.decode(unit)
+        return [{**self.fixed_params, **{name: int(v) if kind == 'int' else float(v)
+                                         for name, kind, v in zip(self.space.names, self.space.kinds, row)}}
+                for row in values]
+
+    def run(self, n_evaluations: int) -> pd.DataFrame:
+        """
+        评估到总共 n_evaluations 组参数为止（包括从检查点恢复的试验）
+        :return: 全部试验
+        """
+        evaluator = _Evaluator(self.compiled, self.features, self.times, self.n_workers, self.close_at_end)
+        start = time.time()
+        try:
+            while len(self.x) < n_evaluations:
+                n = min(self.batch_size, n_evaluations - len(self.x))
+                t0 = time.perf_counter()
+                unit = np.empty((0, self.space.dim))
+                if len(self.x) < self.n_initial:
+                    unit = self._new_points(self.sobol.random(min(n, self.n_initial - len(self.x))))
+                if len(unit) == 0:
+                    unit = self._propose(n)
+                if len(unit) == 0:
+                    print("搜索空间内的参数组合已全部评估")
+                    break
+                n = len(unit)
+                t1 = time.perf_counter()
+                result = evaluator(self.compiled.param_matrix(self._param_sets(unit)))
+                self.eval_time += time.perf_counter() - t1
+
+                batch_id = int(self.batch.max()) + 1 if len(self.batch) else 0
+                self.x = np.vstack([self.x, unit])
+                self.y = np.vstack([self.y, result])
+                self.batch = np.r_[self.batch, np.full(n, batch_id)]
+                self._save()
+
+                feasible = self._feasible(self.y)
+                best = self._objective_values()[feasible].max() if feasible.any() else np.nan
+                print(f"第{batch_id + 1}批: 已评估 {len(self.x)}/{n_evaluations}，可行 {feasible.sum()}，"
+                      f"最优{self.objective} {best:.2f}，选点 {t1 - t0:.2f}s，评估 {time.perf_counter() - t1:.2f}s")
+        finally:
+            evaluator.close()
+            if self.checkpointer is not None:
+                self.checkpointer.flush()
+        print(f"优化完成: {len(self.x)} 次评估，用时 {time.time() - start:.1f}s")
+        return self.trials()
+
+    def close(self):
+        if self.checkpointer is not None:
+            self.checkpointer.close()
+
+    # ===== 结果 =====
+    def trials(self) -> pd.DataFrame:
+        frame = pd.DataFrame(self.space.decode(self.x) if len(self.x) else np.zeros((0, self.space.dim)),
+                             columns=self.space.names)
+        frame[SWEEP_COLUMNS] = self.y
+        frame['feasible'] = self._feasible(self.y)
+        frame['batch'] = self.batch
+        return frame
+
+    def best(self) -> Optional[Dict[str, float]]:
+        """最优可行参数（含固定参数），没有可行解时返回None"""
+        feasible = self._feasible(self.y)
+        if not feasible.any():
+            return None
+        values = np.where(feasible, self._objective_values(), -np.inf)
+        return self._param_sets(self.x[int(np.argmax(values))])[0]
@@ -7,6 +7,7 @@ import os
 import logging
 from src.models.ml_model import PricePredictionModel
 from src.data.data_processor import DataProcessor
+from src.trading.tca import TCARecorder
 
 
 class PredictiveTradingStrategy(CtaTemplate):
@@ -57,6 +58,10 @@ class PredictiveTradingStrategy(CtaTemplate):
         self.window_size = 60    # 用于预测的历史窗口大小
         self.min_history_size = 100  # 最小历史数据量
         
+        # 交易成本分析：记录每笔委托从决策到成交的价格与延迟
+        self.tca = TCARecorder(strategy=strategy_name)
+        self.tca_symbol = vt_symbol.split('.')[0]
+        
         # 初始化模型
         self.init_model()
         
@@ -98,11 +103,13 @@ class PredictiveTradingStrategy(CtaTemplate):
 
     def on_stop(self):
         """策略停止"""
+        self.tca.flush()
         self.write_log("策略停止")
 
     def on_tick(self, tick: TickData):
         """行情推送"""
         self.last_price = tick.last_price
+        self.tca.on_tick(tick)
         
         # 更新价格历史
         if len(self.price_history) >= self.window_size:
@@ -191,30 +198,42 @@ class PredictiveTradingStrategy(CtaTemplate):
             # 预测方向性交易
             if expected_return > self.prediction_threshold and self.pos == 0:
                 # 预测上涨且幅度超过阈值，开多仓
-                self.buy(self.last_price + 1, actual_size)
+                self.send_tracked(self.buy, 1, self.last_price + 1, actual_size)
                 self.entry_price = self.last_price
                 self.write_log(f"预测上涨 {expected_return:.2%}，开多仓: {actual_size}手")
             elif expected_return > self.prediction_threshold and self.pos < 0:
                 # 预测上涨，平空仓再开多仓
-                self.cover(self.last_price + 1, abs(self.pos))
-                self.buy(self.last_price + 1, actual_size)
+                self.send_tracked(self.cover, 1, self.last_price + 1, abs(self.pos))
+                self.send_tracked(self.buy, 1, self.last_price + 1, actual_size)
                 self.entry_price = self.last_price
                 self.write_log(f"预测上涨 {expected_return:.2%}，平空开多: {actual_size}手")
             elif expected_return < -self.prediction_threshold and self.pos == 0:
                 # 预测下跌且幅度超过阈值，开空仓
-                self.short(self.last_price - 1, actual_size)
+                self.send_tracked(self.short, -1, self.last_price - 1, actual_size)
                 self.entry_price = self.last_price
                 self.write_log(f"预测下跌 {expected_return:.2%}，开空仓: {actual_size}手")
             elif expected_return < -self.prediction_threshold and self.pos > 0:
                 # 预测下跌，平多仓再开空仓
-                self.sell(self.last_price - 1, self.pos)
-                self.short(self.last_price - 1, actual_size)
+                self.send_tracked(self.sell, -1, self.last_price - 1, self.pos)
+                self.send_tracked(self.short, -1, self.last_price - 1, actual_size)
                 self.entry_price = self.last_price
                 self.write_log(f"预测下跌 {expected_return:.2%}，平多开空: {actual_size}手")
         
         # 更新跟踪止损/止盈
         self.update_trailing_stop()
 
+    def send_tracked(self, send, side: int, price: float, volume: float):
+        """
+        发单并登记交易成本分析，决策价为发单前的最新价
+        :param send: self.buy / self.sell / self.short / self.cover
+        :param side: 1 买 / -1 卖
+        """
+        record = self.tca.decide(self.tca_symbol, side, volume, self.last_price)
+        self.tca.before_send(record)
+        vt_orderids = send(price, volume)
+        self.tca.on_send(record, vt_orderids, price)
+        return vt_orderids
+    
     def update_trailing_stop(self):
         """更新跟踪止损"""
         if self.pos > 0:  # 持有多头仓位
@@ -225,7 +244,7 @@ class PredictiveTradingStrategy(CtaTemplate):
             # 计算跟踪止损价（价格上涨后回调一定百分比则卖出）
             trailing_stop = self.highest_price * (1 - self.trailing_percent / 100)
             if self.last_price < trailing_stop and self.pos > 0:
-                self.sell(self.last_price - 1, abs(self.pos))
+                self.send_tracked(self.sell, -1, self.last_price - 1, abs(self.pos))
                 self.write_log(f"多头跟踪止损触发，平仓价格: {self.last_price:.2f}")
                 
         elif self.pos < 0:  # 持有空头仓位
@@ -236,11 +255,12 @@ class PredictiveTradingStrategy(CtaTemplate):
             # 计算跟踪止损价（价格下跌后反弹一定百分比则买平）
             trailing_stop = self.lowest_price * (1 + self.trailing_percent / 100)
             if self.last_price > trailing_stop and self.pos < 0:
-                self.cover(self.last_price + 1, abs(self.pos))
+                self.send_tracked(self.cover, 1, self.last_price + 1, abs(self.pos))
                 self.write_log(f"空头跟踪止损触发，买平价格: {self.last_price:.2f}")
 
     def on_order(self, order: OrderData):
         """委托推送"""
+        self.tca.on_order(order)
         if order.is_active():
             self.write_log(f"委托状态: {order.vt_orderid}, 状态: {order.status}, 价格: {order.price}, 数量: {order.volume}")
         else:
@@ -248,6 +268,7 @@ class PredictiveTradingStrategy(CtaTemplate):
 
     def on_trade(self, trade: TradeData):
         """成交推送"""
+        self.tca.on_trade(trade)
         self.write_log(f"成交信息: {trade.vt_symbol}, 方向: {trade.direction}, "
                       f"开平: {trade.offset}, 价格: {trade.price}, 数量: {trade.volume}")
         
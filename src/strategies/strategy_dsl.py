@@ -0,0 +1,524 @@
+"""
+策略描述语言（DSL）
+用声明式的 StrategySpec 描述一个单合约策略：
+- inputs / indicators：输入列与指标定义，由 IndicatorGraph 编译为指标内核（批量与流式结果一致）
+- params：可调参数及默认值，规则中按名称引用
+- entry_long / entry_short / exit_long / exit_short：规则表达式（Python语法的子集），如
+  "ema_fast > ema_slow and bid_volume_1 >= ask_volume_1 * order_imbalance_ratio"
+- 规则中 pos 为当前持仓方向（-1/0/1），price_tick 为最小变动价位
+- 内置的止盈/止损（跳）、移动止损（百分比）、冷却时间、每日最大交易次数、最长持仓K线数
+规则编译为逆波兰指令表，与持仓状态机一起由同一个numba函数 _step 逐事件执行：
+实盘 StrategyRunner 每个事件调用一次，回测 backtest 对数组逐行调用，参数扫描 sweep 对成千上万组参数并行调用，
+三者语义完全一致
+"""
+import ast
+from dataclasses import dataclass, field
+from typing import Dict, List, Sequence, Union
+
+import numpy as np
+import pandas as pd
+from numba import njit, prange
+
+from src.data.features.indicator_graph import IndicatorGraph
+
+# ===== 规则指令 =====
+R_FEATURE = 0   # 压入特征列
+R_PARAM = 1     # 压入参数
+R_CONST = 2     # 压入常数
+R_POS = 3       # 压入当前持仓方向（-1/0/1）
+R_ADD = 4
+R_SUB = 5
+R_MUL = 6
+R_DIV = 7
+R_GT = 8
+R_GE = 9
+R_LT = 10
+R_LE = 11
+R_EQ = 12
+R_NE = 13
+R_AND = 14
+R_OR = 15
+R_NOT = 16
+R_NEG = 17
+R_ABS = 18
+
+_BINARY_OPS = {ast.Add: R_ADD, ast.Sub: R_SUB, ast.Mult: R_MUL, ast.Div: R_DIV}
+_COMPARE_OPS = {ast.Gt: R_GT, ast.GtE: R_GE, ast.Lt: R_LT, ast.LtE: R_LE, ast.Eq: R_EQ, ast.NotEq: R_NE}
+
+# 规则顺序
+RULES = ('entry_long', 'entry_short', 'exit_long', 'exit_short')
+
+# 内置参数，固定占用参数向量的前几位
+BUILTIN_PARAMS = {
+    'take_profit_tick': 0.0,    # 止盈跳数，0为不启用
+    'stop_loss_tick': 0.0,      # 止损跳数，0为不启用
+    'trailing_percent': 0.0,    # 移动止损：从持仓期间最优价回撤的百分比，0为不启用
+    'cooldown_seconds': 0.0,    # 两次开仓的最小间隔
+    'max_trades_per_day': 0.0,  # 每个交易日最多开仓次数，0为不限制
+    'max_hold_bars': 0.0,       # 最长持仓事件数，0为不限制
+    'slippage_tick': 0.0,       # 每次成交的滑点与手续费（跳）
+}
+_P_TP, _P_SL, _P_TRAIL, _P_COOLDOWN, _P_MAX_TRADES, _P_MAX_HOLD, _P_SLIP = range(7)
+
+# 动作
+ACTION_NONE = 0
+ACTION_LONG = 1
+ACTION_SHORT = -1
+ACTION_EXIT = 2
+
+# 状态向量
+S_POS, S_ENTRY, S_BEST, S_LAST_ENTRY, S_TRADES_TODAY, S_DAY, S_HELD, S_REALIZED, S_PEAK, S_MAX_DD, \
+    S_TRADES, S_WINS, S_GROSS_WIN, S_GROSS_LOSS = range(14)
+N_STATE = 14
+
+# 参数扫描结果列
+SWEEP_COLUMNS = ['pnl', 'trades', 'win_rate', 'max_drawdown', 'profit_factor', 'avg_trade']
+
+_NS = 1_000_000_000
+_DAY_NS = 86400 * _NS
+_NIGHT_SHIFT_NS = 3 * 3600 * _NS
+
+
+@njit(cache=True)
+def _trading_day(t_ns):
+    """交易日编号：夜盘（21:00起）归入下一交易日，周五夜盘归入下周一"""
+    day = (t_ns + _NIGHT_SHIFT_NS) // _DAY_NS
+    weekday = (day + 3) % 7  # 1970-01-01 为周四，0 为周一
+    if weekday == 5:
+        day += 2
+    elif weekday == 6:
+        day += 1
+    return day
+
+
+@njit(cache=True)
+def _eval_rule(codes, args, vals, start, end, feat, params, pos, stack):
+    """执行一条规则的指令表，空规则为False"""
+    if start == end:
+        return False
+    top = 0
+    for k in range(start, end):
+        code = codes[k]
+        if code == R_FEATURE:
+            stack[top] = feat[args[k]]
+            top += 1
+        elif code == R_PARAM:
+            stack[top] = params[args[k]]
+            top += 1
+        elif code == R_CONST:
+            stack[top] = vals[k]
+            top += 1
+        elif code == R_POS:
+            stack[top] = pos
+            top += 1
+        elif code == R_NOT:
+            stack[top - 1] = 0.0 if stack[top - 1] != 0.0 else 1.0
+        elif code == R_NEG:
+            stack[top - 1] = -stack[top - 1]
+        elif code == R_ABS:
+            stack[top - 1] = abs(stack[top - 1])
+        else:
+            b = stack[top - 1]
+            a = stack[top - 2]
+            top -= 1
+            if code == R_ADD:
+                r = a + b
+            elif code == R_SUB:
+                r = a - b
+            elif code == R_MUL:
+                r = a * b
+            elif code == R_DIV:
+                r = a / b
+            elif code == R_GT:
+                r = 1.0 if a > b else 0.0
+            elif code == R_GE:
+                r = 1.0 if a >= b else 0.0
+            elif code == R_LT:
+                r = 1.0 if a < b else 0.0
+            elif code == R_LE:
+                r = 1.0 if a <= b else 0.0
+            elif code == R_EQ:
+                r = 1.0 if a == b else 0.0
+            elif code == R_NE:
+                r = 1.0 if a != b else 0.0
+            elif code == R_AND:
+                r = 1.0 if (a != 0.0 and a == a) and (b != 0.0 and b == b) else 0.0
+            else:
+                r = 1.0 if (a != 0.0 and a == a) or (b != 0.0 and b == b) else 0.0
+            stack[top - 1] = r
+    result = stack[top - 1]
+    return result == result and result != 0.0
+
+
+@njit(cache=True)
+def _close(state, price, tick, size, slip):
+    pos = state[S_POS]
+    pnl = (pos * (price - state[S_ENTRY]) - slip * tick) * size
+    state[S_REALIZED] += pnl
+    state[S_TRADES] += 1
+    if pnl > 0:
+        state[S_WINS] += 1
+        state[S_GROSS_WIN] += pnl
+    else:
+        state[S_GROSS_LOSS] -= pnl
+    state[S_POS] = 0.0
+
+
+@njit(cache=True)
+def _step(feat, t_ns, price, params, codes, args, vals, starts, tick, size, state, stack):
+    """
+    处理一个事件（一根K线或一个tick），返回动作
+    成交假设：按本事件价格立即成交，开仓与平仓各计 slippage_tick 跳成本；同一事件平仓后不再开仓
+    """
+    day = _trading_day(t_ns)
+    if day != state[S_DAY]:
+        state[S_DAY] = day
+        state[S_TRADES_TODAY] = 0.0
+
+    action = ACTION_NONE
+    pos = state[S_POS]
+    slip = params[_P_SLIP]
+
+    if pos != 0.0:
+        state[S_HELD] += 1
+        if (pos > 0 and price > state[S_BEST]) or (pos < 0 and price < state[S_BEST]):
+            state[S_BEST] = price
+        move = pos * (price - state[S_ENTRY]) / tick
+        retrace = pos * (state[S_BEST] - price) / state[S_BEST] * 100.0
+
+        exit_rule = 2 if pos > 0 else 3
+        if (params[_P_TP] > 0 and move >= params[_P_TP]) or \
+                (params[_P_SL] > 0 and move <= -params[_P_SL]) or \
+                (params[_P_TRAIL] > 0 and retrace >= params[_P_TRAIL]) or \
+                (params[_P_MAX_HOLD] > 0 and state[S_HELD] >= params[_P_MAX_HOLD]) or \
+                _eval_rule(codes, args, vals, starts[exit_rule], starts[exit_rule + 1], feat, params, pos, stack):
+            _close(state, price, tick, size, slip)
+            action = ACTION_EXIT
+
+    elif (params[_P_MAX_TRADES] <= 0 or state[S_TRADES_TODAY] < params[_P_MAX_TRADES]) and \
+            t_ns - state[S_LAST_ENTRY] >= params[_P_COOLDOWN] * _NS:
+        if _eval_rule(codes, args, vals, starts[0], starts[1], feat, params, pos, stack):
+            action = ACTION_LONG
+        elif _eval_rule(codes, args, vals, starts[1], starts[2], feat, params, pos, stack):
+            action = ACTION_SHORT
+        if action != ACTION_NONE:
+            state[S_POS] = action
+            state[S_ENTRY] = price + action * slip * tick
+            state[S_BEST] = price
+            state[S_HELD] = 0.0
+            state[S_LAST_ENTRY] = t_ns
+            state[S_TRADES_TODAY] += 1
+
+    # 逐事件盯市，记录最大回撤
+    equity = state[S_REALIZED] + state[S_POS] * (price - state[S_ENTRY]) * size
+    if equity > state[S_PEAK]:
+        state[S_PEAK] = equity
+    elif state[S_PEAK] - equity > state[S_MAX_DD]:
+        state[S_MAX_DD] = state[S_PEAK] - equity
+    return action
+
+
+@njit(cache=True)
+def _new_state():
+    state = np.zeros(N_STATE)
+    state[S_DAY] = -1.0
+    state[S_LAST_ENTRY] = -1e30
+    return state
+
+
+@njit(cache=True)
+def _run(features, times, prices, params, codes, args, vals, starts, tick, size, state):
+    """单组参数逐事件执行，返回动作、持仓与权益序列"""
+    n = features.shape[0]
+    actions = np.zeros(n, dtype=np.int64)
+    positions = np.zeros(n)
+    equity = np.zeros(n)
+    stack = np.empty(max(codes.shape[0], 1))
+    for t in range(n):
+        actions[t] = _step(features[t], times[t], prices[t], params, codes, args, vals, starts, tick, size,
+                           state, stack)
+        positions[t] = state[S_POS]
+        equity[t] = state[S_REALIZED] + state[S_POS] * (prices[t] - state[S_ENTRY]) * size
+    return actions, positions, equity
+
+
+@njit(cache=True, parallel=True)
+def _sweep(features, times, prices, param_matrix, codes, args, vals, starts, tick, size, close_at_end):
+    """多组参数并行回测，每组参数只保留汇总结果"""
+    n_sets = param_matrix.shape[0]
+    n = features.shape[0]
+    out = np.empty((n_sets, 6))
+    for p in prange(n_sets):
+        params = param_matrix[p]
+        state = _new_state()
+        stack = np.empty(max(codes.shape[0], 1))
+        for t in range(n):
+            _step(features[t], times[t], prices[t], params, codes, args, vals, starts, tick, size, state, stack)
+        if close_at_end and state[S_POS] != 0.0 and n > 0:
+            _close(state, prices[n - 1], tick, size, params[_P_SLIP])
+        trades = state[S_TRADES]
+        out[p, 0] = state[S_REALIZED]
+        out[p, 1] = trades
+        out[p, 2] = state[S_WINS] / trades if trades > 0 else np.nan
+        out[p, 3] = state[S_MAX_DD]
+        out[p, 4] = state[S_GROSS_WIN] / state[S_GROSS_LOSS] if state[S_GROSS_LOSS] > 0 else np.inf
+        out[p, 5] = state[S_REALIZED] / trades if trades > 0 else np.nan
+    return out
+
+
+@dataclass
+class StrategySpec:
+    """策略定义"""
+    inputs: Sequence[str] = ('open', 'high', 'low', 'close', 'volume')
+    indicators: Dict[str, tuple] = field(default_factory=dict)  # 见 IndicatorGraph.from_spec
+    params: Dict[str, float] = field(default_factory=dict)
+    entry_long: str = ''
+    entry_short: str = ''
+    exit_long: str = ''
+    exit_short: str = ''
+    price: str = 'close'  # 成交与止盈止损使用的价格列
+
+    def compile(self, price_tick: float = 1.0, size: float = 1.0) -> "CompiledStrategy":
+        """
+        :param price_tick: 最小变动价位，止盈止损跳数换算用
+        :param size: 合约乘数，盈亏换算为金额用
+        """
+        return CompiledStrategy(self, price_tick, size)
+
+
+class _RuleCompiler:
+    """把规则表达式编译为逆波兰指令"""
+
+    def __init__(self, features: Dict[str, int], params: Dict[str, int], constants: Dict[str, float]):
+        self.features = features
+        self.params = params
+        self.constants = constants
+        self.codes: List[int] = []
+        self.args: List[int] = []
+        self.vals: List[float] = []
+
+    def emit(self, code: int, arg: int = 0, val: float = 0.0):
+        self.codes.append(code)
+        self.args.append(arg)
+        self.vals.append(val)
+
+    def compile(self, text: str):
+        if text.strip():
+            self.visit(ast.parse(text, mode='eval').body, text)
+
+    def visit(self, node, text: str):
+        if isinstance(node, ast.BoolOp):
+            code = R_AND if isinstance(node.op, ast.And) else R_OR
+            self.visit(node.values[0], text)
+            for value in node.values[1:]:
+                self.visit(value, text)
+                self.emit(code)
+        elif isinstance(node, ast.Compare):
+            # 链式比较 a < b < c 等价于 a < b and b < c
+            left = node.left
+            for i, (op, right) in enumerate(zip(node.ops, node.comparators)):
+                if type(op) not in _COMPARE_OPS:
+                    raise ValueError(f"Unsupported comparison in rule: {text}")
+                self.visit(left, text)
+                self.visit(right, text)
+                self.emit(_COMPARE_OPS[type(op)])
+                if i > 0:
+                    self.emit(R_AND)
+                left = right
+        elif isinstance(node, ast.BinOp) and type(node.op) in _BINARY_OPS:
+            self.visit(node.left, text)
+            self.visit(node.right, text)
+            self.emit(_BINARY_OPS[type(node.op)])
+        elif isinstance(node, ast.UnaryOp) and isinstance(node.op, (ast.Not, ast.USub, ast.UAdd)):
+            self.visit(node.operand, text)
+            if isinstance(node.op, ast.Not):
+                self.emit(R_NOT)
+            elif isinstance(node.op, ast.USub):
+                self.emit(R_NEG)
+        elif isinstance(node, ast.Call) and isinstance(node.func, ast.Name) and node.func.id == 'abs' \
+                and len(node.args) == 1:
+            self.visit(node.args[0], text)
+            self.emit(R_ABS)
+        elif isinstance(node, ast.Constant) and isinstance(node.value, (int, float)):
+            self.emit(R_CONST, val=float(node.value))
+        elif isinstance(node, ast.Name):
+            if node.id == 'pos':
+                self.emit(R_POS)
+            elif node.id in self.params:
+                self.emit(R_PARAM, self.params[node.id])
+            elif node.id in self.constants:
+                self.emit(R_CONST, val=self.constants[node.id])
+            elif node.id in self.features:
+                self.emit(R_FEATURE, self.features[node.id])
+            else:
+                raise ValueError(f"Unknown name '{node.id}' in rule: {text}")
+        else:
+            raise ValueError(f"Unsupported expression in rule: {text}")
+
+
+def _rule_names(text: str) -> List[str]:
+    if not text.strip():
+        return []
+    return [node.id for node in ast.walk(ast.parse(text, mode='eval')) if isinstance(node, ast.Name)]
+
+
+class CompiledStrategy:
+    """编译后的策略：指标内核 + 规则指令表 + 参数布局"""
+
+    def __init__(self, spec: StrategySpec, price_tick: float = 1.0, size: float = 1.0):
+        self.spec = spec
+        self.price_tick = float(price_tick)
+        self.size = float(size)
+
+        # 参数：内置参数在前，其余按定义顺序
+        defaults = dict(BUILTIN_PARAMS)
+        defaults.update(spec.params)
+        self.param_names = list(defaults)
+        self.param_index = {name: i for i, name in enumerate(self.param_names)}
+        self.defaults = np.array([defaults[name] for name in self.param_names], dtype=np.float64)
+
+        # 特征：规则引用的指标与输入列，外加成交价格列
+        constants = {'price_tick': self.price_tick}
+        graph = IndicatorGraph.from_spec(spec.indicators, spec.inputs)
+        referenced = [spec.price]
+        for rule in RULES:
+            referenced += [name for name in _rule_names(getattr(spec, rule))
+                           if name not in self.param_index and name not in constants and name not in ('pos', 'abs')]
+        for name in referenced:
+            if name not in graph.outputs:
+                graph.outputs[name] = graph.ref(name)
+        self.indicators = graph.compile()
+        self.feature_names = self.indicators.names
+        self.feature_index = {name: i for i, name in enumerate(self.feature_names)}
+        self.price_col = self.feature_index[spec.price]
+
+        compiler = _RuleCompiler(self.feature_index, self.param_index, constants)
+        starts = [0]
+        for rule in RULES:
+            compiler.compile(getattr(spec, rule))
+            starts.append(len(compiler.codes))
+        self.codes = np.array(compiler.codes, dtype=np.int64)
+        self.args = np.array(compiler.args, dtype=np.int64)
+        self.vals = np.array(compiler.vals, dtype=np.float64)
+        self.starts = np.array(starts, dtype=np.int64)
+
+    # ===== 参数 =====
+    def param_vector(self, params: Dict[str, float] = None) -> np.ndarray:
+        vector = self.defaults.copy()
+        for name, value in (params or {}).items():
+            if name not in self.param_index:
+                raise ValueError(f"Unknown strategy parameter: {name}")
+            vector[self.param_index[name]] = value
+        return vector
+
+    def param_matrix(self, param_sets: Union[pd.DataFrame, Sequence[Dict[str, float]]]) -> np.ndarray:
+        """参数组合 -> (组数, 参数数) 矩阵，未给出的参数取默认值"""
+        if isinstance(param_sets, pd.DataFrame):
+            param_sets = param_sets.to_dict('records')
+        return np.ascontiguousarray([self.param_vector(p) for p in param_sets], dtype=np.float64)
+
+    # ===== 批量 =====
+    def features(self, data: Union[pd.DataFrame, Dict[str, np.ndarray]]) -> np.ndarray:
+        """指标与参数无关，扫描多组参数时只计算一次"""
+        return np.ascontiguousarray(self.indicators.transform(data).values)
+
+    @staticmethod
+    def _times(data) -> np.ndarray:
+        return np.ascontiguousarray(np.asarray(data['datetime']).astype('datetime64[ns]').astype(np.int64))
+
+    def backtest(self, data: Union[pd.DataFrame, Dict[str, np.ndarray]], params: Dict[str, float] = None,
+                 features: np.ndarray = None) -> pd.DataFrame:
+        """
+        单组参数回测
+        :param data: 含 datetime（纳秒或datetime64）与输入列的DataFrame或列式数组（如 BarStore.load_arrays）
+        :return: 逐事件的 action / position / equity
+        """
+        features = self.features(data) if features is None else features
+        times = self._times(data)
+        prices = np.ascontiguousarray(features[:, self.price_col])
+        actions, positions, equity = _run(features, times, prices, self.param_vector(params), self.codes,
+                                          self.args, self.vals, self.starts, self.price_tick, self.size,
+                                          _new_state())
+        return pd.DataFrame({'datetime': pd.to_datetime(times), 'price': prices, 'action': actions,
+                             'position': positions, 'equity': equity})
+
+    def sweep(self, data: Union[pd.DataFrame, Dict[str, np.ndarray]],
+              param_sets: Union[pd.DataFrame, Sequence[Dict[str, float]]],
+              features: np.ndarray = None, close_at_end: bool = True) -> pd.DataFrame:
+        """
+        多组参数并行回测
+        :param close_at_end: 数据结束时按最后价格平掉持仓
+        :return: 每组参数一行：参数列 + SWEEP_COLUMNS
+        """
+        features = self.features(data) if features is None else features
+        matrix = self.param_matrix(param_sets)
+        result = self.sweep_arrays(features, self._times(data), matrix, close_at_end)
+        frame = pd.DataFrame(matrix, columns=self.param_names)
+        frame[SWEEP_COLUMNS] = result
+        return frame
+
+    def sweep_arrays(self, features: np.ndarray, times: np.ndarray, param_matrix: np.ndarray,
+                     close_at_end: bool = True) -> np.ndarray:
+        """sweep 的数组版本，供优化器等在共享内存数组上直接调用"""
+        prices = np.ascontiguousarray(features[:, self.price_col])
+        return _sweep(features, times, prices, param_matrix, self.codes, self.args, self.vals, self.starts,
+                      self.price_tick, self.size, close_at_end)
+
+    # ===== 实盘 =====
+    def runner(self, params: Dict[str, float] = None) -> "StrategyRunner":
+        return StrategyRunner(self, params)
+
+
+class StrategyRunner:
+    """实盘逐事件执行器：流式指标 + 与回测相同的 _step"""
+
+    def __init__(self, compiled: CompiledStrategy, params: Dict[str, float] = None):
+        self.compiled = compiled
+        self.params = compiled.param_vector(params)
+        self.stream = compiled.indicators.create_stream()
+        self.state = _new_state()
+        self._stack = np.empty(max(len(compiled.codes), 1))
+        self._row = np.zeros((1, len(compiled.indicators.inputs)))
+        self._time = np.zeros(1, dtype=np.int64)
+        self._price = np.zeros(1)
+
+    @property
+    def pos(self) -> int:
+        return int(self.state[S_POS])
+
+    @property
+    def entry_price(self) -> float:
+        return self.state[S_ENTRY]
+
+    def _features(self, values: Dict[str, float]) -> np.ndarray:
+        self._row[0, :] = [values[name] for name in self.compiled.indicators.inputs]
+        return self.compiled.indicators.run(self._row, self.stream.state)
+
+    def warmup(self, values: Dict[str, float]):
+        """只更新指标，不执行规则（加载历史K线时使用）"""
+        self._features(values)
+
+    def update(self, values: Dict[str, float], t_ns: int) -> int:
+        """
+        :param values: {输入列: 数值}，需包含 spec.inputs 的全部列
+        :param t_ns: 事件时间（北京时间纳秒，与回测数据一致）
+        :return: 动作 ACTION_*
+        """
+        c = self.compiled
+        features = self._features(values)
+        self._time[0] = t_ns
+        self._price[0] = features[0, c.price_col]
+        actions, _, _ = _run(features, self._time, self._price, self.params, c.codes, c.args, c.vals, c.starts,
+                             c.price_tick, c.size, self.state)
+        return int(actions[0])
+
+    def sync(self, pos: int, entry_price: float = None):
+        """
+        用实际持仓校正状态机（委托未成交/被撤、成交价与假设不同时调用），
+        保证止盈止损按真实成本价计算
+        """
+        self.state[S_POS] = float(np.sign(pos))
+        if entry_price is not None and pos != 0:
+            self.state[S_ENTRY] = entry_price
+            if self.state[S_BEST] == 0.0:
+                self.state[S_BEST] = entry_price
@@ -0,0 +1,107 @@
+"""
+期货交易时段配置
+按品种登记日盘与夜盘时段（北京时间），供交易时间过滤、日内季节性统计和K线重采样使用
+跨零点的夜盘用大于24:00的结束时间表示，如 21:00-25:00 即次日01:00收盘
+"""
+from datetime import datetime
+from typing import List, Tuple
+
+import numpy as np
+
+from src.data.bar_store import symbol_to_product
+
+
+# 日盘时段
+DAY_SESSIONS = ["09:00-10:15", "10:30-11:30", "13:30-15:00"]
+FINANCIAL_SESSIONS = ["09:30-11:30", "13:00-15:00"]
+
+# 夜盘时段（按品种）
+NIGHT_SESSIONS = {
+    "rb": "21:00-23:00",  # 螺纹钢
+    "hc": "21:00-23:00",  # 热卷
+    "ru": "21:00-23:00",  # 橡胶
+    "cu": "21:00-25:00",  # 沪铜，次日01:00
+    "al": "21:00-25:00",  # 沪铝
+    "zn": "21:00-25:00",  # 沪锌
+    "ni": "21:00-25:00",  # 沪镍
+    "au": "21:00-26:30",  # 黄金，次日02:30
+    "ag": "21:00-26:30",  # 白银
+    "SR": "21:00-23:00",  # 白糖
+}
+
+# 无夜盘的金融期货
+FINANCIAL_PRODUCTS = {"IF", "IH", "IC", "IM", "T", "TF", "TS"}
+
+
+def _parse_range(text: str) -> Tuple[int, int]:
+    """'21:00-25:00' -> (1260, 1500)，单位为当日分钟数"""
+    start, end = text.split('-')
+    to_minutes = lambda s: int(s.split(':')[0]) * 60 + int(s.split(':')[1])
+    return to_minutes(start), to_minutes(end)
+
+
+def get_sessions(symbol: str) -> List[Tuple[int, int]]:
+    """
+    获取品种的交易时段，按交易日内的先后顺序排列（夜盘在前）
+    :param symbol: 合约代码或品种代码，如 'SHFE.rb2605'、'rb2605'、'rb'
+    :return: [(开始分钟, 结束分钟), ...]，左闭右开
+    """
+    product = symbol_to_product(symbol)
+    if product in FINANCIAL_PRODUCTS:
+        return [_parse_range(s) for s in FINANCIAL_SESSIONS]
+
+    sessions = [_parse_range(s) for s in DAY_SESSIONS]
+    if product in NIGHT_SESSIONS:
+        sessions.insert(0, _parse_range(NIGHT_SESSIONS[product]))
+    return sessions
+
+
+def build_minute_map(symbol: str) -> np.ndarray:
+    """
+    当日分钟数 -> 交易日内的时段分钟序号（夜盘在前），非交易时间为-1
+    :return: 长度1440的int64数组
+    """
+    minute_map = np.full(1440, -1, dtype=np.int64)
+    offset = 0
+    for start, end in get_sessions(symbol):
+        minutes = np.arange(start, end)
+        minute_map[minutes % 1440] = offset + minutes - start
+        offset += end - start
+    return minute_map
+
+
+def build_session_map(symbol: str) -> Tuple[np.ndarray, np.ndarray]:
+    """
+    当日分钟数 -> (时段序号, 时段内分钟序号)，非交易时间均为-1
+    :return: 两个长度1440的int64数组
+    """
+    session_index = np.full(1440, -1, dtype=np.int64)
+    position = np.full(1440, -1, dtype=np.int64)
+    for i, (start, end) in enumerate(get_sessions(symbol)):
+        minutes = np.arange(start, end)
+        session_index[minutes % 1440] = i
+        position[minutes % 1440] = minutes - start
+    return session_index, position
+
+
+def minute_of_day(dt: datetime) -> int:
+    """当日分钟数"""
+    return dt.hour * 60 + dt.minute
+
+
+def session_position(symbol: str, dt: datetime) -> int:
+    """
+    时间点所在的时段序号
+    :return: get_sessions 中的下标，不在交易时段内返回-1
+    """
+    minute = minute_of_day(dt)
+    for i, (start, end) in enumerate(get_sessions(symbol)):
+        # 跨零点时段：凌晨的时间加24小时后比较
+        if start <= minute < end or start <= minute + 1440 < end:
+            return i
+    return -1
+
+
+def is_trading_time(symbol: str, dt: datetime) -> bool:
+    """是否处于品种的交易时段内"""
+    return session_position(symbol, dt) >= 0
@@ -0,0 +1,411 @@
+"""
+交易成本分析（TCA）模块
+为每笔委托记录 决策价 -> 到达中间价 -> 发单 -> 回报确认 -> 各笔成交 的价格与时间戳，委托结束后计算：
+- 执行落差（implementation shortfall）：相对决策价的成交成本 + 未成交部分的机会成本（金额、基点、每手跳数）
+- 分解：延迟成本（决策价到发单时中间价）、有效价差（成交价相对成交时中间价）、
+  市场冲击（成交后 impact_horizon 秒中间价相对成交时中间价的变动）、已实现价差 = 有效价差 - 市场冲击
+- 延迟：决策到发单、发单到确认、发单到首笔成交、发单到完成
+结果逐笔写入指标系统（src.utils.metrics），也可汇总为DataFrame
+"""
+import threading
+import time
+from collections import OrderedDict
+from dataclasses import dataclass, field
+from typing import Callable, Dict, List, Optional, Sequence
+
+import numpy as np
+import pandas as pd
+
+from src.data.bar_store import symbol_to_code
+from src.trading.contract_specs import get_contract_spec
+from src.utils.metrics import METRICS, SIGNED_BUCKETS, MetricsRegistry
+
+
+_NS = 1_000_000_000
+# 发单返回委托号之前到达的回报最多缓存的委托数（其余委托的回报也会进入缓存，按先进先出淘汰）
+_MAX_EARLY_ORDERS = 1000
+
+
+@dataclass
+class Fill:
+    """单笔成交"""
+    time_ns: int
+    price: float
+    volume: float
+    mid: float  # 成交时的中间价
+    order_id: str = ''
+    mid_after: float = np.nan  # impact_horizon 之后的中间价
+
+
+@dataclass
+class OrderCost:
+    """一笔委托（从决策到完成）的成本记录"""
+    symbol: str
+    side: int  # +1 买 / -1 卖
+    volume: float  # 决策数量
+    decision_price: float
+    decision_ns: int
+    arrival_mid: float = np.nan  # 发单时的中间价
+    arrival_spread: float = np.nan
+    limit_price: float = np.nan
+    send_ns: int = 0
+    ack_ns: int = 0
+    done_ns: int = 0
+    done_mid: float = np.nan  # 完成时的中间价，未成交部分的机会成本按此计算
+    status: str = 'pending'
+    order_ids: List[str] = field(default_factory=list)
+    fills: List[Fill] = field(default_factory=list)
+    strategy: str = ''
+    closed: Dict[str, float] = field(default_factory=dict)  # 已结束的委托 -> 回报中的成交量
+
+    @property
+    def filled(self) -> float:
+        return sum(f.volume for f in self.fills)
+
+    @property
+    def average_price(self) -> float:
+        filled = self.filled
+        return sum(f.price * f.volume for f in self.fills) / filled if filled else np.nan
+
+
+def _mid(tick) -> float:
+    bid, ask = getattr(tick, 'bid_price_1', 0.0), getattr(tick, 'ask_price_1', 0.0)
+    if bid and ask:
+        return (bid + ask) / 2
+    return getattr(tick, 'last_price', np.nan)
+
+
+class TCARecorder:
+    """
+    委托生命周期记录器
+    用法：decide() 记录决策 -> before_send() 记录发单时刻 -> 发单 -> on_send() 关联委托号 ->
+    把 on_tick/on_order/on_trade 回调转给记录器；
+    委托全部成交、撤单或拒单后，成交后的冲击中间价到齐时完成计算并写入指标
+    线程安全：决策/发单/行情可在交易线程调用，委托/成交回报可在事件引擎线程调用；
+    send_order 返回委托号之前就到达的回报先按委托号缓存，on_send 登记委托号时补处理
+    """
+
+    def __init__(self, strategy: str = '', impact_horizon: float = 5.0, metrics: MetricsRegistry = None,
+                 clock: Callable[[], int] = time.perf_counter_ns, specs: Dict[str, dict] = None):
+        """
+        :param impact_horizon: 市场冲击的观察时长（秒，按行情时间）
+        :param clock: 纳秒时钟，延迟统计使用
+        :param specs: {合约: {'size', 'price_tick'}}，默认取 contract_specs
+        """
+        self.strategy = strategy
+        self.impact_horizon = impact_horizon
+        self.metrics = metrics or METRICS
+        self.clock = clock
+        self.specs = specs or {}
+        self.quotes: Dict[str, tuple] = {}  # 合约 -> (中间价, 价差, 行情时间ns)
+        self.by_order_id: Dict[str, OrderCost] = {}
+        self.pending_impact: Dict[str, List[tuple]] = {}  # 合约 -> [(到期行情时间ns, Fill)]
+        self.active: List[OrderCost] = []
+        self.completed: List[OrderCost] = []
+        self.results: List[dict] = []
+        self.early_reports: OrderedDict = OrderedDict()  # 委托号 -> [('order'/'trade', 回报, 到达时钟ns)]
+        self._lock = threading.RLock()
+
+    # ===== 事件 =====
+    def on_tick(self, tick):
+        """更新中间价，并补齐到期的冲击中间价"""
+        with self._lock:
+            self._on_tick(tick)
+
+    def _on_tick(self, tick):
+        symbol = tick.symbol
+        mid = _mid(tick)
+        spread = (tick.ask_price_1 - tick.bid_price_1) if getattr(tick, 'ask_price_1', 0) and \
+            getattr(tick, 'bid_price_1', 0) else np.nan
+        tick_ns = int(pd.Timestamp(tick.datetime).value) if getattr(tick, 'datetime', None) is not None \
+            else self.clock()
+        self.quotes[symbol] = (mid, spread, tick_ns)
+
+        pending = self.pending_impact.get(symbol)
+        if pending:
+            remaining = []
+            for due, fill in pending:
+                if tick_ns >= due:
+                    fill.mid_after = mid
+                else:
+                    remaining.append((due, fill))
+            self.pending_impact[symbol] = remaining
+            self._finish_ready()
+
+    def decide(self, symbol: str, side: int, volume: float, decision_price: float = None) -> OrderCost:
+        """
+        记录交易决策（产生信号的时刻）
+        :param decision_price: 决策时参考的价格，默认为当前中间价
+        """
+        with self._lock:
+            mid = self.quotes.get(symbol, (np.nan,))[0]
+        return OrderCost(symbol=symbol, side=int(np.sign(side)), volume=float(volume),
+                         decision_price=float(decision_price if decision_price is not None else mid),
+                         decision_ns=self.clock(), strategy=self.strategy)
+
+    def before_send(self, record: OrderCost):
+        """
+        发单前调用：记录发单时刻与到达中间价
+        回报可能在 send_order 返回之前到达，发单时刻必须在调用发单接口之前记录，否则延迟会偏小甚至为负
+        """
+        with self._lock:
+            self._stamp_send(record)
+
+    def _stamp_send(self, record: OrderCost):
+        record.send_ns = self.clock()
+        mid, spread, _ = self.quotes.get(record.symbol, (np.nan, np.nan, 0))
+        record.arrival_mid = mid
+        record.arrival_spread = spread
+
+    def on_send(self, record: OrderCost, order_ids, limit_price: float = np.nan):
+        """
+        发单后调用
+        :param order_ids: 委托号或委托号列表（CtaTemplate.buy 等返回列表）
+        """
+        with self._lock:
+            self._on_send(record, order_ids, limit_price)
+
+    def _on_send(self, record: OrderCost, order_ids, limit_price: float):
+        order_ids = [order_ids] if isinstance(order_ids, str) else list(order_ids or [])
+        if not record.send_ns:
+            # 未调用 before_send：以当前时刻记录，且不晚于已缓存的最早回报
+            self._stamp_send(record)
+            early = [now for order_id in order_ids for _, _, now in self.early_reports.get(order_id, [])]
+            if early:
+                record.send_ns = min(record.send_ns, min(early))
+        record.limit_price = float(limit_price)
+        if not order_ids:
+            record.status = 'rejected'
+            record.done_ns = record.send_ns
+            record.done_mid = self.quotes.get(record.symbol, (np.nan,))[0]
+            self._finish(record)
+            return
+        record.order_ids = order_ids
+        record.status = 'working'
+        for order_id in order_ids:
+            self.by_order_id[order_id] = record
+        self.active.append(record)
+
+        # 补处理发单返回前已到达的回报
+        for order_id in order_ids:
+            for kind, report, now in self.early_reports.pop(order_id, []):
+                if kind == 'order':
+                    self._on_order(report, now)
+                else:
+                    self._on_trade(report, now)
+
+    def _buffer_early(self, kind: str, report, now: int):
+        self.early_reports.setdefault(report.vt_orderid, []).append((kind, report, now))
+        while len(self.early_reports) > _MAX_EARLY_ORDERS:
+            self.early_reports.popitem(last=False)
+
+    def on_order(self, order):
+        """委托回报（vnpy OrderData）"""
+        with self._lock:
+            now = self.clock()
+            if order.vt_orderid not in self.by_order_id:
+                self._buffer_early('order', order, now)
+                return
+            self._on_order(order, now)
+
+    def _on_order(self, order, now: int):
+        record = self.by_order_id.get(order.vt_orderid)
+        if record is None:
+            return
+        if not record.ack_ns:
+            record.ack_ns = now
+        if not order.is_active():
+            record.closed[order.vt_orderid] = float(getattr(order, 'traded', 0.0))
+            self._check_done(record)
+
+    def _check_done(self, record: OrderCost):
+        """
+        一笔决策拆成多个委托时全部结束才算完成；
+        委托结束的回报可能先于最后一笔成交到达，成交量与回报一致后才完成
+        """
+        for order_id in record.order_ids:
+            if order_id not in record.closed:
+                return
+            received = sum(f.volume for f in record.fills if f.order_id == order_id)
+            if received < record.closed[order_id] - 1e-9:
+                return
+        for order_id in record.order_ids:
+            self.by_order_id.pop(order_id, None)
+        record.done_ns = self.clock()
+        record.done_mid = self.quotes.get(record.symbol, (np.nan,))[0]
+        record.status = 'filled' if record.filled >= record.volume - 1e-9 else \
+            ('partial' if record.filled > 0 else 'cancelled')
+        self._finish_ready()
+
+    def on_trade(self, trade):
+        """成交回报（vnpy TradeData）"""
+        with self._lock:
+            now = self.clock()
+            if trade.vt_orderid not in self.by_order_id:
+                self._buffer_early('trade', trade, now)
+                return
+            self._on_trade(trade, now)
+
+    def _on_trade(self, trade, now: int):
+        record = self.by_order_id.get(trade.vt_orderid)
+        if record is None:
+            return
+        mid, _, tick_ns = self.quotes.get(record.symbol, (np.nan, np.nan, 0))
+        fill = Fill(time_ns=now, price=float(trade.price), volume=float(trade.volume), mid=mid,
+                    order_id=trade.vt_orderid)
+        record.fills.append(fill)
+        if self.impact_horizon > 0:
+            self.pending_impact.setdefault(record.symbol, []).append((tick_ns + int(self.impact_horizon * _NS), fill))
+        else:
+            fill.mid_after = mid
+        if trade.vt_orderid in record.closed:
+            self._check_done(record)
+
+    def flush(self):
+        """收盘或停止时调用：冲击中间价未到的成交按最新中间价计算，并结束所有仍在进行的委托"""
+        with self._lock:
+            self._flush()
+
+    def _flush(self):
+        for symbol, pending in self.pending_impact.items():
+            for _, fill in pending:
+                fill.mid_after = self.quotes.get(symbol, (np.nan,))[0]
+        self.pending_impact.clear()
+        for record in self.active:
+            if not record.done_ns:
+                record.done_ns = self.clock()
+                record.done_mid = self.quotes.get(record.symbol, (np.nan,))[0]
+                record.status = 'open'
+        self._finish_ready()
+
+    # ===== 计算 =====
+    def _finish_ready(self):
+        ready = [r for r in self.active if r.done_ns and all(not np.isnan(f.mid_after) or np.isnan(f.mid)
+                                                             for f in r.fills)]
+        for record in ready:
+            self.active.remove(record)
+            self._finish(record)
+
+    def _spec(self, symbol: str) -> dict:
+        return self.specs.get(symbol) or get_contract_spec(symbol_to_code(symbol))
+
+    def _finish(self, record: OrderCost):
+        result = order_costs(record, self._spec(record.symbol))
+        self.completed.append(record)
+        self.results.append(result)
+
+        labels = {'symbol': record.symbol, 'strategy': record.strategy}
+        self.metrics.counter('tca_orders_total', status=record.status, **labels).inc()
+        self.metrics.counter('tca_filled_volume', **labels).inc(result['filled'])
+        if result['filled'] > 0:
+            # 成本类指标可为负（价格改善），用正负对称分桶的直方图记录，执行落差的总和为累计成本
+            for name in ('shortfall', 'shortfall_bps', 'delay_ticks', 'effective_spread_ticks', 'impact_ticks',
+                         'realized_spread_ticks'):
+                metric = 'tca_shortfall_cost' if name == 'shortfall' else f'tca_{name}'
+                self.metrics.observe(metric, result[name], buckets=SIGNED_BUCKETS, **labels)
+        for name in ('decision_to_send_ms', 'send_to_ack_ms', 'send_to_first_fill_ms', 'send_to_done_ms'):
+            if not np.isnan(result[name]):
+                self.metrics.observe(f'tca_{name}', result[name], **labels)
+
+    def to_frame(self) -> pd.DataFrame:
+        with self._lock:
+            return pd.DataFrame(self.results)
+
+    def summary(self, by: Optional[Sequence[str]] = None) -> pd.DataFrame:
+        """
+        汇总：成本按成交量加权，延迟取中位数与90分位
+        :param by: 分组列，如 ['symbol']、['strategy']
+        """
+        frame = self.to_frame()
+        return summarize_costs(frame, by)
+
+
+def order_costs(record: OrderCost, spec: dict) -> dict:
+    """
+    单笔委托的成本
+    价格类指标均为“成本为正”：买入时成交价高于参考价为正，卖出时相反
+    """
+    s = record.side
+    size = spec['size']
+    tick = spec['price_tick']
+    filled = record.filled
+    avg = record.average_price
+    pd_ = record.decision_price
+    notional = abs(pd_) * record.volume * size
+
+    execution = s * (avg - pd_) * filled * size if filled else 0.0
+    unfilled = max(record.volume - filled, 0.0)
+    opportunity = s * (record.done_mid - pd_) * unfilled * size if unfilled and not np.isnan(record.done_mid) else 0.0
+    shortfall = execution + opportunity
+
+    mids = np.array([f.mid for f in record.fills]) if filled else np.empty(0)
+    after = np.array([f.mid_after for f in record.fills]) if filled else np.empty(0)
+    prices = np.array([f.price for f in record.fills]) if filled else np.empty(0)
+    weights = np.array([f.volume for f in record.fills]) if filled else np.empty(0)
+
+    def weighted(values):
+        valid = ~np.isnan(values)
+        return float(np.average(values[valid], weights=weights[valid])) if valid.any() else np.nan
+
+    effective = weighted(s * (prices - mids)) / tick if filled else np.nan
+    impact = weighted(s * (after - mids)) / tick if filled else np.nan
+    ms = lambda a, b: (a - b) / 1e6 if a and b else np.nan
+
+    return {
+        'symbol': record.symbol,
+        'strategy': record.strategy,
+        'side': s,
+        'volume': record.volume,
+        'filled': filled,
+        'fill_rate': filled / record.volume if record.volume else np.nan,
+        'status': record.status,
+        'decision_price': pd_,
+        'arrival_mid': record.arrival_mid,
+        'average_price': avg,
+        'shortfall': shortfall,
+        'execution_cost': execution,
+        'opportunity_cost': opportunity,
+        'shortfall_bps': shortfall / notional * 1e4 if notional else np.nan,
+        'shortfall_ticks': shortfall / (size * tick * record.volume) if record.volume else np.nan,
+        'delay_ticks': s * (record.arrival_mid - pd_) / tick,
+        'arrival_spread_ticks': record.arrival_spread / tick,
+        'effective_spread_ticks': effective,
+        'impact_ticks': impact,
+        'realized_spread_ticks': effective - impact,
+        'decision_to_send_ms': ms(record.send_ns, record.decision_ns),
+        'send_to_ack_ms': ms(record.ack_ns, record.send_ns),
+        'send_to_first_fill_ms': ms(record.fills[0].time_ns, record.send_ns) if filled else np.nan,
+        'send_to_done_ms': ms(record.done_ns, record.send_ns),
+    }
+
+
+def summarize_costs(frame: pd.DataFrame, by: Optional[Sequence[str]] = None) -> pd.DataFrame:
+    """按成交量加权汇总 order_costs 的结果"""
+    if frame.empty:
+        return pd.DataFrame()
+
+    def aggregate(group: pd.DataFrame) -> pd.Series:
+        filled = group[group['filled'] > 0]
+        w = filled['filled']
+        wavg = lambda column: float(np.average(filled[column].dropna(), weights=w[filled[column].notna()])) \
+            if filled[column].notna().any() else np.nan
+        notional = (group['decision_price'].abs() * group['volume']).sum()
+        return pd.Series({
+            'orders': len(group),
+            'fill_rate': group['filled'].sum() / group['volume'].sum() if group['volume'].sum() else np.nan,
+            'shortfall': group['shortfall'].sum(),
+            'shortfall_bps': (group['shortfall_bps'] * group['decision_price'].abs() * group['volume']).sum() /
+                             notional if notional else np.nan,
+            'opportunity_cost': group['opportunity_cost'].sum(),
+            'delay_ticks': wavg('delay_ticks'),
+            'effective_spread_ticks': wavg('effective_spread_ticks'),
+            'impact_ticks': wavg('impact_ticks'),
+            'realized_spread_ticks': wavg('realized_spread_ticks'),
+            'send_to_ack_ms_p50': group['send_to_ack_ms'].median(),
+            'send_to_ack_ms_p90': group['send_to_ack_ms'].quantile(0.9),
+            'send_to_first_fill_ms_p50': group['send_to_first_fill_ms'].median(),
+        })
+
+    if not by:
+        return aggregate(frame).to_frame('all').T
+    return frame.groupby(list(by)).apply(aggregate)
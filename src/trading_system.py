@@ -4,7 +4,8 @@ import json
 import pandas as pd
 import numpy as np
 from datetime import datetime, timedelta
-from vnpy.event import EventEngine
+from vnpy.event import Event, EventEngine
+from vnpy.trader.event import EVENT_ACCOUNT
 from vnpy.trader.engine import MainEngine
 from vnpy.trader.ui import create_qapp
 from vnpy_ctp import CtpGateway
@@ -37,6 +38,8 @@ try:
     from models.train_and_backtest import ModelTrainerAndBacktester
     from strategies.predictive_trading_strategy import PredictiveTradingStrategy
     from risk_management.risk_manager import RiskManager
+    from risk_management.daily_drawdown_risk import DailyDrawdownRisk
+    from risk_management.kill_switch import KillSwitch
 except ImportError as e:
     print(f"导入模块失败: {e}")
     # 如果上面的导入失败，尝试另一种导入方式
@@ -47,6 +50,8 @@ except ImportError as e:
     from models.train_and_backtest import ModelTrainerAndBacktester
     from strategies.predictive_trading_strategy import PredictiveTradingStrategy
     from risk_management.risk_manager import RiskManager
+    from risk_management.daily_drawdown_risk import DailyDrawdownRisk
+    from risk_management.kill_switch import KillSwitch
 
 
 class ComprehensiveTradingSystem:
@@ -77,9 +82,6 @@ class ComprehensiveTradingSystem:
         self.window_size = 60
         self.feature_count = 10
         
-        # 初始化风险管理器
-        self.risk_manager = DailyDrawdownRisk(max_drawdown=0.05)  # 5%最大回撤
-        
         # 当前交易状态
         self.is_trading_active = False
         self.active_contracts = ["rb2605", "cu2605", "ni2605"]  # 支持的合约列表
@@ -89,6 +91,13 @@ class ComprehensiveTradingSystem:
         self.initial_capital = 1000000  # 初始资金
         self.current_capital = self.initial_capital
         
+        # 全局熔断：日内回撤超过初始资金5%时撤销全部委托并平仓
+        self.kill_switch = KillSwitch(self.main_engine, self.event_engine, flatten=True)
+        self.kill_switch.install()
+        self.risk_manager = DailyDrawdownRisk(max_daily_loss=self.initial_capital * 0.05,
+                                              kill_switch=self.kill_switch)
+        self.event_engine.register(EVENT_ACCOUNT, self.process_account_event)
+        
         # 注册信号处理器，用于优雅退出
         signal.signal(signal.SIGINT, self.signal_handler)
         signal.signal(signal.SIGTERM, self.signal_handler)
@@ -347,10 +356,16 @@ class ComprehensiveTradingSystem:
                 import traceback
                 traceback.print_exc()
     
+    def process_account_event(self, event: Event):
+        """账户回报：检查日内回撤"""
+        self.risk_manager.update_account(event.data)
+    
     def shutdown(self):
         """关闭系统"""
         print("正在关闭综合交易系统...")
         
+        self.kill_switch.close()
+        
         # 关闭CTA策略引擎
         if self.cta_engine:
             try:
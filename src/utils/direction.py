@@ -0,0 +1,18 @@
+"""
+交易方向映射
+成交/委托方向（字符串或vnpy Direction枚举）-> +1 买 / -1 卖，供成交分析与风控共用，不依赖其他模块
+"""
+
+_BUY = {'BUY', 'LONG', '多', '买', 'B', '1'}
+_SELL = {'SELL', 'SHORT', '空', '卖', 'S', '-1'}
+
+
+def direction_sign(direction) -> int:
+    """成交方向 -> +1 买 / -1 卖（兼容字符串与vnpy Direction枚举）"""
+    value = getattr(direction, 'value', direction)
+    text = str(value).strip().upper()
+    if text in _BUY:
+        return 1
+    if text in _SELL:
+        return -1
+    raise ValueError(f"Unsupported trade direction: {direction}")
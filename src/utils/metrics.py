@@ -0,0 +1,181 @@
+"""
+运行指标模块
+进程内的计数器、数值和直方图，按 名称 + 标签 区分，线程安全；
+交易、风控、执行分析等模块把指标写入默认注册表 METRICS，可随时取快照或导出为 Prometheus 文本格式
+"""
+import bisect
+import math
+import threading
+import time
+from typing import Callable, Dict, List, Sequence, Tuple
+
+
+def log_buckets(start: float, factor: float, count: int) -> List[float]:
+    """等比分桶上界：start, start*factor, ..."""
+    return [start * factor ** i for i in range(count)]
+
+
+def symmetric_buckets(start: float, factor: float, count: int) -> List[float]:
+    """正负对称的等比分桶上界：-start*factor^(count-1), ..., -start, 0, start, ..., start*factor^(count-1)"""
+    positive = log_buckets(start, factor, count)
+    return [-b for b in reversed(positive)] + [0.0] + positive
+
+
+# 默认分桶：0.01 ~ 约1e5，覆盖毫秒级延迟与基点级成本
+DEFAULT_BUCKETS = log_buckets(0.01, 2.0, 24)
+# 有符号指标（成本、价差等，负值表示价格改善）的分桶
+SIGNED_BUCKETS = symmetric_buckets(0.01, 2.0, 24)
+
+
+def _key(name: str, labels: Dict[str, str]) -> Tuple[str, Tuple[Tuple[str, str], ...]]:
+    return name, tuple(sorted((k, str(v)) for k, v in labels.items()))
+
+
+class Counter:
+    """单调递增计数"""
+
+    def __init__(self):
+        self.value = 0.0
+        self._lock = threading.Lock()
+
+    def inc(self, amount: float = 1.0):
+        with self._lock:
+            self.value += amount
+
+
+class Gauge:
+    """可增可减的当前值"""
+
+    def __init__(self):
+        self.value = 0.0
+        self.updated = 0.0
+
+    def set(self, value: float):
+        self.value = float(value)
+        self.updated = time.time()
+
+
+class Histogram:
+    """
+    固定分桶直方图：记录次数、总和、最小/最大值，分位数按桶内线性插值估计；
+    低于最低上界的值都计入第一个桶（最小值保留真实值），可能为负的指标应使用 SIGNED_BUCKETS
+    """
+
+    def __init__(self, buckets: Sequence[float] = None):
+        self.bounds = list(buckets or DEFAULT_BUCKETS)
+        self.counts = [0] * (len(self.bounds) + 1)
+        self.count = 0
+        self.sum = 0.0
+        self.min = math.inf
+        self.max = -math.inf
+        self._lock = threading.Lock()
+
+    def observe(self, value: float):
+        if value is None or value != value:
+            return
+        with self._lock:
+            self.counts[bisect.bisect_left(self.bounds, value)] += 1
+            self.count += 1
+            self.sum += value
+            self.min = min(self.min, value)
+            self.max = max(self.max, value)
+
+    @property
+    def mean(self) -> float:
+        return self.sum / self.count if self.count else math.nan
+
+    def quantile(self, q: float) -> float:
+        if not self.count:
+            return math.nan
+        target = q * self.count
+        cumulative = 0
+        for i, c in enumerate(self.counts):
+            if c and cumulative + c >= target:
+                lower = self.bounds[i - 1] if i > 0 else self.min
+                upper = self.bounds[i] if i < len(self.bounds) else self.max
+                lower, upper = max(lower, self.min), min(upper, self.max)
+                return lower + (upper - lower) * (target - cumulative) / c
+            cumulative += c
+        return self.max
+
+    def summary(self) -> Dict[str, float]:
+        return {'count': self.count, 'mean': self.mean, 'min': self.min if self.count else math.nan,
+                'p50': self.quantile(0.5), 'p90': self.quantile(0.9), 'p99': self.quantile(0.99),
+                'max': self.max if self.count else math.nan}
+
+
+class MetricsRegistry:
+    """指标注册表，同名同标签的指标只创建一次"""
+
+    def __init__(self):
+        self._metrics: Dict[tuple, object] = {}
+        self._kinds: Dict[str, str] = {}
+        self._lock = threading.Lock()
+        self._listeners: List[Callable[[str, Dict[str, str], float], None]] = []
+
+    def _get(self, kind: str, factory, name: str, labels: Dict[str, str]):
+        key = _key(name, labels)
+        metric = self._metrics.get(key)
+        if metric is None:
+            with self._lock:
+                if self._kinds.setdefault(name, kind) != kind:
+                    raise ValueError(f"Metric {name} already registered as {self._kinds[name]}")
+                metric = self._metrics.setdefault(key, factory())
+        return metric
+
+    def counter(self, name: str, **labels) -> Counter:
+        return self._get('counter', Counter, name, labels)
+
+    def gauge(self, name: str, **labels) -> Gauge:
+        return self._get('gauge', Gauge, name, labels)
+
+    def histogram(self, name: str, buckets: Sequence[float] = None, **labels) -> Histogram:
+        return self._get('histogram', lambda: Histogram(buckets), name, labels)
+
+    def observe(self, name: str, value: float, buckets: Sequence[float] = None, **labels):
+        """写入直方图，并通知订阅者（流式转发到外部系统）"""
+        self.histogram(name, buckets, **labels).observe(value)
+        for listener in self._listeners:
+            listener(name, labels, value)
+
+    def subscribe(self, listener: Callable[[str, Dict[str, str], float], None]):
+        """订阅 observe 写入的每个数值：listener(名称, 标签, 数值)"""
+        self._listeners.append(listener)
+
+    def snapshot(self) -> Dict[str, List[dict]]:
+        """{名称: [{'labels', 值或直方图统计}]}"""
+        result: Dict[str, List[dict]] = {}
+        for (name, labels), metric in list(self._metrics.items()):
+            entry = {'labels': dict(labels)}
+            if isinstance(metric, Histogram):
+                entry.update(metric.summary())
+            else:
+                entry['value'] = metric.value
+            result.setdefault(name, []).append(entry)
+        return result
+
+    def to_prometheus(self) -> str:
+        """Prometheus 文本格式"""
+        lines = []
+        for (name, labels), metric in sorted(self._metrics.items(), key=lambda item: item[0]):
+            label_text = ','.join(f'{k}="{v}"' for k, v in labels)
+            if isinstance(metric, Histogram):
+                cumulative = 0
+                for bound, count in zip(metric.bounds + ['+Inf'], metric.counts):
+                    cumulative += count
+                    le = bound if isinstance(bound, str) else f'{bound:g}'
+                    lines.append(f'{name}_bucket{{{label_text}{"," if label_text else ""}le="{le}"}} {cumulative}')
+                lines.append(f'{name}_sum{{{label_text}}} {metric.sum}')
+                lines.append(f'{name}_count{{{label_text}}} {metric.count}')
+            else:
+                lines.append(f'{name}{{{label_text}}} {metric.value}')
+        return '\n'.join(lines) + '\n'
+
+    def reset(self):
+        with self._lock:
+            self._metrics.clear()
+            self._kinds.clear()
+
+
+# 默认注册表
+METRICS = MetricsRegistry()
@@ -0,0 +1,23 @@
+"""
+交易日归属
+期货夜盘（21:00起，跨零点至次日凌晨）计入下一交易日，周五夜盘计入下周一；
+按交易日切换的风控（当日亏损、日内回撤）共用，与 strategy_dsl 中回测内核的交易日划分一致，不依赖其他模块
+"""
+from datetime import date, datetime, timedelta
+
+# 夜盘开始时刻（21:00）平移到次日零点
+_NIGHT_SHIFT = timedelta(hours=3)
+
+
+def trading_day(dt: datetime = None) -> date:
+    """
+    时间点所属的交易日
+    :param dt: 北京时间，默认为当前时间
+    """
+    day = ((dt or datetime.now()) + _NIGHT_SHIFT).date()
+    weekday = day.weekday()
+    if weekday == 5:
+        day += timedelta(days=2)
+    elif weekday == 6:
+        day += timedelta(days=1)
+    return day